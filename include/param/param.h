@@ -263,6 +263,29 @@ void param_set_string(param_t * param, const char * inbuf, int len);
 void param_set(param_t * param, unsigned int offset, void * value);
 void param_get(param_t * param, unsigned int offset, void * value);
 
+/**
+ * Read count elements from offset into values, packed and in host byte order.
+ * VMEM parameters are read with a single scatter/gather transfer per 16 elements.
+ * Not for strings and data, count is clipped to the array size.
+ */
+void param_get_array(param_t * param, unsigned int offset, unsigned int count, void * values);
+
+/**
+ * CHANGE TRACKING
+ *
+ * All setters advance a global change sequence and stamp the parameter version
+ * with it. Code writing directly to the RAM of a parameter must call param_touch()
+ * for the change to be visible to "changed since" pulls and the pull cache.
+ *
+ * Versions are kept in a table indexed by position in the static param section, so
+ * param_t stays unchanged. Only the first PARAM_VERSIONS static params are tracked,
+ * param_version() returns NULL for the rest. Writes to those still advance the
+ * sequence, and "changed since" pulls always include them.
+ */
+extern uint32_t param_change_seq;
+void param_touch(param_t * param);
+uint32_t * param_version(param_t * param);
+
 /* Returns the size of a native type */
 int param_typesize(param_type_e type);
 int param_size(param_t * param);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <param/param.h>
+#include <vmem/vmem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * COMPRESSED TELEMETRY ARCHIVE
+ *
+ * Values written to archived parameters by param_queue_apply are compressed per
+ * parameter (column) in RAM, and full blocks are appended as entries to a
+ * vmem_ring. Timestamps are stored as delta-of-delta, values as the XOR with the
+ * previous value (Gorilla style), so a slowly changing value at a fixed interval
+ * costs a few bits per sample.
+ *
+ * A block is a 20 byte big endian header followed by the bitstream:
+ *   magic(2) id(2) node(2) type(1) reserved(1) count(2) reserved(2) first(4) last(4)
+ * The first value is stored raw (64 bits) at the start of the bitstream.
+ *
+ * Only numeric, non-array parameters can be archived. Values are returned as
+ * double, so 64 bit integers above 2^53 lose precision when queried.
+ */
+
+#ifndef PARAM_ARCHIVE_COLUMNS
+#define PARAM_ARCHIVE_COLUMNS 32
+#endif
+
+#ifndef PARAM_ARCHIVE_MASKS
+#define PARAM_ARCHIVE_MASKS 4
+#endif
+
+#ifndef PARAM_ARCHIVE_BLOCK_SIZE
+#define PARAM_ARCHIVE_BLOCK_SIZE 256
+#endif
+
+#define PARAM_ARCHIVE_MAGIC 0xA5C1
+
+typedef struct __attribute__((packed)) {
+	uint16_t magic;
+	uint16_t id;
+	uint16_t node;
+	uint8_t type;
+	uint8_t reserved;
+	uint16_t count;
+	uint16_t reserved2;
+	uint32_t first_time;
+	uint32_t last_time;
+} param_archive_block_t;
+
+typedef void (*param_archive_sample_f)(uint32_t time, double value, void * context);
+
+/**
+ * Select the ring the archive is written to, must be a vmem_ring
+ */
+void param_archive_init(vmem_t * ring);
+
+/**
+ * Archive a parameter
+ * @return 0 = OK, -1 on unsupported type or column table full
+ */
+int param_archive_add(param_t * param);
+
+/**
+ * Archive all parameters matching any bit in mask, including parameters added later
+ * @return 0 = OK, -1 if the mask table is full
+ */
+int param_archive_add_mask(uint32_t mask);
+
+/**
+ * Compress the current value of a parameter, called from param_queue_apply
+ * @param timestamp     UNIX seconds, 0 for local time
+ */
+void param_archive_record(param_t * param, uint32_t timestamp);
+
+/**
+ * Write all partially filled blocks to the ring
+ */
+void param_archive_flush(void);
+
+/**
+ * Call callback for every sample of (node, id) in [from, to], oldest first,
+ * including samples not yet flushed. The callback runs with the archive ring
+ * locked, so it must not record or flush.
+ * @return number of samples, -1 if no archive ring is set
+ */
+int param_archive_query(uint16_t node, uint16_t id, uint32_t from, uint32_t to, param_archive_sample_f callback, void * context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <param/param.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * CLIENT SIDE VALUE CACHE
+ *
+ * Remote parameters keep a local RAM copy of their value. The cache layer decides
+ * whether that copy is recent enough to be served without a network pull.
+ *
+ * A max-age policy can be set per parameter or per mask. Parameters without any
+ * policy are always pulled. When a cached value is older than its max-age, the
+ * stale value is returned immediately and a refresh is queued for a single
+ * background worker. Concurrent reads of the same parameter share a single
+ * in-flight pull. The age of a value also follows the parameter timestamp, so
+ * values received through other pulls or pushes refresh the cache.
+ *
+ * Entries are keyed by node, id and the host pulled from, and the least recently
+ * used entry is reclaimed when the table is full.
+ */
+
+#ifndef PARAM_CACHE_ENTRIES
+#define PARAM_CACHE_ENTRIES 256
+#endif
+
+#ifndef PARAM_CACHE_PARAM_POLICIES
+#define PARAM_CACHE_PARAM_POLICIES 64
+#endif
+
+#ifndef PARAM_CACHE_MASK_POLICIES
+#define PARAM_CACHE_MASK_POLICIES 8
+#endif
+
+/**
+ * Set max-age for a single parameter, overrides any mask policy.
+ * @param param         pointer to remote parameter
+ * @param max_age       in ms, 0 removes the policy
+ * @return              0 = OK, -1 if the policy table is full
+ */
+int param_cache_set_maxage(param_t * param, uint32_t max_age);
+
+/**
+ * Set max-age for all parameters matching any bit in mask
+ * @param mask          parameter mask
+ * @param max_age       in ms, 0 removes the policy
+ * @return              0 = OK, -1 if the policy table is full
+ */
+int param_cache_set_maxage_mask(uint32_t mask, uint32_t max_age);
+
+/**
+ * Lookup the effective max-age of a parameter
+ * @return              max-age in ms, 0 if the parameter is not cached
+ */
+uint32_t param_cache_get_maxage(param_t * param);
+
+/**
+ * Mark all cached values as invalid, next read will pull
+ */
+void param_cache_invalidate(void);
+
+/**
+ * PULL single through the cache:
+ *
+ * Same arguments as param_pull_single. Fresh values are served locally, stale values are
+ * served locally while a background pull refreshes them. Only the first read of a parameter
+ * (or a parameter without policy) blocks on the network.
+ *
+ * @return              0 = ok, -1 on network error
+ */
+int param_pull_single_cached(param_t *param, int offset, uint8_t prio, int verbose, int host, int timeout, int version);
+
+void param_cache_print(void);
+
+#ifdef __cplusplus
+}
+#endif
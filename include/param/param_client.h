@@ -49,6 +49,23 @@ int param_pull_single(param_t *param, int offset, uint8_t prio, int verbose, int
  */
 int param_pull_all(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, int timeout, int version);
 
+/**
+ * PULL all, counting the bytes on the link
+ * @param bytes         output, request and response payload bytes
+ */
+int param_pull_all_bytes(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, int timeout, int version, uint32_t * bytes);
+
+/**
+ * PULL all changed since
+ *
+ * Like pull all, but the server only returns parameters written after the given
+ * change sequence. Untracked parameters are always returned. Start with since = 0.
+ *
+ * @param since         in: last known server change sequence, out: current server sequence
+ * @return              0 = OK, -1 on network error
+ */
+int param_pull_all_since(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, uint32_t * since, int timeout);
+
 /**
  * PUSH single:
  *
@@ -7,4 +7,69 @@
 
 #pragma once
 
+#include <stdint.h>
+
+/**
+ * The collector pulls (node, mask) pairs at fixed intervals. Jobs are kept in a
+ * min-heap ordered by deadline, and the loop sleeps until the earliest one is due.
+ * Due pulls are handed to PARAM_COLLECTOR_WORKERS threads, so a slow node does not
+ * delay the others. A job still in progress when it is due again is skipped.
+ *
+ * Bandwidth budget: the response size of every job is learned, and when the sum
+ * of all jobs exceeds param_collector_budget (bytes per second, 0 = unlimited),
+ * intervals are stretched by priority class, taken from the PM_PRIO bits of the
+ * job mask. PM_PRIO1 jobs always keep their rate, PM_PRIO2 jobs share what is left,
+ * and PM_PRIO3 (or jobs without a single priority) get the remainder. No job is
+ * slowed more than PARAM_COLLECTOR_MAX_STRETCH times.
+ */
+
+#ifndef PARAM_COLLECTOR_JOBS
+#define PARAM_COLLECTOR_JOBS 256
+#endif
+
+#ifndef PARAM_COLLECTOR_WORKERS
+#define PARAM_COLLECTOR_WORKERS 4
+#endif
+
+#ifndef PARAM_COLLECTOR_TIMEOUT
+#define PARAM_COLLECTOR_TIMEOUT 1000
+#endif
+
+/**
+ * Size of the col_cnfstr config string, stored at offset 0x02 of the application's
+ * vmem_col, which must be at least 2 + PARAM_COLLECTOR_CNFSTR_SIZE bytes. Every
+ * "node interval mask phase jitter," entry takes up to about 40 characters, so the
+ * default only fits a handful of jobs. Larger job sets are added with
+ * param_collector_add(), or by raising this together with vmem_col.
+ */
+#ifndef PARAM_COLLECTOR_CNFSTR_SIZE
+#define PARAM_COLLECTOR_CNFSTR_SIZE 100
+#endif
+
+#ifndef PARAM_COLLECTOR_MAX_STRETCH
+#define PARAM_COLLECTOR_MAX_STRETCH 16
+#endif
+
+#define PARAM_COLLECTOR_PHASE_AUTO -1
+
+/* Link budget in bytes per second, 0 = unlimited */
+extern uint32_t param_collector_budget;
+
+/**
+ * Add a collection job
+ * @param node          node to pull from
+ * @param interval      in ms
+ * @param mask          include mask
+ * @param phase         offset in ms from the interval grid, PARAM_COLLECTOR_PHASE_AUTO
+ *                      derives one from node and mask to spread jobs with equal interval
+ * @param jitter        random delay of up to this many ms added to every pull
+ * @return              0 = OK, -1 if the job table is full
+ */
+int param_collector_add(uint16_t node, uint32_t interval, uint32_t mask, int32_t phase, uint32_t jitter);
+
+/**
+ * Remove all jobs. Pulls already in progress are completed.
+ */
+void param_collector_clear(void);
+
 void param_collector_loop(void * param);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <param/param.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * PARAMETER HISTORY
+ *
+ * Parameters with history enabled keep their last values in a ring of
+ * (timestamp, value) samples, filled whenever param_queue_apply writes them,
+ * i.e. by pulls, pushes and the collector. The timestamps are those carried in
+ * the packet, or the local clock when there is none (UNIX seconds).
+ *
+ * A ring stores its timestamps and its values in two separate arrays, with values
+ * in their native size, taken from a static pool of PARAM_HISTORY bytes. Only
+ * numeric, non-array parameters are supported.
+ *
+ * Writers claim slots with an atomic increment and stamp each slot with its
+ * sequence number once written. Readers drop samples whose stamp is missing or
+ * changed while they were being copied, so no locks are taken and no writer
+ * waits for another. Rings are never freed.
+ */
+
+#ifndef PARAM_HISTORY_RINGS
+#define PARAM_HISTORY_RINGS 64
+#endif
+
+#ifndef PARAM_HISTORY_MASKS
+#define PARAM_HISTORY_MASKS 4
+#endif
+
+/**
+ * Enable history for a parameter
+ * @param depth         number of samples kept
+ * @return              0 = OK, -1 on unsupported type or out of rings/pool
+ */
+int param_history_enable(param_t * param, int depth);
+
+/**
+ * Enable history for all parameters matching any bit in mask, including
+ * parameters added later. Rings are allocated on first write.
+ * @return              0 = OK, -1 if the mask policy table is full
+ */
+int param_history_enable_mask(uint32_t mask, int depth);
+
+/**
+ * Record the current value of a parameter, called from param_queue_apply
+ * @param timestamp     UNIX seconds, 0 for local time
+ */
+void param_history_record(param_t * param, uint32_t timestamp);
+
+/**
+ * Get samples in the time range [from, to], oldest first.
+ * If more than max samples match, the newest max are returned.
+ * @return              number of samples, -1 if param has no history
+ */
+int param_history_query(param_t * param, uint32_t from, uint32_t to, uint32_t * times, double * values, int max);
+
+#ifdef __cplusplus
+}
+#endif
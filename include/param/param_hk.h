@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <param/param.h>
+#include <param/param_server.h>
+#include <vmem/vmem.h>
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * HOUSEKEEPING STORE
+ *
+ * Every interval of a priority class, the local parameters flagged with that
+ * PM_PRIO class are serialized into V2 param queues, which are stored as
+ * OBJ_TYPE_HK_QUEUE objects in the objstore on vmem_hk. A single
+ * OBJ_TYPE_HK_INDEX object holds the (time, offset) of every stored queue,
+ * sorted by time. When the store or the index is full, the oldest queue is
+ * deleted.
+ *
+ * A ground station retrieves a time range with PARAM_HK_REQUEST, and the server
+ * streams the stored queues back as PARAM_HK_RESPONSE packets, which the client
+ * applies with the stored time as timestamp. This allows gaps after loss of
+ * signal to be filled in, without any per sample cost on board beyond the
+ * periodic serialization.
+ *
+ * Request layout (PARAM_HK_REQUEST):
+ *   data[0]     packet type
+ *   data[1]     flags
+ *   data32[1]   from, UNIX seconds
+ *   data32[2]   to, UNIX seconds
+ *
+ * Response (PARAM_HK_RESPONSE):
+ *   data[0]     packet type
+ *   data[1]     flags (PARAM_FLAG_END on the last packet, with PARAM_FLAG_PARTIAL
+ *               if the server ran out of buffers before the end of the range)
+ *   data[2]     priority class
+ *   data[3]     reserved
+ *   data32[1]   time the queue was stored, UNIX seconds
+ *   data[8..]   V2 queue, empty if nothing was found
+ */
+
+extern vmem_t vmem_hk;
+
+#ifndef PARAM_HK_INDEX
+#define PARAM_HK_INDEX 128
+#endif
+
+#define PARAM_HK_HEADER_SIZE 8
+#define PARAM_HK_QUEUE_SIZE (PARAM_SERVER_MTU - PARAM_HK_HEADER_SIZE)
+
+/* Number of PM_PRIO classes (PM_PRIO1 to PM_PRIO3) */
+#define PARAM_HK_CLASSES 3
+
+/**
+ * Server side
+ */
+void param_hk_server_init(void);
+void param_serve_hk(csp_packet_t * request);
+
+/**
+ * Set the logging interval of a priority class
+ * @param prio          1 to PARAM_HK_CLASSES
+ * @param interval      seconds, 0 = not logged (default)
+ */
+void param_hk_set_interval(int prio, uint32_t interval);
+
+/**
+ * Store the classes whose interval has passed
+ * @param timestamp     current UNIX time in seconds
+ * @return              number of queues stored, -1 on error
+ */
+int param_hk_server_update(uint32_t timestamp);
+
+/**
+ * Convenience task calling param_hk_server_update() every second
+ */
+void param_hk_loop(void * param);
+
+/**
+ * Client side
+ *
+ * Retrieve and apply the stored values in [from, to] from server
+ * @param verbose       print the time and size of every queue received
+ * @return              number of queues received, -1 on error or if the server
+ *                      could not send the whole range. The queues received are
+ *                      applied regardless, so the rest can be retrieved from
+ *                      the time of the last one.
+ */
+int param_hk_retrieve(int server, uint32_t from, uint32_t to, int verbose, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <libparam.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * CLIENT ROUND-TRIP LATENCY
+ *
+ * Every param_transaction records, per host, the time to open the connection,
+ * the time from sending the request to the first response packet and to the
+ * packet with the end flag. The times are kept in log-linear (HDR style)
+ * histograms with 1 ms resolution up to 16 ms and 8 sub-buckets per power of
+ * two above that, so any value is known within 12.5%.
+ *
+ * A retry is counted when a transaction to a host follows a failed one.
+ *
+ * Statistics are kept for the first PARAM_LATENCY_HOSTS hosts contacted.
+ */
+
+#define PARAM_LATENCY_BUCKETS 128
+
+typedef enum {
+	PARAM_LATENCY_CONNECT,
+	PARAM_LATENCY_FIRST,
+	PARAM_LATENCY_END,
+	PARAM_LATENCY_STAGES,
+} param_latency_stage_e;
+
+typedef struct {
+	uint32_t count;
+	uint32_t max;
+	uint32_t bucket[PARAM_LATENCY_BUCKETS];
+} param_latency_hist_t;
+
+typedef struct {
+	uint16_t host;
+	uint8_t last_failed;
+	uint32_t transactions;
+	uint32_t connect_failures;
+	uint32_t timeouts;
+	uint32_t retries;
+	param_latency_hist_t hist[PARAM_LATENCY_STAGES];
+} param_latency_t;
+
+/**
+ * Record a transaction
+ * @param connect       ms to open the connection, -1 if it failed
+ * @param first         ms from request to first response, -1 if none arrived
+ * @param end           ms from request to end flag, -1 on timeout
+ */
+void param_latency_record(int host, int connect, int first, int end);
+
+/**
+ * Copy the statistics of a host
+ * @return 0 = OK, -1 if nothing was recorded for host
+ */
+int param_latency_get(int host, param_latency_t * out);
+
+/**
+ * Value below which the given fraction of samples fall
+ * @param fraction      0.0 to 1.0, e.g. 0.99 for the 99th percentile
+ * @return upper bound of the bucket in ms, 0 if empty
+ */
+uint32_t param_latency_percentile(const param_latency_hist_t * hist, float fraction);
+
+/**
+ * @param host          host to clear, -1 for all
+ */
+void param_latency_clear(int host);
+
+void param_latency_print(int host);
+
+#ifdef __cplusplus
+}
+#endif
@@ -42,6 +42,18 @@ int param_list_remove(int node, uint8_t verbose);
  */
 void param_list_remove_specific(param_t * param, uint8_t verbose, int destroy);
 param_t * param_list_find_id(int node, int id);
+
+/**
+ * @brief Call callback for every parameter with any bit of include_mask and no bit of exclude_mask set.
+ *
+ * Parameters are visited in list order. With PARAM_MASK_INDEX > 0 the matching set is found
+ * from per-bit membership bitmaps, otherwise the list is scanned.
+ *
+ * @param callback Return a negative value to stop the iteration.
+ * @return The last callback result, 0 if nothing matched.
+ */
+typedef int (*param_list_mask_callback_f)(param_t * param, void * context);
+int param_list_foreach_mask(uint32_t include_mask, uint32_t exclude_mask, param_list_mask_callback_f callback, void * context);
 param_t * param_list_find_name(int node, const char * name);
 void param_list_print(uint32_t mask, int node, const char * globstr, int verbosity);
 uint32_t param_maskstr_to_mask(const char * str);
@@ -55,6 +55,12 @@ typedef enum {
 	PARAM_COMMAND_EXEC_RESPONSE = 31,
 	PARAM_SCHEDULE_COMMAND_REQUEST = 32,
 	PARAM_PUSH_REQUEST_V2_HWID = 33,
+	PARAM_SUBSCRIBE_REQUEST = 34,
+	PARAM_SUBSCRIBE_RESPONSE = 35,
+	PARAM_PULL_ALL_SINCE_REQUEST = 36,  // Pull all with data32[3] = change sequence, only newer values are returned
+	PARAM_PULL_SINCE_RESPONSE = 37,     // Pull response with data32[1] = server change sequence, queue from data[8]
+	PARAM_HK_REQUEST = 38,              // Stored housekeeping in time range data32[1] to data32[2]
+	PARAM_HK_RESPONSE = 39,             // Stored queue with data32[1] = time it was stored, queue from data[8]
 
 } param_packet_type_e;
 
@@ -62,6 +68,7 @@ typedef enum {
  * Second byte on all packets contains flags
  */
 #define PARAM_FLAG_END (1 << 7)
+#define PARAM_FLAG_PARTIAL (1 << 6)	// With END: the server stopped before the end of the requested range
 
 /**
  * Handle incoming parameter requests
@@ -71,3 +78,27 @@ typedef enum {
  * @param packet
  */
 void param_serve(csp_packet_t * packet);
+
+/**
+ * Dispatcher
+ *
+ * Drop-in replacement for param_serve, for use on the router task. Pull requests for
+ * RAM parameters are answered inline, everything else is queued per CSP priority and
+ * served by worker tasks running param_serve_worker_loop(). The application decides
+ * how many workers to start. Packets arriving at a full queue are dropped and counted
+ * in param_dispatch_dropped.
+ */
+#ifndef PARAM_DISPATCH_QUEUE_LENGTH
+#define PARAM_DISPATCH_QUEUE_LENGTH 8
+#endif
+
+extern uint32_t param_dispatch_dropped;
+void param_serve_dispatch_init(void);
+void param_serve_dispatch(csp_packet_t * packet);
+void param_serve_worker_loop(void * param);
+
+/**
+ * Coalescing of identical concurrent pull requests (PARAM_COALESCE > 0)
+ * Needs the external si_lock hooks, coalescing stays disabled until this is called.
+ */
+void param_serve_coalesce_init(void);
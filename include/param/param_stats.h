@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <libparam.h>
+
+/**
+ * Server instrumentation
+ *
+ * Counters are kept per thread and summed when the stats parameters are read,
+ * so the hot path is a single uncontended add. Writing a stats parameter resets it.
+ *
+ * The parameters are defined in the reserved id range starting at PARAMID_STATS_BASE,
+ * which can be moved by defining it before including this file (e.g. in param_config.h).
+ */
+
+#ifndef PARAMID_STATS_BASE
+#define PARAMID_STATS_BASE 992
+#endif
+
+/* Number of threads with a private slot, any further threads share the last one */
+#ifndef PARAM_STATS_SLOTS
+#define PARAM_STATS_SLOTS 4
+#endif
+
+/* Request counters are indexed by packet type (param_packet_type_e) */
+#define PARAM_STATS_TYPES 40
+
+/* Service time histogram, bucket 0 is < 1 ms, bucket n is [2^(n-1), 2^n) ms, the last is open ended */
+#define PARAM_STATS_BUCKETS 8
+
+typedef enum {
+	PARAM_STATS_APPLIED,		// Entries applied by param_queue_apply
+	PARAM_STATS_UNKNOWN,		// Entries skipped by param_queue_apply, parameter not found
+	PARAM_STATS_BYTES_IN,		// Request bytes received by the servers
+	PARAM_STATS_BYTES_OUT,		// Response bytes sent by the servers
+	PARAM_STATS_NOBUF,			// CSP buffer allocation failures in the servers
+	PARAM_STATS_VMEM_REQUESTS,	// Requests handled by vmem_server_handler
+	PARAM_STATS_LIST_REQUESTS,	// Requests handled by rparam_list_handler
+	PARAM_STATS_REQUESTS,		// Start of param_serve counters per packet type
+	PARAM_STATS_TIME = PARAM_STATS_REQUESTS + PARAM_STATS_TYPES,
+	PARAM_STATS_WORDS = PARAM_STATS_TIME + PARAM_STATS_BUCKETS,
+} param_stats_counter_e;
+
+#ifdef PARAM_HAVE_STATS
+
+void param_stats_add(int counter, uint32_t value);
+
+/**
+ * Count a request of given packet type
+ */
+void param_stats_request(int type, uint32_t length);
+
+/**
+ * Start timing a request
+ * @return start time for param_stats_time
+ */
+uint32_t param_stats_start(void);
+
+/**
+ * Add the time elapsed since start to the service time histogram
+ * @param start param_stats_start() when the request was received
+ */
+void param_stats_time(uint32_t start);
+
+/**
+ * Read the aggregated counters
+ * @param out array of PARAM_STATS_WORDS counters
+ */
+void param_stats_get(uint32_t * out);
+void param_stats_reset(void);
+
+#else
+
+static inline void param_stats_add(int counter, uint32_t value) {}
+static inline void param_stats_request(int type, uint32_t length) {}
+static inline uint32_t param_stats_start(void) { return 0; }
+static inline void param_stats_time(uint32_t start) {}
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <param/param.h>
+#include <param/param_queue.h>
+#include <csp/csp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * SUBSCRIPTIONS
+ *
+ * A client registers either a mask or a list of parameters with the server. The server
+ * checks the subscribed values every interval and only sends the ones that changed, as
+ * unsolicited PARAM_PULL_RESPONSE_V2 packets to the subscriber's PARAM_PORT_SERVER.
+ * The subscriber's normal param_serve() applies them to its remote parameter copies.
+ *
+ * Each subscriber node has a single subscription, a new request replaces the old one.
+ * Subscriptions expire after their lease, so clients must renew them periodically.
+ *
+ * Request layout (PARAM_SUBSCRIBE_REQUEST):
+ *   data[0]     packet type
+ *   data[1]     flags (PARAM_SUBSCRIBE_FLAG_*)
+ *   data32[1]   include mask
+ *   data32[2]   exclude mask
+ *   data32[3]   min interval in ms
+ *   data32[4]   deadband (IEEE754 float bits), 0 = any change
+ *   data32[5]   lease in seconds, 0 = PARAM_SUBSCRIBE_LEASE_DEFAULT
+ *   data[24..]  optional V2 get queue, replaces the masks when present
+ *
+ * Response (PARAM_SUBSCRIBE_RESPONSE):
+ *   data[2]     number of subscribed parameters, 0 on failure
+ */
+
+#ifndef PARAM_SUBSCRIBE_MAX
+#define PARAM_SUBSCRIBE_MAX 8
+#endif
+
+/* At most 255, the response reports the count in one byte */
+#ifndef PARAM_SUBSCRIBE_PARAMS
+#define PARAM_SUBSCRIBE_PARAMS 64
+#endif
+
+#ifndef PARAM_SUBSCRIBE_LEASE_DEFAULT
+#define PARAM_SUBSCRIBE_LEASE_DEFAULT 600
+#endif
+
+#define PARAM_SUBSCRIBE_HEADER_SIZE 24
+
+#define PARAM_SUBSCRIBE_FLAG_CANCEL (1 << 0)
+
+/**
+ * Server side
+ */
+void param_subscribe_server_init(void);
+void param_serve_subscribe(csp_packet_t * request);
+
+/**
+ * Check all subscriptions and send the values that changed
+ * @param now_ms        current time, typically csp_get_ms()
+ */
+void param_subscribe_server_update(uint32_t now_ms);
+
+/**
+ * Convenience task calling param_subscribe_server_update() every 100 ms
+ */
+void param_subscribe_loop(void * param);
+
+/**
+ * Client side
+ *
+ * @param server        remote csp node
+ * @param include_mask  parameter mask, ignored when queue is given
+ * @param exclude_mask  parameter mask, ignored when queue is given
+ * @param queue         optional get queue with explicit parameters, NULL for mask
+ * @param interval      min interval between updates in ms
+ * @param deadband      minimum absolute change of numeric scalars, 0 for any change
+ * @param lease         subscription lifetime in seconds
+ * @param verbose       printout
+ * @param timeout       in ms
+ * @return              number of subscribed parameters, -1 on error
+ */
+int param_subscribe(int server, uint32_t include_mask, uint32_t exclude_mask, param_queue_t * queue, uint32_t interval, float deadband, uint32_t lease, int verbose, int timeout);
+int param_unsubscribe(int server, int verbose, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <libparam.h>
+
+/**
+ * Hot path tracing (PARAM_TRACE > 0)
+ *
+ * Every traced call appends a 16 byte event to a per thread ring of PARAM_TRACE
+ * events, overwriting the oldest. Appending is a clock read and a relaxed
+ * atomic increment, no locks are taken. The whole trace buffer is mapped as
+ * the "trace" VMEM, so it can be fetched with vmem download, and written to a
+ * file with param_trace_dump(). Both produce the same binary format,
+ * which is decoded by tools/param_trace_decode.py.
+ */
+
+#define PARAM_TRACE_MAGIC 0x50545243	// "PTRC"
+#define PARAM_TRACE_VERSION 1
+
+/* Number of threads with a private ring, any further threads share the last one */
+#ifndef PARAM_TRACE_THREADS
+#define PARAM_TRACE_THREADS 4
+#endif
+
+typedef enum {
+	PARAM_TRACE_GET = 1,		// param_get_*, id/node of param, length is array index
+	PARAM_TRACE_SET = 2,		// param_set_*, id/node of param, length is array index
+	PARAM_TRACE_GET_DATA = 3,	// param_get_data, length in bytes
+	PARAM_TRACE_SET_DATA = 4,	// param_set_data, length in bytes
+	PARAM_TRACE_APPLY = 5,		// param_queue_apply, node is source, length is queue bytes
+	PARAM_TRACE_TRANSACTION = 6,	// param_transaction, node is host, length is request bytes
+	PARAM_TRACE_VMEM_READ = 7,	// vmem driver read, id is vmem index, length in bytes
+	PARAM_TRACE_VMEM_WRITE = 8,	// vmem driver write, id is vmem index, length in bytes
+} param_trace_op_e;
+
+typedef struct {
+	uint32_t time;				// Start time, param_trace_clock() [us]
+	uint32_t duration;			// [us]
+	uint16_t id;
+	uint16_t node;
+	uint8_t op;
+	uint8_t thread;
+	uint16_t length;
+} param_trace_event_t;
+
+#if PARAM_TRACE > 0
+
+/**
+ * Trace buffer layout, in host byte order (the decoder uses magic to detect it)
+ * Ring i holds head[i] events in total, the newest at (head[i] - 1) % entries.
+ */
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t threads;
+	uint32_t entries;
+	uint32_t head[PARAM_TRACE_THREADS];
+	param_trace_event_t ring[PARAM_TRACE_THREADS][PARAM_TRACE];
+} param_trace_buffer_t;
+
+/**
+ * Microsecond clock used for events. Weak, can be replaced by a cycle counter
+ */
+uint32_t param_trace_clock(void);
+
+void param_trace_event(uint8_t op, uint16_t id, uint16_t node, uint16_t length, uint32_t start);
+void param_trace_clear(void);
+
+#ifdef PARAM_HAVE_FOPEN
+/**
+ * Write the trace buffer to a file
+ * @return 0 on success, -1 on error
+ */
+int param_trace_dump(const char * filename);
+#endif
+
+#define PARAM_TRACE_BEGIN(_start) uint32_t _start = param_trace_clock()
+#define PARAM_TRACE_END(_start, _op, _id, _node, _length) param_trace_event(_op, _id, _node, _length, _start)
+
+#else
+
+#define PARAM_TRACE_BEGIN(_start)
+#define PARAM_TRACE_END(_start, _op, _id, _node, _length)
+
+#endif
@@ -32,6 +32,22 @@ enum vmem_types{
 	VMEM_TYPE_BLOCK = 10,
 };
 
+/**
+ * One segment of a scatter/gather transfer. addr is relative to the VMEM,
+ * like the addr of the read and write methods. For writes buf is only read.
+ */
+typedef struct {
+	uint64_t addr;
+	void * buf;
+	uint32_t len;
+} vmem_iovec_t;
+
+/* Access wanted from a mapping */
+enum vmem_map_flags {
+	VMEM_MAP_READ = 1,
+	VMEM_MAP_WRITE = 2,
+};
+
 typedef struct vmem_s {
 	int type;
 	void (*read)(struct vmem_s * vmem, uint64_t addr, void * dataout, uint32_t len);
@@ -64,6 +80,11 @@ typedef struct vmem_s {
 	int big_endian;
 	int ack_with_pull; // allow ack with pull request
 	void * driver;
+	/* Optional, transfer several segments in order. Drivers may merge adjacent segments */
+	void (*readv)(struct vmem_s * vmem, const vmem_iovec_t * iov, int count);
+	void (*writev)(struct vmem_s * vmem, const vmem_iovec_t * iov, int count);
+	/* Optional, pointer to [addr, addr + len] in process memory, or NULL if it cannot be mapped for this access */
+	void * (*map)(struct vmem_s * vmem, uint64_t addr, uint32_t len, int flags);
 } vmem_t;
 
 void * vmem_memcpy(void * to, const void * from, uint32_t size);
@@ -76,6 +97,32 @@ int vmem_ptr_to_index(vmem_t * vmem);
 vmem_t * vmem_vaddr_to_vmem(uint64_t vaddr);
 int vmem_flush(vmem_t *vmem);
 
+/**
+ * Scatter/gather transfer on a single VMEM. Uses the readv/writev method of the
+ * driver, or else calls read/write once per segment. VMEMs without methods are
+ * accessed directly at vaddr + addr.
+ */
+void vmem_readv(vmem_t * vmem, const vmem_iovec_t * iov, int count);
+void vmem_writev(vmem_t * vmem, const vmem_iovec_t * iov, int count);
+
+/**
+ * Direct pointer to VMEM data that lives in process memory (RAM, file and mmap).
+ * Loads and stores through it replace read/write calls. A write mapping is only
+ * given where a store needs no further action by the driver. The pointer stays
+ * valid until the VMEM is resized.
+ * @param flags VMEM_MAP_READ and/or VMEM_MAP_WRITE
+ * @return pointer, or NULL if the caller must use read/write
+ */
+static inline void * vmem_map(vmem_t * vmem, uint64_t addr, uint32_t len, int flags) {
+	return (vmem->map) ? vmem->map(vmem, addr, len, flags) : NULL;
+}
+
+/**
+ * With PARAM_VMEM_INDEX > 0 addresses are resolved through a sorted index of the
+ * VMEMs, built on first use. Call this after changing the vaddr or size of a VMEM.
+ */
+void vmem_index_invalidate(void);
+
 extern int __start_vmem __attribute__((weak)), __stop_vmem __attribute__((weak));
 
 #ifdef __cplusplus
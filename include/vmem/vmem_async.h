@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <libparam.h>
+#include <vmem/vmem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * ASYNCHRONOUS VMEM OPERATIONS
+ *
+ * A read or write is submitted and completes later on one of PARAM_VMEM_ASYNC
+ * worker threads, so the caller can do other work while a slow device (I2C/SPI
+ * FRAM, block devices) transfers the data. Any number of operations can be
+ * queued. Operations on the same VMEM are run one at a time in submission
+ * order, so drivers need not be thread safe, while different VMEMs run in
+ * parallel.
+ *
+ * With PARAM_VMEM_ASYNC = 0 there are no workers and operations complete
+ * before the submit call returns, so the same code runs without threads.
+ *
+ * The operation struct is owned by the caller and must stay valid until the
+ * operation is complete. That is when the callback is called, or, for
+ * operations without a callback, when vmem_async_wait() returns.
+ */
+
+typedef struct vmem_async_s vmem_async_t;
+
+typedef void (*vmem_async_callback_f)(vmem_async_t * op, void * context);
+
+struct vmem_async_s {
+	vmem_t * vmem;
+	uint64_t addr;				// Relative to the VMEM, like the read/write methods
+	void * buf;
+	uint32_t len;
+	int write;
+	vmem_async_callback_f callback;
+	void * context;
+
+	/* Private */
+	vmem_async_t * next;
+	volatile int done;
+};
+
+/**
+ * Submit a read of len bytes at addr in vmem into buf
+ * @param callback      called on the worker thread when the data is in buf, or NULL to use vmem_async_wait()
+ */
+void vmem_async_read(vmem_async_t * op, vmem_t * vmem, uint64_t addr, void * buf, uint32_t len, vmem_async_callback_f callback, void * context);
+
+/**
+ * Submit a write of len bytes from buf to addr in vmem. buf must not change until completion
+ */
+void vmem_async_write(vmem_async_t * op, vmem_t * vmem, uint64_t addr, const void * buf, uint32_t len, vmem_async_callback_f callback, void * context);
+
+/**
+ * Block until an operation submitted without a callback is complete
+ */
+void vmem_async_wait(vmem_async_t * op);
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,12 +22,34 @@ typedef struct vmem_block_driver_s vmem_block_driver_t;
 struct vmem_block_device_s;
 typedef struct vmem_block_device_s vmem_block_device_t;
 
-typedef struct vmem_block_cache_s {
+/**
+ * Set-associative cache of block sized lines with LRU replacement and
+ * write-back. Block n can only be held by the ways of set (n % sets), so a
+ * lookup scans one set. Regions on the same device may share a cache, also
+ * through different drivers. It is bound to the device of the first region
+ * that uses it, and regions on other devices bypass it. Runs of whole blocks that miss are transferred
+ * directly, so streaming does not evict the working set.
+ */
+typedef struct vmem_block_line_s {
+    uint32_t block;         // Device block held by the line
+    uint32_t used;          // Access stamp, the lowest in a set is evicted
     bool is_valid;
     bool is_modified;
-    uint32_t start_block;
-    uint32_t size;
+} vmem_block_line_t;
+
+typedef struct vmem_block_cache_s {
+    uint32_t size;          // Memory budget for line data in bytes
+    uint32_t max_lines;
+    uint8_t ways;
     uint8_t *data;
+    vmem_block_line_t *lines;
+
+    /* State, set up on first use */
+    const vmem_block_device_t *device;
+    uint32_t sets;
+    uint32_t clock;
+    uint32_t hits;
+    uint32_t misses;
 } vmem_block_cache_t;
 
 /* Block API methods */
@@ -60,17 +82,24 @@ typedef struct vmem_block_region_s {
 	vmem_block_cache_t * cache;
 } vmem_block_region_t;
 
-#define VMEM_DEFINE_BLOCK_CACHE(name_in, _csize) \
+#define VMEM_BLOCK_CACHE_WAYS 4
+
+/* Line metadata is allocated for blocks of _bsize bytes, devices with larger blocks use fewer lines */
+#define VMEM_DEFINE_BLOCK_CACHE_WAYS(name_in, _csize, _bsize, _ways) \
 	__attribute__((section(".noinit.cache"))) \
 	static uint8_t vmem_##name_in##_cache_data[_csize]; \
+	static vmem_block_line_t vmem_##name_in##_cache_lines[(_csize) / (_bsize)]; \
 	static vmem_block_cache_t vmem_##name_in##_cache = { \
-		.is_valid = false, \
-		.is_modified = false, \
-		.start_block = 0, \
 		.size = _csize, \
+		.max_lines = (_csize) / (_bsize), \
+		.ways = _ways, \
 		.data = &vmem_##name_in##_cache_data[0], \
+		.lines = &vmem_##name_in##_cache_lines[0], \
 	};
 
+#define VMEM_DEFINE_BLOCK_CACHE(name_in, _csize) \
+	VMEM_DEFINE_BLOCK_CACHE_WAYS(name_in, _csize, 512, VMEM_BLOCK_CACHE_WAYS)
+
 /* Macros for defining block- devices, drivers and regions */
 #define VMEM_DEFINE_BLOCK_DEVICE(name_in, strname, _bsize, _total_nblocks, init_fn) \
 	static uint8_t vmem_oneblock_##name_in##_storage[_bsize]; \
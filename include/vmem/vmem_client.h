@@ -7,6 +7,29 @@ int vmem_download(int node, int timeout, uint64_t address, uint32_t length, char
 int vmem_upload(int node, int timeout, uint64_t address, char * datain, uint32_t length, int version);
 int vmem_ring_download(int node, int timeout, const char * vmem_name, int offset, char * dataout, int version, int use_rdp);
 int vmem_ring_upload(int node, int timeout, const char * vmem_name, char * datain, uint32_t length, int version);
+
+/**
+ * Called for each ring entry received into dataout
+ * @param seq       entry sequence number, a jump means entries were evicted before they were sent
+ * @return 0 to continue, non-zero to stop
+ */
+typedef int (*vmem_ring_entry_f)(uint32_t seq, char * data, uint32_t length, void * context);
+
+/**
+ * Download ring entries [from, to) over one connection, negative indexes count back from the newest
+ * @param dataout   buffer for one entry, longer entries are truncated to size
+ * @return entries received, -1 if no connection
+ */
+int vmem_ring_download_range(int node, int timeout, const char * vmem_name, int from, int to, char * dataout, uint32_t size, vmem_ring_entry_f callback, void * context, int version);
+
+/**
+ * Download ring entries from index from on, then each new entry as it is appended,
+ * until the callback returns non-zero, vmem_client_abort() is called or the ring
+ * is idle for VMEM_SERVER_TIMEOUT. A from past the newest entry, e.g. INT32_MAX, only follows new entries.
+ * The server ends the follow every VMEM_SERVER_FOLLOW_SLICE, and it is re-armed from the next entry.
+ * @return entries received, -1 if no connection
+ */
+int vmem_ring_follow(int node, int timeout, const char * vmem_name, int from, char * dataout, uint32_t size, vmem_ring_entry_f callback, void * context, int version);
 void vmem_client_list(int node, int timeout, int version);
 int vmem_client_find(int node, int timeout, void * dataout, int version, char * name, int namelen);
 int vmem_client_backup(int node, int vmem_id, int timeout, int backup_or_restore);
@@ -8,22 +8,77 @@
 #ifndef LIB_PARAM_INCLUDE_VMEM_VMEM_FILE_H_
 #define LIB_PARAM_INCLUDE_VMEM_VMEM_FILE_H_
 
+#include <pthread.h>
 #include <vmem/vmem.h>
 
+/**
+ * The VMEM is a RAM image of the file. Writes mark byte ranges dirty, and a
+ * flush writes only those ranges to the file, with one pwrite per range on a
+ * file descriptor kept open. Up to VMEM_FILE_DIRTY_RANGES ranges are tracked,
+ * beyond that the closest ranges are merged.
+ *
+ * With dirty_limit = 0 every write is flushed at once (write-through). Otherwise
+ * writes are flushed when dirty_limit bytes are dirty, on vmem_flush(), and by
+ * vmem_file_flush_expired() once the oldest change is flush_interval ms old.
+ */
+
+#define VMEM_FILE_DIRTY_RANGES 4
+
+typedef enum {
+	VMEM_FILE_SYNC_NONE = 0,	// Leave it to the OS to write back the page cache
+	VMEM_FILE_SYNC_FSYNC = 1,	// fdatasync after each flush
+	VMEM_FILE_SYNC_ATOMIC = 2,	// Write the whole image to filename.tmp, fsync and rename it over the file
+} vmem_file_sync_e;
+
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+} vmem_file_range_t;
+
 typedef struct {
 	void * physaddr;
 	char * filename;
+	uint32_t dirty_limit;
+	uint32_t flush_interval;
+	uint8_t sync;
+
+	/* State */
+	int fd;						// Open descriptor + 1, 0 when not open
+	uint8_t lock;				// Spinlock for the RAM image and dirty ranges
+	pthread_mutex_t io_lock;	// Held across the file writes and syncs of a flush
+	uint8_t dirty_count;
+	uint32_t dirty_since;		// csp_get_ms() of the oldest unflushed write
+	vmem_file_range_t dirty[VMEM_FILE_DIRTY_RANGES];
 } vmem_file_driver_t;
 
 void vmem_file_init(vmem_t * vmem);
 void vmem_file_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t len);
 void vmem_file_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len);
+void vmem_file_readv(vmem_t * vmem, const vmem_iovec_t * iov, int count);
+void vmem_file_writev(vmem_t * vmem, const vmem_iovec_t * iov, int count);
+void * vmem_file_map(vmem_t * vmem, uint64_t addr, uint32_t len, int flags);
 
-#define VMEM_DEFINE_FILE(name_in, strname, filename_in, size_in) \
+/**
+ * Write the dirty ranges to the file
+ * @return 0 = OK, -1 on error, the ranges are then kept dirty
+ */
+int vmem_file_flush(vmem_t * vmem);
+
+/**
+ * Flush every file VMEM with changes older than its flush_interval.
+ * Call periodically, e.g. once a second.
+ */
+void vmem_file_flush_expired(void);
+
+#define VMEM_DEFINE_FILE_WRITEBACK(name_in, strname, filename_in, size_in, dirty_limit_in, flush_interval_in, sync_in) \
 	uint8_t vmem_##name_in##_buf[size_in] = {}; \
 	static vmem_file_driver_t vmem_##name_in##_driver = { \
 		.physaddr = vmem_##name_in##_buf, \
 		.filename = filename_in, \
+		.dirty_limit = dirty_limit_in, \
+		.flush_interval = flush_interval_in, \
+		.sync = sync_in, \
+		.io_lock = PTHREAD_MUTEX_INITIALIZER, \
 	}; \
 	__attribute__((section("vmem"))) \
 	__attribute__((aligned(1))) \
@@ -34,10 +89,18 @@ void vmem_file_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t
 		.size = size_in, \
 		.read = vmem_file_read, \
 		.write = vmem_file_write, \
+		.flush = vmem_file_flush, \
+		.readv = vmem_file_readv, \
+		.writev = vmem_file_writev, \
+		.map = vmem_file_map, \
 		.driver = &vmem_##name_in##_driver, \
 		.vaddr = (uint64_t)vmem_##name_in##_buf, \
 		.ack_with_pull = 1, \
 	};
 
+/* Write-through, every write reaches the file before returning */
+#define VMEM_DEFINE_FILE(name_in, strname, filename_in, size_in) \
+	VMEM_DEFINE_FILE_WRITEBACK(name_in, strname, filename_in, size_in, 0, 0, VMEM_FILE_SYNC_NONE)
+
 
 #endif /* LIB_PARAM_INCLUDE_VMEM_VMEM_FILE_H_ */
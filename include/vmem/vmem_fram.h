@@ -27,6 +27,8 @@ typedef struct {
 		.size = size_in, \
 		.read = vmem_fram_read, \
 		.write = vmem_fram_write, \
+		.readv = vmem_fram_readv, \
+		.writev = vmem_fram_writev, \
 		.driver = &vmem_##name_in##_driver, \
 		.vaddr = _vaddr, \
 		.ack_with_pull = 1, \
@@ -34,6 +36,8 @@ typedef struct {
 
 void vmem_fram_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t len);
 void vmem_fram_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len);
+void vmem_fram_readv(vmem_t * vmem, const vmem_iovec_t * iov, int count);
+void vmem_fram_writev(vmem_t * vmem, const vmem_iovec_t * iov, int count);
 
 
 #endif /* SRC_PARAM_VMEM_FRAM_H_ */
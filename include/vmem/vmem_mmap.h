@@ -6,18 +6,52 @@
 extern "C" {
 #endif
 
+/**
+ * The file is mapped shared, so reads and writes go straight to the page cache.
+ *
+ * A write past the end extends the VMEM. The mapping then grows to at least
+ * twice its capacity (with mremap where available), so appending costs
+ * O(log n) remaps rather than one per write. The file itself is only extended
+ * to the logical size vmem->size, one ftruncate per growing write, so it never
+ * holds padding and reopens at the size written.
+ */
+typedef enum {
+	VMEM_MMAP_SYNC_NONE = 0,	// The kernel writes back the mapping when it sees fit
+	VMEM_MMAP_SYNC_ASYNC = 1,	// Start write back on flush (msync MS_ASYNC)
+	VMEM_MMAP_SYNC_SYNC = 2,	// Wait for write back on flush (msync MS_SYNC)
+} vmem_mmap_sync_e;
+
+/* Hints for large stores, ignored where the platform lacks them */
+#define VMEM_MMAP_POPULATE	(1 << 0)	// Prefault the mapping (MAP_POPULATE)
+#define VMEM_MMAP_HUGEPAGE	(1 << 1)	// Ask for transparent huge pages (MADV_HUGEPAGE)
+
 typedef struct {
 	void * physaddr;
 	char * filename;
+	uint8_t sync;
+	uint8_t flags;
+
+	/* State */
+	int fd;						// Open descriptor + 1, 0 when not open
+	uint64_t capacity;			// Bytes mapped, may extend past the end of the file
 } vmem_mmap_driver_t;
 
 void vmem_mmap_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t len);
 void vmem_mmap_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len);
+void * vmem_mmap_map(vmem_t * vmem, uint64_t addr, uint32_t len, int flags);
 
-#define VMEM_DEFINE_MMAP(name_in, strname, filename_in, size_in) \
+/**
+ * msync according to the sync mode
+ * @return 0 = OK, -1 on error
+ */
+int vmem_mmap_flush(vmem_t * vmem);
+
+#define VMEM_DEFINE_MMAP_FLAGS(name_in, strname, filename_in, size_in, sync_in, flags_in) \
 	static vmem_mmap_driver_t vmem_mmap_##name_in##_driver = { \
 		.physaddr = 0, \
 		.filename = filename_in, \
+		.sync = sync_in, \
+		.flags = flags_in, \
 	}; \
 	__attribute__((section("vmem"))) \
 	__attribute__((aligned(1))) \
@@ -28,11 +62,16 @@ void vmem_mmap_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t
 		.size = size_in, \
 		.read = vmem_mmap_read, \
 		.write = vmem_mmap_write, \
+		.flush = vmem_mmap_flush, \
+		.map = vmem_mmap_map, \
 		.driver = &vmem_mmap_##name_in##_driver, \
 		.vaddr = 0, \
 		.ack_with_pull = 1, \
 	};
 
+#define VMEM_DEFINE_MMAP(name_in, strname, filename_in, size_in) \
+	VMEM_DEFINE_MMAP_FLAGS(name_in, strname, filename_in, size_in, VMEM_MMAP_SYNC_NONE, 0)
+
 /// Helper macro to help reference the vmem_t variable created behind the scene by the VMEM_DEFINE_MMAP macro above
 #define VMEM_MMAP_VAR(name_in) vmem_mmap_##name_in
 
@@ -18,6 +18,8 @@ typedef struct {
 	void * physaddr;
 } vmem_ram_driver_t;
 
+void * vmem_ram_map(vmem_t * vmem, uint64_t addr, uint32_t len, int flags);
+
 #include <stdint.h>
 #if UINTPTR_MAX == 0xFFFFFFFFFFFFFFFFULL
 #define __64BIT__ 1
@@ -46,6 +48,7 @@ typedef struct {
 		.type = VMEM_TYPE_RAM, \
 		.read = NULL, \
 		.write = NULL, \
+		.map = vmem_ram_map, \
 		VMEM_STATIC_RAM_VADDR_INITIALIZER(name_in), \
 		.size = size_in, \
 		.name = strname, \
@@ -73,6 +76,7 @@ typedef struct {
         .type = VMEM_TYPE_RAM, \
         .read = NULL, \
         .write = NULL, \
+        .map = vmem_ram_map, \
 		VMEM_STATIC_RAM_ADDR_VADDR_INITIALIZER(mem_addr), \
         .size = size_in, \
         .name = strname, \
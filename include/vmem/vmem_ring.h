@@ -10,6 +10,25 @@
 
 #include <vmem/vmem.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * File layout, host byte order: tail, head, offsets[entries], data[data_size].
+ *
+ * The file is mapped once and kept mapped, entries are copied straight into the
+ * mapping. The metadata in the file is only updated at a commit point, every
+ * commit_every writes (0 = never) and on vmem_flush(), so a crash loses at most
+ * the entries written since the last commit. The sync policy decides whether a commit also
+ * msyncs the mapping.
+ */
+typedef enum {
+    VMEM_RING_SYNC_NONE = 0,    // The kernel writes back the mapping when it sees fit
+    VMEM_RING_SYNC_ASYNC = 1,   // Start write back at each commit (msync MS_ASYNC)
+    VMEM_RING_SYNC_SYNC = 2,    // Wait for write back at each commit (msync MS_SYNC)
+} vmem_ring_sync_e;
+
 typedef struct {
     uint32_t data_size;
     uint32_t entries;
@@ -17,17 +36,73 @@ typedef struct {
 	void * offsets;
 	uint32_t tail;
 	uint32_t head;
+    uint32_t commit_every;
+    uint8_t sync;
+
+    /* State */
+    uint8_t * map;              // Mapped file, NULL until first use
+    uint32_t uncommitted;       // Writes since the last commit
+    uint32_t committed_head;
+    uint32_t appended;          // Entries appended since init, the sequence number of the next entry
 } vmem_ring_driver_t;
 
+/* Entry being appended in pieces */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t written;
+} vmem_ring_append_t;
+
 void vmem_ring_init(vmem_t * vmem);
-void vmem_ring_read(vmem_t * vmem, uint32_t addr, void * dataout, uint32_t offset);
-void vmem_ring_write(vmem_t * vmem, uint32_t addr, const void * datain, uint32_t len);
+void vmem_ring_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t offset);
+void vmem_ring_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len);
 uint32_t vmem_ring_offset(vmem_t * vmem, uint32_t index, uint32_t offset);
 uint32_t vmem_ring_element_size(vmem_t * vmem, uint32_t index);
 int vmem_ring_is_valid_index(vmem_t * vmem, uint32_t index);
 uint32_t vmem_ring_get_amount_of_elements(vmem_t * vmem);
 
-#define VMEM_DEFINE_RING(name_in, strname, filename_in, size_in, entries_in) \
+/**
+ * Append an entry of len bytes in any number of pieces, without holding all of
+ * it in memory. Old entries are evicted only when a piece overwrites their
+ * data, and the entry is only added to the ring by end. An append that is not
+ * ended leaves the ring without it and loses only the entries it overwrote.
+ * There must be only one writer.
+ * @return 0 = OK, -1 if the file cannot be mapped or len does not fit in the ring
+ */
+int vmem_ring_append_begin(vmem_t * vmem, vmem_ring_append_t * append, uint32_t len);
+void vmem_ring_append(vmem_t * vmem, vmem_ring_append_t * append, const void * datain, uint32_t len);
+void vmem_ring_append_end(vmem_t * vmem, vmem_ring_append_t * append);
+
+/**
+ * Followers identify entries by sequence number, counted from 0 at init, so
+ * they can tell new entries from old and notice entries evicted before they
+ * got to them. Appending wakes threads blocked in vmem_ring_wait().
+ */
+uint32_t vmem_ring_appended(vmem_t * vmem);
+
+/**
+ * Block until an entry is appended after the first seen entries, or timeout
+ * @return the number of entries appended, equal to seen on timeout
+ */
+uint32_t vmem_ring_wait(vmem_t * vmem, uint32_t seen, uint32_t timeout_ms);
+
+/**
+ * Look up entry number seq. The data at offset stays intact for as long as a
+ * later call still finds the entry, since entries are evicted before they are
+ * overwritten, so a reader calls this again after copying the data out.
+ * @param offset        output, ring offset for vmem_ring_read(), may be NULL
+ * @param length        output, entry length, may be NULL
+ * @return 0 = OK, -1 if it is evicted or not yet appended
+ */
+int vmem_ring_sequence_entry(vmem_t * vmem, uint32_t seq, uint32_t * offset, uint32_t * length);
+
+/**
+ * Write head, tail and the new offsets to the file, and msync according to the policy
+ * @return 0 = OK, -1 if the file is not mapped or msync failed
+ */
+int vmem_ring_commit(vmem_t * vmem);
+
+#define VMEM_DEFINE_RING_BATCHED(name_in, strname, filename_in, size_in, entries_in, commit_every_in, sync_in) \
 	uint32_t vmem_##name_in##_offsets[entries_in] = {0}; \
     static vmem_ring_driver_t vmem_##name_in##_driver = { \
         .data_size = size_in, \
@@ -36,6 +111,8 @@ uint32_t vmem_ring_get_amount_of_elements(vmem_t * vmem);
 		.offsets = vmem_##name_in##_offsets, \
 		.tail = 0, \
 		.head = 0, \
+        .commit_every = commit_every_in, \
+        .sync = sync_in, \
 	}; \
 	__attribute__((section("vmem"))) \
 	__attribute__((aligned(1))) \
@@ -46,8 +123,17 @@ uint32_t vmem_ring_get_amount_of_elements(vmem_t * vmem);
 		.size = size_in + ((entries_in + 2) * sizeof(uint32_t)), \
 		.read = vmem_ring_read, \
 		.write = vmem_ring_write, \
+		.flush = vmem_ring_commit, \
 		.driver = &vmem_##name_in##_driver, \
 		.ack_with_pull = 1, \
 	}; \
 
+/* Commits every write */
+#define VMEM_DEFINE_RING(name_in, strname, filename_in, size_in, entries_in) \
+    VMEM_DEFINE_RING_BATCHED(name_in, strname, filename_in, size_in, entries_in, 1, VMEM_RING_SYNC_NONE)
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* LIB_PARAM_INCLUDE_VMEM_VMEM_RING_H_ */
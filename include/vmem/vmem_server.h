@@ -16,6 +16,11 @@
 #define VMEM_PORT_SERVER 14
 #define VMEM_VERSION 3
 
+/* A ring follow holds the server task for at most this long, then the client re-arms it */
+#ifndef VMEM_SERVER_FOLLOW_SLICE
+#define VMEM_SERVER_FOLLOW_SLICE 1000
+#endif
+
 typedef enum {
 	VMEM_SERVER_UPLOAD,
 	VMEM_SERVER_DOWNLOAD,
@@ -26,6 +31,8 @@ typedef enum {
 	VMEM_SERVER_CALCULATE_CRC32,
 	VMEM_SERVER_RING_UPLOAD,
 	VMEM_SERVER_RING_DOWNLOAD,
+	VMEM_SERVER_RING_BATCH,
+	VMEM_SERVER_RING_FOLLOW,
 } vmem_request_type;
 
 typedef struct {
@@ -54,9 +61,35 @@ typedef struct {
 			char vmem_name[5];
 			uint32_t offset;
 		} ring;
+		struct {
+			char vmem_name[5];
+			int32_t from;			// Entry index, negative counts back from the newest
+			uint32_t count;			// Entries to send, 0 = no limit
+			uint8_t flags;			// VMEM_RING_RANGE_SEQ
+		} ring_range;
 	};
 } __attribute__((packed)) vmem_request_t;
 
+/* ring_range.from is the sequence number of a re-armed follow, not an index */
+#define VMEM_RING_RANGE_SEQ 1
+
+/**
+ * RING BATCH and FOLLOW reply with this header before the data of each entry.
+ * A follow keeps sending entries as they are appended, until count entries are
+ * sent, the client closes the connection or VMEM_SERVER_FOLLOW_SLICE has passed,
+ * so other requests are not held up. A slice ends with a header of length
+ * VMEM_RING_ENTRY_REARM and seq set to the next entry, which the client requests
+ * again with VMEM_RING_RANGE_SEQ. A jump in seq means entries were evicted
+ * before they could be sent. An entry evicted while it is sent is cut short
+ * and the connection closed, a follow then re-arms from that entry.
+ */
+typedef struct {
+	uint32_t seq;
+	uint32_t length;
+} __attribute__((packed)) vmem_ring_entry_t;
+
+#define VMEM_RING_ENTRY_REARM 0xFFFFFFFF
+
 typedef struct {
 	uint32_t vaddr;
 	uint32_t size;
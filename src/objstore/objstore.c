@@ -11,11 +11,13 @@ static uint8_t _make_checksum(vmem_t * vmem, int offset, int length) {
     if (length < 0)
         return 0;
 
-    uint8_t buf, checksum;
+    uint8_t buf[64], checksum;
     vmem->read(vmem, offset+OBJ_HEADER_LENGTH, &checksum, sizeof(checksum)); // initialize with first data byte
-    for (int i = 1; i < length; i++) {
-        vmem->read(vmem, offset+OBJ_HEADER_LENGTH+i, &buf, sizeof(buf));
-        checksum ^= buf;
+    for (int i = 1; i < length; i += sizeof(buf)) {
+        int chunk = VMEM_MIN(length - i, (int) sizeof(buf));
+        vmem->read(vmem, offset+OBJ_HEADER_LENGTH+i, buf, chunk);
+        for (int j = 0; j < chunk; j++)
+            checksum ^= buf[j];
     }
 
     return checksum;
@@ -182,21 +184,33 @@ int objstore_rm_obj(vmem_t * vmem, int offset, int verbose) {
     const uint16_t length;
     vmem->read(vmem, offset+5, (void *) &length, sizeof(length));
 
-    const uint8_t clear_block = 0xFF;
+    static const uint8_t clear_block[64] = {[0 ... 63] = 0xFF};
+
+    /* Cleared back to front, so the sync word goes last. The segments
+     * of a scatter list are written in order */
+    vmem_iovec_t iov[16];
+    int n = 0;
     // clear checksum
-    vmem->write(vmem, offset+length+OBJ_HEADER_LENGTH, (void *) &clear_block, sizeof(clear_block));
+    iov[n++] = (vmem_iovec_t) {offset+length+OBJ_HEADER_LENGTH, (void *) clear_block, 1};
     // clear data field
-    for (int i = length; i > 0; i--) {
-        vmem->write(vmem, offset+i+OBJ_HEADER_LENGTH-1, (void *) &clear_block, sizeof(clear_block));
+    for (int end = length; end > 0; ) {
+        int chunk = VMEM_MIN(end, (int) sizeof(clear_block));
+        end -= chunk;
+        iov[n++] = (vmem_iovec_t) {offset+OBJ_HEADER_LENGTH+end, (void *) clear_block, chunk};
+        if (n == 16) {
+            vmem_writev(vmem, iov, n);
+            n = 0;
+        }
+    }
+    if (n > 14) {
+        vmem_writev(vmem, iov, n);
+        n = 0;
     }
     // clear header
-    vmem->write(vmem, offset+6, (void *) &clear_block, sizeof(clear_block));
-    vmem->write(vmem, offset+5, (void *) &clear_block, sizeof(clear_block));
-    vmem->write(vmem, offset+4, (void *) &clear_block, sizeof(clear_block));
+    iov[n++] = (vmem_iovec_t) {offset+4, (void *) clear_block, 3};
     // clear sync word
-    for (int i = 0; i < 4; i++) {
-        vmem->write(vmem, offset+i, (void *) &clear_block, sizeof(clear_block));
-    }
+    iov[n++] = (vmem_iovec_t) {offset, (void *) clear_block, 4};
+    vmem_writev(vmem, iov, n);
 
     if (verbose)
         printf("Deleted object of length %u bytes at offset %u\n", length, offset);
@@ -225,10 +239,13 @@ int objstore_read_obj(vmem_t * vmem, int offset, void * data_buf, int verbose) {
 }
 
 void objstore_write_obj(vmem_t * vmem, int offset, uint8_t type, uint16_t length, void * data) {
-    vmem->write(vmem, offset, (void *) sync_word, 4);
-    vmem->write(vmem, offset+4, &type, sizeof(type));
-    vmem->write(vmem, offset+5, &length, sizeof(length));
-    vmem->write(vmem, offset+OBJ_HEADER_LENGTH, data, length);
+    const vmem_iovec_t iov[] = {
+        {offset, (void *) sync_word, 4},
+        {offset+4, &type, sizeof(type)},
+        {offset+5, &length, sizeof(length)},
+        {offset+OBJ_HEADER_LENGTH, data, length},
+    };
+    vmem_writev(vmem, iov, 4);
 
     uint8_t checksum = _make_checksum(vmem, offset, length);
     vmem->write(vmem, offset+OBJ_HEADER_LENGTH+length, &checksum, sizeof(checksum));
@@ -0,0 +1,488 @@
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+#include <csp/csp.h>
+
+#include <param/param.h>
+#include <param/param_archive.h>
+#include <vmem/vmem_ring.h>
+
+#define PARAM_ARCHIVE_HEADER sizeof(param_archive_block_t)
+#define PARAM_ARCHIVE_BITS ((PARAM_ARCHIVE_BLOCK_SIZE - PARAM_ARCHIVE_HEADER) * 8)
+
+/* Worst case sample: 4 + 32 bits of time, 2 + 5 + 6 + 64 bits of value */
+#define PARAM_ARCHIVE_SAMPLE_BITS_MAX 113
+
+typedef struct {
+	param_t * param;
+	uint16_t count;
+	uint32_t bits;
+	uint32_t first_time;
+	uint32_t last_time;
+	int32_t last_delta;
+	uint64_t last_value;
+	uint8_t leading;
+	uint8_t trailing;
+	uint8_t stream[PARAM_ARCHIVE_BLOCK_SIZE - sizeof(param_archive_block_t)];
+} param_archive_column_t;
+
+static vmem_t * param_archive_ring = NULL;
+
+static param_archive_column_t param_archive_columns[PARAM_ARCHIVE_COLUMNS];
+static int param_archive_column_count = 0;
+
+static uint32_t param_archive_masks[PARAM_ARCHIVE_MASKS];
+static int param_archive_mask_count = 0;
+
+/* Column state, only held for a few hundred bit operations */
+static uint8_t param_archive_lock = 0;
+
+/* Ring writes and queries, may block on msync. Taken before param_archive_lock */
+static pthread_mutex_t param_archive_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void param_archive_take(void) {
+	while (__atomic_test_and_set(&param_archive_lock, __ATOMIC_ACQUIRE));
+}
+
+static void param_archive_give(void) {
+	__atomic_clear(&param_archive_lock, __ATOMIC_RELEASE);
+}
+
+/**
+ * Bitstream, most significant bit first
+ */
+
+static void param_archive_put(uint8_t * stream, uint32_t * pos, uint64_t value, int bits) {
+	while (bits > 0) {
+		bits--;
+		uint32_t byte = *pos / 8;
+		uint8_t mask = 0x80 >> (*pos % 8);
+		if ((value >> bits) & 1) {
+			stream[byte] |= mask;
+		} else {
+			stream[byte] &= ~mask;
+		}
+		(*pos)++;
+	}
+}
+
+/* Bits at or past limit read as zero, so a corrupt block cannot read past its end */
+static uint64_t param_archive_get(const uint8_t * stream, uint32_t * pos, uint32_t limit, int bits) {
+	uint64_t value = 0;
+	while (bits-- > 0) {
+		uint64_t bit = (*pos < limit) ? (stream[*pos / 8] >> (7 - (*pos % 8))) & 1 : 0;
+		value = (value << 1) | bit;
+		(*pos)++;
+	}
+	return value;
+}
+
+/**
+ * Values are compressed as 64 bit patterns: floats as double, integers sign or zero extended
+ */
+
+static int param_archive_supported(param_t * param) {
+	if (param->array_size > 1)
+		return 0;
+	switch (param->type) {
+		case PARAM_TYPE_STRING:
+		case PARAM_TYPE_DATA:
+		case PARAM_TYPE_INVALID:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+static uint64_t param_archive_bits(param_t * param) {
+
+	union {
+		uint8_t u8; uint16_t u16; uint32_t u32; uint64_t u64;
+		int8_t i8; int16_t i16; int32_t i32; int64_t i64;
+		float f; double d;
+	} v;
+	param_get(param, 0, &v);
+
+	double d;
+	uint64_t bits;
+	switch (param->type) {
+		case PARAM_TYPE_UINT8: case PARAM_TYPE_XINT8: return v.u8;
+		case PARAM_TYPE_UINT16: case PARAM_TYPE_XINT16: return v.u16;
+		case PARAM_TYPE_UINT32: case PARAM_TYPE_XINT32: return v.u32;
+		case PARAM_TYPE_UINT64: case PARAM_TYPE_XINT64: return v.u64;
+		case PARAM_TYPE_INT8: return (int64_t) v.i8;
+		case PARAM_TYPE_INT16: return (int64_t) v.i16;
+		case PARAM_TYPE_INT32: return (int64_t) v.i32;
+		case PARAM_TYPE_INT64: return v.i64;
+		case PARAM_TYPE_FLOAT: d = v.f; memcpy(&bits, &d, sizeof(bits)); return bits;
+		case PARAM_TYPE_DOUBLE: memcpy(&bits, &v.d, sizeof(bits)); return bits;
+		default: return 0;
+	}
+}
+
+static double param_archive_value(uint8_t type, uint64_t bits) {
+	double d;
+	switch (type) {
+		case PARAM_TYPE_INT8:
+		case PARAM_TYPE_INT16:
+		case PARAM_TYPE_INT32:
+		case PARAM_TYPE_INT64:
+			return (int64_t) bits;
+		case PARAM_TYPE_FLOAT:
+		case PARAM_TYPE_DOUBLE:
+			memcpy(&d, &bits, sizeof(d));
+			return d;
+		default:
+			return bits;
+	}
+}
+
+/**
+ * Encoder
+ */
+
+static void param_archive_put_time(param_archive_column_t * column, uint32_t time) {
+
+	int32_t delta = time - column->last_time;
+	int32_t dod = delta - column->last_delta;
+	column->last_delta = delta;
+	column->last_time = time;
+
+	if (dod == 0) {
+		param_archive_put(column->stream, &column->bits, 0, 1);
+	} else if (dod >= -63 && dod <= 64) {
+		param_archive_put(column->stream, &column->bits, 0b10, 2);
+		param_archive_put(column->stream, &column->bits, dod + 63, 7);
+	} else if (dod >= -255 && dod <= 256) {
+		param_archive_put(column->stream, &column->bits, 0b110, 3);
+		param_archive_put(column->stream, &column->bits, dod + 255, 9);
+	} else if (dod >= -2047 && dod <= 2048) {
+		param_archive_put(column->stream, &column->bits, 0b1110, 4);
+		param_archive_put(column->stream, &column->bits, dod + 2047, 12);
+	} else {
+		param_archive_put(column->stream, &column->bits, 0b1111, 4);
+		param_archive_put(column->stream, &column->bits, (uint32_t) dod, 32);
+	}
+}
+
+static void param_archive_put_value(param_archive_column_t * column, uint64_t value) {
+
+	uint64_t xor = value ^ column->last_value;
+	column->last_value = value;
+
+	if (xor == 0) {
+		param_archive_put(column->stream, &column->bits, 0, 1);
+		return;
+	}
+
+	int leading = __builtin_clzll(xor);
+	int trailing = __builtin_ctzll(xor);
+	if (leading > 31)
+		leading = 31;
+
+	/* Reuse the previous window if the meaningful bits fit in it */
+	if (column->leading != 0xFF && leading >= column->leading && trailing >= column->trailing) {
+		int length = 64 - column->leading - column->trailing;
+		param_archive_put(column->stream, &column->bits, 0b10, 2);
+		param_archive_put(column->stream, &column->bits, xor >> column->trailing, length);
+		return;
+	}
+
+	int length = 64 - leading - trailing;
+	param_archive_put(column->stream, &column->bits, 0b11, 2);
+	param_archive_put(column->stream, &column->bits, leading, 5);
+	param_archive_put(column->stream, &column->bits, length - 1, 6);
+	param_archive_put(column->stream, &column->bits, xor >> trailing, length);
+	column->leading = leading;
+	column->trailing = trailing;
+}
+
+static void param_archive_header(param_archive_column_t * column, param_archive_block_t * header) {
+	header->magic = htobe16(PARAM_ARCHIVE_MAGIC);
+	header->id = htobe16(column->param->id);
+	header->node = htobe16(column->param->node);
+	header->type = column->param->type;
+	header->reserved = 0;
+	header->count = htobe16(column->count);
+	header->reserved2 = 0;
+	header->first_time = htobe32(column->first_time);
+	header->last_time = htobe32(column->last_time);
+}
+
+/* Copy the column out as a block, return its length */
+static uint32_t param_archive_block(param_archive_column_t * column, uint8_t * block) {
+	param_archive_header(column, (param_archive_block_t *) block);
+	uint32_t length = (column->bits + 7) / 8;
+	memcpy(&block[PARAM_ARCHIVE_HEADER], column->stream, length);
+	return PARAM_ARCHIVE_HEADER + length;
+}
+
+/* Called with param_archive_lock taken, the block is written by the caller once it is given */
+static uint32_t param_archive_detach_column(param_archive_column_t * column, uint8_t * block) {
+
+	if (column->count == 0)
+		return 0;
+
+	uint32_t length = param_archive_block(column, block);
+	column->count = 0;
+	column->bits = 0;
+	return length;
+}
+
+static int param_archive_full(param_archive_column_t * column) {
+	return column->count > 0 && (column->bits + PARAM_ARCHIVE_SAMPLE_BITS_MAX > PARAM_ARCHIVE_BITS || column->count == UINT16_MAX);
+}
+
+static param_archive_column_t * param_archive_find(param_t * param) {
+	for (int i = 0; i < param_archive_column_count; i++) {
+		if (param_archive_columns[i].param == param)
+			return &param_archive_columns[i];
+	}
+	return NULL;
+}
+
+static param_archive_column_t * param_archive_alloc(param_t * param) {
+
+	param_archive_column_t * column = param_archive_find(param);
+	if (column)
+		return column;
+
+	if (!param_archive_supported(param) || param_archive_column_count >= PARAM_ARCHIVE_COLUMNS)
+		return NULL;
+
+	column = &param_archive_columns[param_archive_column_count++];
+	memset(column, 0, sizeof(*column));
+	column->param = param;
+	return column;
+}
+
+void param_archive_init(vmem_t * ring) {
+	param_archive_take();
+	param_archive_ring = ring;
+	param_archive_give();
+}
+
+int param_archive_add(param_t * param) {
+	param_archive_take();
+	param_archive_column_t * column = param_archive_alloc(param);
+	param_archive_give();
+	return (column != NULL) ? 0 : -1;
+}
+
+int param_archive_add_mask(uint32_t mask) {
+	param_archive_take();
+	if (param_archive_mask_count >= PARAM_ARCHIVE_MASKS) {
+		param_archive_give();
+		return -1;
+	}
+	param_archive_masks[param_archive_mask_count++] = mask;
+	param_archive_give();
+	return 0;
+}
+
+void param_archive_record(param_t * param, uint32_t timestamp) {
+
+	vmem_t * ring = param_archive_ring;
+	if (ring == NULL)
+		return;
+
+	uint8_t block[PARAM_ARCHIVE_BLOCK_SIZE];
+	uint32_t length = 0;
+	int ring_locked = 0;
+
+	param_archive_take();
+
+	param_archive_column_t * column = param_archive_find(param);
+	if (column == NULL) {
+		for (int i = 0; i < param_archive_mask_count; i++) {
+			if (param->mask & param_archive_masks[i]) {
+				column = param_archive_alloc(param);
+				break;
+			}
+		}
+		if (column == NULL) {
+			param_archive_give();
+			return;
+		}
+	}
+
+	if (timestamp == 0) {
+		csp_timestamp_t now;
+		csp_clock_get_time(&now);
+		timestamp = now.tv_sec;
+	}
+
+	/* A full block goes to the ring. Detach it with the ring lock held, so blocks are
+	 * written in order and a query never sees a sample in neither or both places */
+	if (param_archive_full(column)) {
+		param_archive_give();
+		pthread_mutex_lock(&param_archive_ring_lock);
+		ring_locked = 1;
+		param_archive_take();
+		if (param_archive_full(column))
+			length = param_archive_detach_column(column, block);
+	}
+
+	uint64_t value = param_archive_bits(param);
+
+	if (column->count == 0) {
+		/* First sample of a block: time in header, value raw */
+		column->first_time = timestamp;
+		column->last_time = timestamp;
+		column->last_delta = 0;
+		column->last_value = value;
+		column->leading = 0xFF;
+		param_archive_put(column->stream, &column->bits, value, 64);
+	} else {
+		param_archive_put_time(column, timestamp);
+		param_archive_put_value(column, value);
+	}
+	column->count++;
+
+	param_archive_give();
+
+	if (length > 0)
+		vmem_ring_write(ring, 0, block, length);
+	if (ring_locked)
+		pthread_mutex_unlock(&param_archive_ring_lock);
+}
+
+void param_archive_flush(void) {
+
+	vmem_t * ring = param_archive_ring;
+	if (ring == NULL)
+		return;
+
+	uint8_t block[PARAM_ARCHIVE_BLOCK_SIZE];
+
+	pthread_mutex_lock(&param_archive_ring_lock);
+	param_archive_take();
+	int count = param_archive_column_count;
+	param_archive_give();
+
+	for (int i = 0; i < count; i++) {
+		param_archive_take();
+		uint32_t length = param_archive_detach_column(&param_archive_columns[i], block);
+		param_archive_give();
+		if (length > 0)
+			vmem_ring_write(ring, 0, block, length);
+	}
+	pthread_mutex_unlock(&param_archive_ring_lock);
+}
+
+/**
+ * Decoder
+ */
+
+static int param_archive_decode(const uint8_t * block, uint32_t length, uint32_t from, uint32_t to, param_archive_sample_f callback, void * context) {
+
+	const param_archive_block_t * header = (const param_archive_block_t *) block;
+	const uint8_t * stream = &block[PARAM_ARCHIVE_HEADER];
+	uint32_t bits = (length - PARAM_ARCHIVE_HEADER) * 8;
+	uint16_t count = be16toh(header->count);
+
+	/* Blocks are read back from a ring anyone can upload to, trust nothing past the header */
+	if (bits < 64)
+		return 0;
+
+	uint32_t pos = 0;
+	uint32_t time = be32toh(header->first_time);
+	int32_t delta = 0;
+	uint64_t value = param_archive_get(stream, &pos, bits, 64);
+	int leading = 0, trailing = 0;
+
+	int found = 0;
+	for (int i = 0; i < count; i++) {
+
+		if (i > 0) {
+			int32_t dod;
+			if (param_archive_get(stream, &pos, bits, 1) == 0) {
+				dod = 0;
+			} else if (param_archive_get(stream, &pos, bits, 1) == 0) {
+				dod = (int32_t) param_archive_get(stream, &pos, bits, 7) - 63;
+			} else if (param_archive_get(stream, &pos, bits, 1) == 0) {
+				dod = (int32_t) param_archive_get(stream, &pos, bits, 9) - 255;
+			} else if (param_archive_get(stream, &pos, bits, 1) == 0) {
+				dod = (int32_t) param_archive_get(stream, &pos, bits, 12) - 2047;
+			} else {
+				dod = (int32_t) param_archive_get(stream, &pos, bits, 32);
+			}
+			delta = (int32_t) ((uint32_t) delta + (uint32_t) dod);
+			time += delta;
+
+			if (param_archive_get(stream, &pos, bits, 1) == 1) {
+				if (param_archive_get(stream, &pos, bits, 1) == 1) {
+					leading = param_archive_get(stream, &pos, bits, 5);
+					int length = param_archive_get(stream, &pos, bits, 6) + 1;
+					if (leading + length > 64)
+						break;
+					trailing = 64 - leading - length;
+				}
+				value ^= param_archive_get(stream, &pos, bits, 64 - leading - trailing) << trailing;
+			}
+
+			/* Truncated sample */
+			if (pos > bits)
+				break;
+		}
+
+		if (time >= from && time <= to) {
+			if (callback)
+				callback(time, param_archive_value(header->type, value), context);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+int param_archive_query(uint16_t node, uint16_t id, uint32_t from, uint32_t to, param_archive_sample_f callback, void * context) {
+
+	vmem_t * ring = param_archive_ring;
+	if (ring == NULL)
+		return -1;
+
+	int found = 0;
+	uint8_t block[PARAM_ARCHIVE_BLOCK_SIZE];
+
+	/* Blocks only move from RAM to the ring with this held, so nothing is seen twice or missed */
+	pthread_mutex_lock(&param_archive_ring_lock);
+
+	uint32_t entries = vmem_ring_get_amount_of_elements(ring);
+	for (uint32_t i = 0; i < entries; i++) {
+
+		uint32_t length = vmem_ring_element_size(ring, i);
+		if (length < PARAM_ARCHIVE_HEADER || length > PARAM_ARCHIVE_BLOCK_SIZE)
+			continue;
+
+		/* Check the header before reading the whole block */
+		param_archive_block_t * header = (param_archive_block_t *) block;
+		uint32_t offset = vmem_ring_offset(ring, i, 0);
+		vmem_ring_read(ring, offset, block, PARAM_ARCHIVE_HEADER);
+		if (be16toh(header->magic) != PARAM_ARCHIVE_MAGIC || be16toh(header->id) != id || be16toh(header->node) != node)
+			continue;
+		if (be32toh(header->last_time) < from || be32toh(header->first_time) > to)
+			continue;
+
+		vmem_ring_read(ring, offset, block, length);
+		found += param_archive_decode(block, length, from, to, callback, context);
+	}
+
+	/* Samples still in RAM are the newest */
+	uint32_t length = 0;
+	param_archive_take();
+	for (int i = 0; i < param_archive_column_count; i++) {
+		param_archive_column_t * column = &param_archive_columns[i];
+		if (column->count == 0 || column->param->id != id || column->param->node != node)
+			continue;
+		length = param_archive_block(column, block);
+		break;
+	}
+	param_archive_give();
+
+	if (length > 0)
+		found += param_archive_decode(block, length, from, to, callback, context);
+
+	pthread_mutex_unlock(&param_archive_ring_lock);
+	return found;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <time.h>
+#include <slash/slash.h>
+#include <slash/optparse.h>
+#include <slash/dflopt.h>
+#include <csp/csp.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_archive.h>
+
+static int cmd_archive_add(struct slash *slash) {
+
+	int node = slash_dfl_node;
+	char * mask_str = NULL;
+
+	optparse_t * parser = optparse_new("archive add", "[param]");
+	optparse_add_help(parser);
+	optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_string(parser, 'm', "mask", "MASK", &mask_str, "archive all params matching mask (param letters)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (mask_str) {
+		if (param_archive_add_mask(param_maskstr_to_mask(mask_str)) < 0) {
+			printf("Mask table full\n");
+			optparse_del(parser);
+			return SLASH_ENOMEM;
+		}
+		optparse_del(parser);
+		return SLASH_SUCCESS;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("missing parameter name\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	param_t * param = param_list_find_name(node, slash->argv[argi]);
+	if (param == NULL) {
+		printf("%s not found on node %d\n", slash->argv[argi], node);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (param_archive_add(param) < 0) {
+		printf("Unsupported type, or column table full\n");
+		optparse_del(parser);
+		return SLASH_ENOMEM;
+	}
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(archive, add, cmd_archive_add, "[OPTIONS] [param]", "Archive values of a parameter");
+
+static int cmd_archive_flush(struct slash *slash) {
+	param_archive_flush();
+	return SLASH_SUCCESS;
+}
+slash_command_sub(archive, flush, cmd_archive_flush, "", "Write partially filled archive blocks");
+
+static void archive_print(uint32_t time, double value, void * context) {
+	time_t t = time;
+	struct tm tm;
+	char buf[32];
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime_r(&t, &tm));
+	printf("  %s  %g\n", buf, value);
+}
+
+static int cmd_archive_show(struct slash *slash) {
+
+	int node = slash_dfl_node;
+	int seconds = 0;
+
+	optparse_t * parser = optparse_new("archive show", "<param>");
+	optparse_add_help(parser);
+	optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_int(parser, 's', "seconds", "NUM", 0, &seconds, "only the last seconds (default = all)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("missing parameter name\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	param_t * param = param_list_find_name(node, slash->argv[argi]);
+	if (param == NULL) {
+		printf("%s not found on node %d\n", slash->argv[argi], node);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	uint32_t from = 0;
+	if (seconds > 0) {
+		csp_timestamp_t now;
+		csp_clock_get_time(&now);
+		from = now.tv_sec - seconds;
+	}
+
+	int count = param_archive_query(param->node, param->id, from, UINT32_MAX, archive_print, NULL);
+	if (count < 0)
+		printf("No archive ring\n");
+	else
+		printf("%d samples\n", count);
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(archive, show, cmd_archive_show, "[OPTIONS] <param>", "Show archived values of a parameter");
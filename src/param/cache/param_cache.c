@@ -0,0 +1,392 @@
+#include <param/param_cache.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <csp/csp.h>
+#include <csp/arch/csp_time.h>
+#include <csp/csp_hooks.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_client.h>
+
+typedef struct {
+	uint16_t node;
+	uint16_t id;
+	int host;			/* Server the value was pulled from */
+	uint32_t fetched;	/* csp_get_ms() when the last pull completed */
+	uint32_t used;		/* Access stamp, the lowest is reclaimed first */
+	uint8_t valid;
+	uint8_t in_flight;
+	uint8_t queued;		/* Waiting for the refresh worker */
+	uint8_t waiters;	/* Readers sharing the pull in flight, the entry is not reclaimed under them */
+	uint8_t done;		/* Completed pulls, waiters watch it change */
+	int result;			/* Result of the last completed pull */
+
+	/* Arguments of the queued refresh */
+	uint8_t prio;
+	int timeout;
+	int version;
+} param_cache_entry_t;
+
+typedef struct {
+	uint16_t node;
+	uint16_t id;
+	uint32_t max_age;
+} param_cache_param_policy_t;
+
+typedef struct {
+	uint32_t mask;
+	uint32_t max_age;
+} param_cache_policy_t;
+
+static param_cache_entry_t param_cache[PARAM_CACHE_ENTRIES];
+static param_cache_param_policy_t param_cache_param_policy[PARAM_CACHE_PARAM_POLICIES];
+static param_cache_policy_t param_cache_policy[PARAM_CACHE_MASK_POLICIES];
+static uint32_t param_cache_clock = 0;
+
+static pthread_mutex_t param_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t param_cache_done = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t param_cache_work = PTHREAD_COND_INITIALIZER;
+static pthread_once_t param_cache_once = PTHREAD_ONCE_INIT;
+static int param_cache_worker_running = 0;
+
+/* Must be called with lock held */
+static param_cache_entry_t * param_cache_find(param_t * param, int host, int create) {
+
+	param_cache_entry_t * victim = NULL;
+	for (int i = 0; i < PARAM_CACHE_ENTRIES; i++) {
+		param_cache_entry_t * entry = &param_cache[i];
+		if (entry->used && entry->node == param->node && entry->id == param->id && entry->host == host) {
+			entry->used = ++param_cache_clock;
+			return entry;
+		}
+		/* Free slots have used = 0, so they are taken before any entry is reclaimed */
+		if (!entry->in_flight && !entry->waiters && (victim == NULL || entry->used < victim->used))
+			victim = entry;
+	}
+
+	if (!create || victim == NULL)
+		return NULL;
+
+	victim->node = param->node;
+	victim->id = param->id;
+	victim->host = host;
+	victim->fetched = 0;
+	victim->valid = 0;
+	victim->in_flight = 0;
+	victim->queued = 0;
+	victim->done = 0;
+	victim->used = ++param_cache_clock;
+	return victim;
+}
+
+/* Must be called with lock held */
+static param_cache_param_policy_t * param_cache_param_policy_find(param_t * param, int create) {
+
+	param_cache_param_policy_t * free_policy = NULL;
+	for (int i = 0; i < PARAM_CACHE_PARAM_POLICIES; i++) {
+		param_cache_param_policy_t * policy = &param_cache_param_policy[i];
+		if (policy->max_age == 0) {
+			if (free_policy == NULL)
+				free_policy = policy;
+			continue;
+		}
+		if (policy->node == param->node && policy->id == param->id)
+			return policy;
+	}
+
+	if (!create || free_policy == NULL)
+		return NULL;
+
+	free_policy->node = param->node;
+	free_policy->id = param->id;
+	return free_policy;
+}
+
+/* Must be called with lock held */
+static uint32_t param_cache_maxage(param_t * param) {
+
+	param_cache_param_policy_t * policy = param_cache_param_policy_find(param, 0);
+	if (policy)
+		return policy->max_age;
+
+	for (int i = 0; i < PARAM_CACHE_MASK_POLICIES; i++) {
+		if (param_cache_policy[i].max_age && (param->mask & param_cache_policy[i].mask))
+			return param_cache_policy[i].max_age;
+	}
+
+	return 0;
+}
+
+/* Must be called with lock held */
+static void param_cache_complete(param_cache_entry_t * entry, int result) {
+	entry->result = result;
+	entry->done++;
+	if (result == 0) {
+		entry->valid = 1;
+		entry->fetched = csp_get_ms();
+
+		/* The parameter holds one value, it no longer matches what other hosts served */
+		for (int i = 0; i < PARAM_CACHE_ENTRIES; i++) {
+			param_cache_entry_t * other = &param_cache[i];
+			if (other != entry && other->used && other->node == entry->node && other->id == entry->id)
+				other->valid = 0;
+		}
+	}
+	entry->in_flight = 0;
+	pthread_cond_broadcast(&param_cache_done);
+}
+
+/**
+ * Values also arrive through pulls and pushes that bypass the cache, those stamp the parameter.
+ * Must be called with lock held
+ */
+static void param_cache_timestamp(param_cache_entry_t * entry, param_t * param) {
+
+	if (param->timestamp == NULL || *param->timestamp == 0)
+		return;
+
+	csp_timestamp_t now;
+	csp_clock_get_time(&now);
+
+	/* Timestamps are in seconds, a stamp ahead of the local clock counts as new */
+	uint32_t age = 0;
+	if (now.tv_sec > *param->timestamp) {
+		uint32_t seconds = now.tv_sec - *param->timestamp;
+		age = (seconds < UINT32_MAX / 2000) ? seconds * 1000 : UINT32_MAX / 2;
+	}
+
+	uint32_t fetched = csp_get_ms() - age;
+	if (!entry->valid || (int32_t) (fetched - entry->fetched) > 0) {
+		entry->valid = 1;
+		entry->fetched = fetched;
+	}
+}
+
+int param_cache_set_maxage(param_t * param, uint32_t max_age) {
+
+	pthread_mutex_lock(&param_cache_lock);
+	param_cache_param_policy_t * policy = param_cache_param_policy_find(param, max_age > 0);
+	if (policy == NULL) {
+		pthread_mutex_unlock(&param_cache_lock);
+		return (max_age > 0) ? -1 : 0;
+	}
+	policy->max_age = max_age;
+	pthread_mutex_unlock(&param_cache_lock);
+	return 0;
+}
+
+int param_cache_set_maxage_mask(uint32_t mask, uint32_t max_age) {
+
+	int result = -1;
+
+	pthread_mutex_lock(&param_cache_lock);
+
+	/* Update existing policy for the same mask */
+	for (int i = 0; i < PARAM_CACHE_MASK_POLICIES; i++) {
+		if (param_cache_policy[i].max_age && param_cache_policy[i].mask == mask) {
+			param_cache_policy[i].max_age = max_age;
+			pthread_mutex_unlock(&param_cache_lock);
+			return 0;
+		}
+	}
+
+	if (max_age == 0) {
+		pthread_mutex_unlock(&param_cache_lock);
+		return 0;
+	}
+
+	for (int i = 0; i < PARAM_CACHE_MASK_POLICIES; i++) {
+		if (param_cache_policy[i].max_age == 0) {
+			param_cache_policy[i].mask = mask;
+			param_cache_policy[i].max_age = max_age;
+			result = 0;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&param_cache_lock);
+	return result;
+}
+
+uint32_t param_cache_get_maxage(param_t * param) {
+	pthread_mutex_lock(&param_cache_lock);
+	uint32_t max_age = param_cache_maxage(param);
+	pthread_mutex_unlock(&param_cache_lock);
+	return max_age;
+}
+
+void param_cache_invalidate(void) {
+	pthread_mutex_lock(&param_cache_lock);
+	for (int i = 0; i < PARAM_CACHE_ENTRIES; i++) {
+		param_cache[i].valid = 0;
+	}
+	pthread_mutex_unlock(&param_cache_lock);
+}
+
+/* Must be called with lock held */
+static param_cache_entry_t * param_cache_next_queued(void) {
+	for (int i = 0; i < PARAM_CACHE_ENTRIES; i++) {
+		if (param_cache[i].queued)
+			return &param_cache[i];
+	}
+	return NULL;
+}
+
+/* Runs the queued refreshes one at a time, entries in flight are never reclaimed */
+static void * param_cache_worker(void * arg) {
+
+	pthread_mutex_lock(&param_cache_lock);
+
+	while (1) {
+
+		param_cache_entry_t * entry;
+		while ((entry = param_cache_next_queued()) == NULL)
+			pthread_cond_wait(&param_cache_work, &param_cache_lock);
+
+		entry->queued = 0;
+		uint16_t node = entry->node;
+		uint16_t id = entry->id;
+		int host = entry->host;
+		uint8_t prio = entry->prio;
+		int timeout = entry->timeout;
+		int version = entry->version;
+		pthread_mutex_unlock(&param_cache_lock);
+
+		/* The parameter may have been removed from the list while we were waiting */
+		int result = -1;
+		param_t * param = param_list_find_id(node, id);
+		if (param) {
+			result = param_pull_single(param, -1, prio, 0, host, timeout, version);
+		}
+
+		pthread_mutex_lock(&param_cache_lock);
+		param_cache_complete(entry, result);
+	}
+
+	return NULL;
+}
+
+static void param_cache_worker_start(void) {
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, param_cache_worker, NULL) == 0) {
+		pthread_detach(thread);
+		param_cache_worker_running = 1;
+	}
+}
+
+/* Must be called with lock held, entry is marked in-flight on success */
+static int param_cache_refresh_start(param_cache_entry_t * entry, uint8_t prio, int timeout, int version) {
+
+	pthread_once(&param_cache_once, param_cache_worker_start);
+	if (!param_cache_worker_running)
+		return -1;
+
+	entry->prio = prio;
+	entry->timeout = timeout;
+	entry->version = version;
+	entry->queued = 1;
+	entry->in_flight = 1;
+	pthread_cond_signal(&param_cache_work);
+	return 0;
+}
+
+int param_pull_single_cached(param_t *param, int offset, uint8_t prio, int verbose, int host, int timeout, int version) {
+
+	pthread_mutex_lock(&param_cache_lock);
+
+	uint32_t max_age = param_cache_maxage(param);
+
+	/* No policy: plain pull */
+	if (max_age == 0) {
+		pthread_mutex_unlock(&param_cache_lock);
+		return param_pull_single(param, offset, prio, verbose, host, timeout, version);
+	}
+
+	param_cache_entry_t * entry = param_cache_find(param, host, 1);
+	if (entry == NULL) {
+		/* Every entry is being pulled, fall back to uncached */
+		pthread_mutex_unlock(&param_cache_lock);
+		return param_pull_single(param, offset, prio, verbose, host, timeout, version);
+	}
+
+	int result = 0;
+
+	param_cache_timestamp(entry, param);
+
+	if (entry->valid) {
+
+		/* Stale-while-revalidate: serve local copy, refresh in background */
+		if ((csp_get_ms() - entry->fetched >= max_age) && !entry->in_flight) {
+			param_cache_refresh_start(entry, prio, timeout, version);
+		}
+
+	} else if (entry->in_flight) {
+
+		/* Share the pull already in progress, the result is read before the entry can be reclaimed */
+		uint8_t done = entry->done;
+		entry->waiters++;
+		while (entry->done == done) {
+			pthread_cond_wait(&param_cache_done, &param_cache_lock);
+		}
+		result = entry->result;
+		entry->waiters--;
+
+	} else {
+
+		/* First read, pull synchronously. The whole array is fetched so any offset can be served later */
+		entry->in_flight = 1;
+		pthread_mutex_unlock(&param_cache_lock);
+		result = param_pull_single(param, -1, prio, 0, host, timeout, version);
+		pthread_mutex_lock(&param_cache_lock);
+		param_cache_complete(entry, result);
+
+	}
+
+	pthread_mutex_unlock(&param_cache_lock);
+
+	if (result == 0 && verbose) {
+		param_print(param, offset, NULL, 0, verbose, 0);
+	}
+
+	return result;
+}
+
+void param_cache_print(void) {
+
+	pthread_mutex_lock(&param_cache_lock);
+
+	for (int i = 0; i < PARAM_CACHE_MASK_POLICIES; i++) {
+		if (param_cache_policy[i].max_age == 0)
+			continue;
+		printf("  mask 0x%08"PRIX32" max-age %"PRIu32" ms\n", param_cache_policy[i].mask, param_cache_policy[i].max_age);
+	}
+
+	for (int i = 0; i < PARAM_CACHE_PARAM_POLICIES; i++) {
+		param_cache_param_policy_t * policy = &param_cache_param_policy[i];
+		if (policy->max_age == 0)
+			continue;
+		param_t * param = param_list_find_id(policy->node, policy->id);
+		printf("  %-20s node %-5u max-age %"PRIu32" ms\n", param ? param->name : "?", policy->node, policy->max_age);
+	}
+
+	uint32_t now = csp_get_ms();
+	for (int i = 0; i < PARAM_CACHE_ENTRIES; i++) {
+		param_cache_entry_t * entry = &param_cache[i];
+		if (!entry->used)
+			continue;
+		param_t * param = param_list_find_id(entry->node, entry->id);
+		printf("  %-20s node %-5u host %-5d", param ? param->name : "?", entry->node, entry->host);
+		if (entry->valid)
+			printf(" age %"PRIu32" ms", now - entry->fetched);
+		else
+			printf(" invalid");
+		if (entry->in_flight)
+			printf(" (pulling)");
+		printf("\n");
+	}
+
+	pthread_mutex_unlock(&param_cache_lock);
+}
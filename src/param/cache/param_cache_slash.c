@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <slash/slash.h>
+#include <slash/optparse.h>
+#include <slash/dflopt.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_cache.h>
+
+static int cmd_cache_maxage(struct slash *slash) {
+
+	int node = slash_dfl_node;
+	char * mask_str = NULL;
+
+	optparse_t * parser = optparse_new("cache maxage", "[param] <ms>");
+	optparse_add_help(parser);
+	optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_string(parser, 'm', "mask", "MASK", &mask_str, "set policy for all params matching mask (param letters)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	char * name = NULL;
+	if (mask_str == NULL) {
+		if (++argi >= slash->argc) {
+			printf("missing parameter name\n");
+			optparse_del(parser);
+			return SLASH_EINVAL;
+		}
+		name = slash->argv[argi];
+	}
+
+	if (++argi >= slash->argc) {
+		printf("missing max-age\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	uint32_t max_age = strtoul(slash->argv[argi], NULL, 10);
+
+	if (mask_str) {
+		if (param_cache_set_maxage_mask(param_maskstr_to_mask(mask_str), max_age) < 0) {
+			printf("Mask policy table full\n");
+			optparse_del(parser);
+			return SLASH_ENOMEM;
+		}
+		optparse_del(parser);
+		return SLASH_SUCCESS;
+	}
+
+	param_t * param = param_list_find_name(node, name);
+	if (param == NULL) {
+		printf("%s not found on node %d\n", name, node);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (param_cache_set_maxage(param, max_age) < 0) {
+		printf("Cache table full\n");
+		optparse_del(parser);
+		return SLASH_ENOMEM;
+	}
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(cache, maxage, cmd_cache_maxage, "[OPTIONS] [param] <ms>", "Set cache max-age, 0 disables caching");
+
+static int cmd_cache_clear(struct slash *slash) {
+	param_cache_invalidate();
+	return SLASH_SUCCESS;
+}
+slash_command_sub(cache, clear, cmd_cache_clear, "", "Invalidate all cached values");
+
+static int cmd_cache_list(struct slash *slash) {
+	param_cache_print();
+	return SLASH_SUCCESS;
+}
+slash_command_sub(cache, list, cmd_cache_list, "", "List cache policies and entries");
@@ -5,9 +5,11 @@
  *      Author: johan
  */
 
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
 #include <csp/csp.h>
 #include <csp/arch/csp_time.h>
-#include <unistd.h>
 
 #include <param/param_collector.h>
 #include <param/param_client.h>
@@ -15,31 +17,286 @@
 
 #include "param_collector_config.h"
 
+typedef struct {
+	uint16_t node;
+	uint32_t mask;
+	uint32_t interval;
+	uint32_t jitter;
+	uint32_t due;			// Next point on the interval grid
+	uint32_t deadline;		// due + jitter, heap key
+	uint32_t generation;	// Bumped on clear, so stale workers leave busy alone
+	uint8_t busy;
+	uint8_t prio;			// Priority class, 0 = PM_PRIO1
+	float cost;				// Average bytes per pull
+} param_collector_job_t;
+
+#define PARAM_COLLECTOR_PRIOS 3
+
+static param_collector_job_t param_collector_jobs[PARAM_COLLECTOR_JOBS];
+static int param_collector_job_count = 0;
+static uint32_t param_collector_generation = 0;
+
+/* Min-heap of jobs by deadline */
+static param_collector_job_t * param_collector_heap[PARAM_COLLECTOR_JOBS];
+static int param_collector_heap_size = 0;
+
+/* Work ring of due jobs */
+static param_collector_job_t * param_collector_work[PARAM_COLLECTOR_JOBS];
+static int param_collector_work_head = 0;
+static int param_collector_work_count = 0;
+
+static pthread_mutex_t param_collector_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t param_collector_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t param_collector_work_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int param_collector_seed = 1;
+
+uint32_t param_collector_budget = 0;
+static uint32_t param_collector_budget_used = 0;
+
+/* Bytes per second each priority class would use at full rate, and the resulting stretch */
+static float param_collector_demand[PARAM_COLLECTOR_PRIOS];
+static float param_collector_stretch[PARAM_COLLECTOR_PRIOS] = {1, 1, 1};
+
+static int param_collector_prio(uint32_t mask) {
+	switch (mask & PM_PRIO_MASK) {
+		case PM_PRIO1: return 0;
+		case PM_PRIO2: return 1;
+		default: return 2;
+	}
+}
+
+/* Spend the budget in priority order, the first class always runs at full rate */
+static void param_collector_rebalance(void) {
+
+	param_collector_budget_used = param_collector_budget;
+	float remaining = param_collector_budget;
+
+	for (int prio = 0; prio < PARAM_COLLECTOR_PRIOS; prio++) {
+		float demand = param_collector_demand[prio];
+		float stretch = 1;
+
+		if (param_collector_budget > 0 && prio > 0 && demand > remaining) {
+			stretch = (remaining > 0) ? demand / remaining : PARAM_COLLECTOR_MAX_STRETCH;
+			if (stretch > PARAM_COLLECTOR_MAX_STRETCH)
+				stretch = PARAM_COLLECTOR_MAX_STRETCH;
+		}
+
+		param_collector_stretch[prio] = stretch;
+		remaining -= demand / stretch;
+		if (remaining < 0)
+			remaining = 0;
+	}
+}
+
+static uint32_t param_collector_interval(param_collector_job_t * job) {
+	return job->interval * param_collector_stretch[job->prio];
+}
+
+/* Learn the response size of a job */
+static void param_collector_cost(param_collector_job_t * job, uint32_t bytes) {
+
+	float old_rate = job->cost * 1000 / job->interval;
+	if (job->cost == 0) {
+		job->cost = bytes;
+	} else {
+		job->cost += (bytes - job->cost) / 4;
+	}
+	param_collector_demand[job->prio] += job->cost * 1000 / job->interval - old_rate;
+
+	param_collector_rebalance();
+}
+
+static int param_collector_before(param_collector_job_t * a, param_collector_job_t * b) {
+	return (int32_t) (a->deadline - b->deadline) < 0;
+}
+
+static void param_collector_heap_push(param_collector_job_t * job) {
+	int i = param_collector_heap_size++;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!param_collector_before(job, param_collector_heap[parent]))
+			break;
+		param_collector_heap[i] = param_collector_heap[parent];
+		i = parent;
+	}
+	param_collector_heap[i] = job;
+}
+
+static param_collector_job_t * param_collector_heap_pop(void) {
+	param_collector_job_t * top = param_collector_heap[0];
+	param_collector_job_t * last = param_collector_heap[--param_collector_heap_size];
+	int i = 0;
+	while (1) {
+		int child = 2 * i + 1;
+		if (child >= param_collector_heap_size)
+			break;
+		if (child + 1 < param_collector_heap_size && param_collector_before(param_collector_heap[child + 1], param_collector_heap[child]))
+			child++;
+		if (!param_collector_before(param_collector_heap[child], last))
+			break;
+		param_collector_heap[i] = param_collector_heap[child];
+		i = child;
+	}
+	if (param_collector_heap_size > 0)
+		param_collector_heap[i] = last;
+	return top;
+}
+
+static uint32_t param_collector_jitter(param_collector_job_t * job) {
+	if (job->jitter == 0)
+		return 0;
+	return rand_r(&param_collector_seed) % job->jitter;
+}
+
+int param_collector_add(uint16_t node, uint32_t interval, uint32_t mask, int32_t phase, uint32_t jitter) {
+
+	if (interval == 0)
+		return -1;
+
+	pthread_mutex_lock(&param_collector_lock);
+
+	if (param_collector_job_count >= PARAM_COLLECTOR_JOBS) {
+		pthread_mutex_unlock(&param_collector_lock);
+		return -1;
+	}
+
+	if (phase < 0) {
+		/* Spread jobs with the same interval over the interval */
+		phase = ((node * 2654435761u) ^ mask) % interval;
+	}
+
+	param_collector_job_t * job = &param_collector_jobs[param_collector_job_count++];
+	job->node = node;
+	job->mask = mask;
+	job->interval = interval;
+	job->jitter = jitter;
+	job->generation = param_collector_generation;
+	job->busy = 0;
+	job->prio = param_collector_prio(mask);
+	job->cost = 0;
+
+	/* First deadline on the grid: the next multiple of interval, plus phase */
+	uint32_t now = csp_get_ms();
+	job->due = now - (now % interval) + (phase % interval);
+	if ((int32_t) (job->due - now) < 0)
+		job->due += interval;
+	job->deadline = job->due + param_collector_jitter(job);
+
+	param_collector_heap_push(job);
+	pthread_cond_signal(&param_collector_wake);
+	pthread_mutex_unlock(&param_collector_lock);
+
+	return 0;
+}
+
+void param_collector_clear(void) {
+	pthread_mutex_lock(&param_collector_lock);
+	param_collector_generation++;
+	param_collector_job_count = 0;
+	param_collector_heap_size = 0;
+	param_collector_work_count = 0;
+	for (int prio = 0; prio < PARAM_COLLECTOR_PRIOS; prio++)
+		param_collector_demand[prio] = 0;
+	param_collector_rebalance();
+	pthread_mutex_unlock(&param_collector_lock);
+}
+
+static void * param_collector_worker(void * param) {
+
+	pthread_mutex_lock(&param_collector_lock);
+
+	while (1) {
+
+		while (param_collector_work_count == 0)
+			pthread_cond_wait(&param_collector_work_cond, &param_collector_lock);
+
+		param_collector_job_t * job = param_collector_work[param_collector_work_head];
+		param_collector_work_head = (param_collector_work_head + 1) % PARAM_COLLECTOR_JOBS;
+		param_collector_work_count--;
+
+		uint16_t node = job->node;
+		uint32_t mask = job->mask;
+		uint32_t generation = job->generation;
+		pthread_mutex_unlock(&param_collector_lock);
+
+		uint32_t bytes = 0;
+		int result = param_pull_all_bytes(CSP_PRIO_NORM, param_get_uint8(&col_verbose), node, mask, 0, PARAM_COLLECTOR_TIMEOUT, 2, &bytes);
+
+		pthread_mutex_lock(&param_collector_lock);
+		if (job->generation == generation) {
+			job->busy = 0;
+			if (result == 0)
+				param_collector_cost(job, bytes);
+		}
+	}
+
+	return NULL;
+}
+
+static void param_collector_sleep(uint32_t ms) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(&param_collector_wake, &param_collector_lock, &ts);
+}
+
 void param_collector_loop(void * param) {
 
 	param_collector_init();
 
+	for (int i = 0; i < PARAM_COLLECTOR_WORKERS; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, param_collector_worker, NULL) == 0)
+			pthread_detach(thread);
+	}
+
+	pthread_mutex_lock(&param_collector_lock);
+
 	while(1) {
 
-		usleep(100000);
+		/* The run flag has no callback, so it is polled at most once a second */
+		if (param_get_uint8(&col_run) == 0 || param_collector_heap_size == 0) {
+			param_collector_sleep(1000);
+			continue;
+		}
 
-		for(int i = 0; i < 16; i++) {
-			if (param_collector_config[i].node == 0)
-				break;
+		/* The budget is a plain variable (or parameter), pick up changes */
+		if (param_collector_budget != param_collector_budget_used)
+			param_collector_rebalance();
 
-			if (param_get_uint8(&col_run) == 0)
-				continue;
+		uint32_t now = csp_get_ms();
 
-			if (csp_get_ms() < param_collector_config[i].last_time + param_collector_config[i].interval) {
-				continue;
-			}
+		while (param_collector_heap_size > 0 && (int32_t) (param_collector_heap[0]->deadline - now) <= 0) {
 
-			param_collector_config[i].last_time = csp_get_ms();
+			param_collector_job_t * job = param_collector_heap_pop();
 
-			param_pull_all(CSP_PRIO_NORM, param_get_uint8(&col_verbose), param_collector_config[i].node, param_collector_config[i].mask, 0, 1000, 2);
+			if (!job->busy && param_collector_work_count < PARAM_COLLECTOR_JOBS) {
+				job->busy = 1;
+				param_collector_work[(param_collector_work_head + param_collector_work_count) % PARAM_COLLECTOR_JOBS] = job;
+				param_collector_work_count++;
+				pthread_cond_signal(&param_collector_work_cond);
+			}
+
+			/* Stay on the grid, but skip deadlines already missed */
+			uint32_t interval = param_collector_interval(job);
+			job->due += interval;
+			if ((int32_t) (job->due - now) <= 0)
+				job->due = now + interval - ((now - job->due) % interval);
+			job->deadline = job->due + param_collector_jitter(job);
+			param_collector_heap_push(job);
 		}
 
+		int32_t wait = (int32_t) (param_collector_heap[0]->deadline - now);
+		if (wait > 1000)
+			wait = 1000;
+		if (wait > 0)
+			param_collector_sleep(wait);
+
 	}
 
 }
-
@@ -10,15 +10,6 @@
 
 #include <param/param.h>
 
-struct param_collector_config_s {
-	uint8_t node;
-	uint32_t interval;
-	uint32_t mask;
-	uint32_t last_time;
-};
-
-extern struct param_collector_config_s param_collector_config[];
-
 extern param_t col_run;
 extern param_t col_verbose;
 extern param_t col_cnfstr;
@@ -0,0 +1,223 @@
+#include <string.h>
+#include <csp/csp.h>
+
+#include <param/param.h>
+#include <param/param_history.h>
+
+typedef struct {
+	param_t * param;
+	uint32_t depth;
+	uint32_t size;
+	uint32_t reserve;		// Samples claimed by writers
+	uint32_t * stamp;		// depth sequence stamps, seq + 1 when written, 0 while writing
+	uint32_t * time;		// depth timestamps
+	uint8_t * value;		// depth values of size bytes
+} param_history_t;
+
+typedef struct {
+	uint32_t mask;
+	uint32_t depth;
+} param_history_mask_t;
+
+static uint8_t param_history_pool[PARAM_HISTORY] __attribute__((aligned(8)));
+static uint32_t param_history_pool_used = 0;
+
+static param_history_t param_history[PARAM_HISTORY_RINGS];
+static int param_history_count = 0;
+
+static param_history_mask_t param_history_masks[PARAM_HISTORY_MASKS];
+static int param_history_mask_count = 0;
+
+/* Allocation is rare, a spinning flag is enough */
+static uint8_t param_history_lock = 0;
+
+static void param_history_take(void) {
+	while (__atomic_test_and_set(&param_history_lock, __ATOMIC_ACQUIRE));
+}
+
+static void param_history_give(void) {
+	__atomic_clear(&param_history_lock, __ATOMIC_RELEASE);
+}
+
+static param_history_t * param_history_find(param_t * param) {
+	int count = __atomic_load_n(&param_history_count, __ATOMIC_ACQUIRE);
+	for (int i = 0; i < count; i++) {
+		if (param_history[i].param == param)
+			return &param_history[i];
+	}
+	return NULL;
+}
+
+static int param_history_supported(param_t * param) {
+	if (param->array_size > 1)
+		return 0;
+	switch (param->type) {
+		case PARAM_TYPE_STRING:
+		case PARAM_TYPE_DATA:
+		case PARAM_TYPE_INVALID:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+static param_history_t * param_history_alloc(param_t * param, int depth) {
+
+	if (depth <= 0 || !param_history_supported(param))
+		return NULL;
+
+	param_history_take();
+
+	param_history_t * history = param_history_find(param);
+	if (history) {
+		param_history_give();
+		return history;
+	}
+
+	uint32_t size = param_typesize(param->type);
+	/* Keep the value column 8 byte aligned for the next ring */
+	uint32_t bytes = (depth * (2 * sizeof(uint32_t) + size) + 7) & ~7;
+	if (param_history_count >= PARAM_HISTORY_RINGS || param_history_pool_used + bytes > PARAM_HISTORY) {
+		param_history_give();
+		return NULL;
+	}
+
+	history = &param_history[param_history_count];
+	history->param = param;
+	history->depth = depth;
+	history->size = size;
+	history->reserve = 0;
+	history->stamp = (uint32_t *) &param_history_pool[param_history_pool_used];
+	history->time = history->stamp + depth;
+	history->value = &param_history_pool[param_history_pool_used + 2 * depth * sizeof(uint32_t)];
+	memset(history->stamp, 0, depth * sizeof(uint32_t));
+	param_history_pool_used += bytes;
+
+	/* Publish the ring only when it is complete */
+	__atomic_store_n(&param_history_count, param_history_count + 1, __ATOMIC_RELEASE);
+
+	param_history_give();
+	return history;
+}
+
+int param_history_enable(param_t * param, int depth) {
+	return (param_history_alloc(param, depth) != NULL) ? 0 : -1;
+}
+
+int param_history_enable_mask(uint32_t mask, int depth) {
+	param_history_take();
+	if (param_history_mask_count >= PARAM_HISTORY_MASKS) {
+		param_history_give();
+		return -1;
+	}
+	param_history_masks[param_history_mask_count].mask = mask;
+	param_history_masks[param_history_mask_count].depth = depth;
+	__atomic_store_n(&param_history_mask_count, param_history_mask_count + 1, __ATOMIC_RELEASE);
+	param_history_give();
+	return 0;
+}
+
+void param_history_record(param_t * param, uint32_t timestamp) {
+
+	param_history_t * history = param_history_find(param);
+
+	if (history == NULL) {
+		int masks = __atomic_load_n(&param_history_mask_count, __ATOMIC_ACQUIRE);
+		for (int i = 0; i < masks; i++) {
+			if (param->mask & param_history_masks[i].mask) {
+				history = param_history_alloc(param, param_history_masks[i].depth);
+				break;
+			}
+		}
+		if (history == NULL)
+			return;
+	}
+
+	if (timestamp == 0) {
+		csp_timestamp_t now;
+		csp_clock_get_time(&now);
+		timestamp = now.tv_sec;
+	}
+
+	uint8_t value[8];
+	param_get(param, 0, value);
+
+	uint32_t seq = __atomic_fetch_add(&history->reserve, 1, __ATOMIC_RELAXED);
+	uint32_t slot = seq % history->depth;
+
+	/* Stamp the slot per sample, so writers never wait for each other */
+	__atomic_store_n(&history->stamp[slot], 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	history->time[slot] = timestamp;
+	memcpy(&history->value[slot * history->size], value, history->size);
+	__atomic_store_n(&history->stamp[slot], seq + 1, __ATOMIC_RELEASE);
+}
+
+static double param_history_value(param_history_t * history, uint32_t slot) {
+
+	const void * raw = &history->value[slot * history->size];
+
+	switch (history->param->type) {
+#define PARAM_HISTORY_CASE(casename, type) \
+		case casename: { type v; memcpy(&v, raw, sizeof(v)); return v; }
+		PARAM_HISTORY_CASE(PARAM_TYPE_UINT8, uint8_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_XINT8, uint8_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_UINT16, uint16_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_XINT16, uint16_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_UINT32, uint32_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_XINT32, uint32_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_UINT64, uint64_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_XINT64, uint64_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_INT8, int8_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_INT16, int16_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_INT32, int32_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_INT64, int64_t)
+		PARAM_HISTORY_CASE(PARAM_TYPE_FLOAT, float)
+		PARAM_HISTORY_CASE(PARAM_TYPE_DOUBLE, double)
+#undef PARAM_HISTORY_CASE
+		default:
+			return 0;
+	}
+}
+
+int param_history_query(param_t * param, uint32_t from, uint32_t to, uint32_t * times, double * values, int max) {
+
+	param_history_t * history = param_history_find(param);
+	if (history == NULL)
+		return -1;
+
+	uint32_t head = __atomic_load_n(&history->reserve, __ATOMIC_ACQUIRE);
+	uint32_t first = (head > history->depth) ? head - history->depth : 0;
+
+	/* Walk from the newest, so the newest max samples are kept */
+	int count = 0;
+	for (uint32_t seq = head; seq > first && count < max; seq--) {
+		uint32_t slot = (seq - 1) % history->depth;
+		uint32_t stamp = __atomic_load_n(&history->stamp[slot], __ATOMIC_ACQUIRE);
+		uint32_t time = history->time[slot];
+		double value = param_history_value(history, slot);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		/* Still being written, or overwritten while we copied it */
+		if (stamp != seq || __atomic_load_n(&history->stamp[slot], __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if (time < from || time > to)
+			continue;
+		times[count] = time;
+		values[count] = value;
+		count++;
+	}
+
+	/* Oldest first */
+	for (int i = 0; i < count / 2; i++) {
+		uint32_t time = times[i];
+		times[i] = times[count - 1 - i];
+		times[count - 1 - i] = time;
+		double value = values[i];
+		values[i] = values[count - 1 - i];
+		values[count - 1 - i] = value;
+	}
+
+	return count;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <inttypes.h>
+#include <slash/slash.h>
+#include <slash/optparse.h>
+#include <slash/dflopt.h>
+#include <csp/csp.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_history.h>
+
+static int cmd_history_enable(struct slash *slash) {
+
+	int node = slash_dfl_node;
+	int depth = 128;
+	char * mask_str = NULL;
+
+	optparse_t * parser = optparse_new("history enable", "[param]");
+	optparse_add_help(parser);
+	optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_int(parser, 'd', "depth", "NUM", 0, &depth, "samples kept (default = 128)");
+	optparse_add_string(parser, 'm', "mask", "MASK", &mask_str, "enable for all params matching mask (param letters)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (mask_str) {
+		if (param_history_enable_mask(param_maskstr_to_mask(mask_str), depth) < 0) {
+			printf("Mask policy table full\n");
+			optparse_del(parser);
+			return SLASH_ENOMEM;
+		}
+		optparse_del(parser);
+		return SLASH_SUCCESS;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("missing parameter name\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	param_t * param = param_list_find_name(node, slash->argv[argi]);
+	if (param == NULL) {
+		printf("%s not found on node %d\n", slash->argv[argi], node);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (param_history_enable(param, depth) < 0) {
+		printf("Unsupported type, or out of history memory\n");
+		optparse_del(parser);
+		return SLASH_ENOMEM;
+	}
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(history, enable, cmd_history_enable, "[OPTIONS] [param]", "Keep value history of a parameter");
+
+static int cmd_history_show(struct slash *slash) {
+
+	int node = slash_dfl_node;
+	int seconds = 0;
+	int max = 20;
+
+	optparse_t * parser = optparse_new("history show", "<param>");
+	optparse_add_help(parser);
+	optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
+	optparse_add_int(parser, 's', "seconds", "NUM", 0, &seconds, "only the last seconds (default = all)");
+	optparse_add_int(parser, 'c', "count", "NUM", 0, &max, "max samples shown (default = 20)");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (++argi >= slash->argc) {
+		printf("missing parameter name\n");
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	param_t * param = param_list_find_name(node, slash->argv[argi]);
+	if (param == NULL) {
+		printf("%s not found on node %d\n", slash->argv[argi], node);
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (max <= 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	uint32_t from = 0;
+	if (seconds > 0) {
+		csp_timestamp_t now;
+		csp_clock_get_time(&now);
+		from = now.tv_sec - seconds;
+	}
+
+	uint32_t * times = malloc(max * sizeof(uint32_t));
+	double * values = malloc(max * sizeof(double));
+	if (times == NULL || values == NULL) {
+		free(times);
+		free(values);
+		optparse_del(parser);
+		return SLASH_ENOMEM;
+	}
+
+	int count = param_history_query(param, from, UINT32_MAX, times, values, max);
+	if (count < 0)
+		printf("No history for %s\n", param->name);
+
+	for (int i = 0; i < count; i++) {
+		time_t t = times[i];
+		struct tm tm;
+		char buf[32];
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime_r(&t, &tm));
+		printf("  %s  %g\n", buf, values[i]);
+	}
+
+	free(times);
+	free(values);
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(history, show, cmd_history_show, "[OPTIONS] <param>", "Show value history of a parameter");
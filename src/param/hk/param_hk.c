@@ -0,0 +1,347 @@
+#include <param/param_hk.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <csp/csp.h>
+#include <sys/types.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_queue.h>
+#include <param/param_server.h>
+#include <param/param_stats.h>
+
+#include <objstore/objstore.h>
+
+/**
+ * NOTE: The lock functions are external hooks,
+ * and must therefore be implemented by the user.
+ */
+int si_lock_take(void* lock, int block_time_ms);
+int si_lock_give(void* lock);
+void* si_lock_init(void);
+
+static void* lock = NULL;
+
+/* A stored queue object is the response from data[2]: prio, reserved, time, queue */
+#define PARAM_HK_OBJ_HEADER (PARAM_HK_HEADER_SIZE - 2)
+
+typedef struct __attribute__((packed)) {
+	uint32_t time;
+	uint32_t offset;
+} param_hk_index_entry_t;
+
+/* Entries sorted by time, oldest first */
+typedef struct __attribute__((packed)) {
+	uint16_t count;
+	uint16_t reserved;
+	param_hk_index_entry_t entry[PARAM_HK_INDEX];
+} param_hk_index_t;
+
+static param_hk_index_t hk_index;
+static int hk_index_offset = -1;
+
+static uint32_t hk_interval[PARAM_HK_CLASSES];
+static uint32_t hk_last[PARAM_HK_CLASSES];
+
+static void param_hk_index_save(void) {
+	if (hk_index_offset < 0)
+		return;
+	objstore_write_obj(&vmem_hk, hk_index_offset, OBJ_TYPE_HK_INDEX, sizeof(hk_index), (void *) &hk_index);
+}
+
+static void param_hk_index_insert(uint32_t time, int offset) {
+
+	/* Normally appended, but keep the order if the clock was stepped back */
+	int i = hk_index.count;
+	while (i > 0 && hk_index.entry[i - 1].time > time) {
+		hk_index.entry[i] = hk_index.entry[i - 1];
+		i--;
+	}
+	hk_index.entry[i].time = time;
+	hk_index.entry[i].offset = offset;
+	hk_index.count++;
+}
+
+static void param_hk_drop_oldest(void) {
+	int offset = hk_index.entry[0].offset;
+	hk_index.count--;
+	memmove(&hk_index.entry[0], &hk_index.entry[1], hk_index.count * sizeof(param_hk_index_entry_t));
+
+	/* The saved index must never point at a removed object, a reset may come at any time */
+	param_hk_index_save();
+	objstore_rm_obj(&vmem_hk, offset, 0);
+}
+
+/* First entry with time >= from */
+static int param_hk_index_find(uint32_t from) {
+	int lo = 0, hi = hk_index.count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (hk_index.entry[mid].time < from) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static int param_hk_store(uint8_t * obj, int length, uint32_t time) {
+
+	int offset;
+	while (1) {
+		if (hk_index.count < PARAM_HK_INDEX) {
+			offset = objstore_alloc(&vmem_hk, length, 0);
+			if (offset >= 0)
+				break;
+		}
+		if (hk_index.count == 0)
+			return -1;
+		param_hk_drop_oldest();
+	}
+
+	objstore_write_obj(&vmem_hk, offset, OBJ_TYPE_HK_QUEUE, length, obj);
+	param_hk_index_insert(time, offset);
+	return 0;
+}
+
+static int param_hk_store_class(int prio, uint32_t time) {
+
+	uint8_t obj[PARAM_HK_OBJ_HEADER + PARAM_HK_QUEUE_SIZE];
+	obj[0] = prio;
+	obj[1] = 0;
+	uint32_t _time = htobe32(time);
+	memcpy(&obj[2], &_time, sizeof(_time));
+
+	param_queue_t queue;
+	param_queue_init(&queue, &obj[PARAM_HK_OBJ_HEADER], PARAM_HK_QUEUE_SIZE, 0, PARAM_QUEUE_TYPE_SET, 2);
+
+	int stored = 0;
+	param_t * param;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL) {
+
+		if ((param->node != 0) || ((param->mask & PM_PRIO_MASK) != (prio << 12)))
+			continue;
+
+		if (param_queue_add(&queue, param, -1, NULL) == 0)
+			continue;
+
+		/* Queue full, store it and continue in a fresh one */
+		if (queue.used > 0) {
+			if (param_hk_store(obj, PARAM_HK_OBJ_HEADER + queue.used, time) < 0)
+				return -1;
+			stored++;
+			param_queue_init(&queue, &obj[PARAM_HK_OBJ_HEADER], PARAM_HK_QUEUE_SIZE, 0, PARAM_QUEUE_TYPE_SET, 2);
+		}
+
+		if (param_queue_add(&queue, param, -1, NULL) != 0) {
+			printf("warn: %s too big for hk queue\n", param->name);
+			param_queue_init(&queue, &obj[PARAM_HK_OBJ_HEADER], PARAM_HK_QUEUE_SIZE, 0, PARAM_QUEUE_TYPE_SET, 2);
+		}
+	}
+
+	if (queue.used > 0) {
+		if (param_hk_store(obj, PARAM_HK_OBJ_HEADER + queue.used, time) < 0)
+			return -1;
+		stored++;
+	}
+
+	return stored;
+}
+
+void param_hk_set_interval(int prio, uint32_t interval) {
+	if (prio < 1 || prio > PARAM_HK_CLASSES)
+		return;
+	hk_interval[prio - 1] = interval;
+	hk_last[prio - 1] = 0;
+}
+
+int param_hk_server_update(uint32_t timestamp) {
+
+	if (lock == NULL || si_lock_take(lock, 1000) != 0)
+		return -1;
+
+	int stored = 0;
+	for (int prio = 1; prio <= PARAM_HK_CLASSES; prio++) {
+
+		uint32_t interval = hk_interval[prio - 1];
+		if (interval == 0)
+			continue;
+		if (hk_last[prio - 1] != 0 && timestamp - hk_last[prio - 1] < interval)
+			continue;
+		hk_last[prio - 1] = timestamp;
+
+		int result = param_hk_store_class(prio, timestamp);
+		if (result < 0) {
+			stored = -1;
+			break;
+		}
+		stored += result;
+	}
+
+	if (stored != 0)
+		param_hk_index_save();
+
+	si_lock_give(lock);
+	return stored;
+}
+
+void param_hk_loop(void * param) {
+	while(1) {
+		csp_timestamp_t now;
+		csp_clock_get_time(&now);
+		param_hk_server_update(now.tv_sec);
+		sleep(1);
+	}
+}
+
+static void param_hk_send(csp_packet_t * request, csp_packet_t * packet, uint8_t flags) {
+	packet->data[0] = PARAM_HK_RESPONSE;
+	packet->data[1] = flags;
+	param_stats_add(PARAM_STATS_BYTES_OUT, packet->length);
+	csp_sendto_reply(request, packet, CSP_O_SAME);
+}
+
+void param_serve_hk(csp_packet_t * request) {
+
+	uint32_t from = 0;
+	uint32_t to = UINT32_MAX;
+	if (request->length >= 12) {
+		from = be32toh(request->data32[1]);
+		to = be32toh(request->data32[2]);
+	}
+
+	/* Every packet is sent when the next one is ready, so the last can carry the end flag */
+	csp_packet_t * pending = NULL;
+	uint8_t end = PARAM_FLAG_END;
+
+	if (lock != NULL && si_lock_take(lock, 1000) == 0) {
+
+		for (int i = param_hk_index_find(from); i < hk_index.count && hk_index.entry[i].time <= to; i++) {
+
+			/* The index may have been saved before a reset, only trust what it points at */
+			int offset = hk_index.entry[i].offset;
+			if (objstore_read_obj_type(&vmem_hk, offset) != OBJ_TYPE_HK_QUEUE)
+				continue;
+			int length = objstore_read_obj_length(&vmem_hk, offset);
+			if (length < PARAM_HK_OBJ_HEADER || length > PARAM_SERVER_MTU - 2)
+				continue;
+
+			csp_packet_t * packet = csp_buffer_get(PARAM_SERVER_MTU);
+			if (packet == NULL) {
+				/* Tell the client the range was cut short, rather than ending normally */
+				param_stats_add(PARAM_STATS_NOBUF, 1);
+				end |= PARAM_FLAG_PARTIAL;
+				break;
+			}
+
+			if (objstore_read_obj(&vmem_hk, offset, &packet->data[2], 0) < 0) {
+				csp_buffer_free(packet);
+				continue;
+			}
+
+			/* Stored time follows prio and reserved */
+			uint32_t time;
+			memcpy(&time, &packet->data[4], sizeof(time));
+			if (be32toh(time) != hk_index.entry[i].time) {
+				csp_buffer_free(packet);
+				continue;
+			}
+			packet->length = length + 2;
+
+			if (pending)
+				param_hk_send(request, pending, 0);
+			pending = packet;
+		}
+
+		si_lock_give(lock);
+	}
+
+	if (pending) {
+		param_hk_send(request, pending, end);
+		csp_buffer_free(request);
+		return;
+	}
+
+	/* Nothing found or sent, reply with an empty queue */
+	memset(&request->data[2], 0, PARAM_HK_OBJ_HEADER);
+	request->length = PARAM_HK_HEADER_SIZE;
+	param_hk_send(request, request, end);
+}
+
+static int param_hk_rebuild_scancb(vmem_t * vmem, int offset, int verbose, void * ctx) {
+
+	if (objstore_read_obj_type(vmem, offset) != OBJ_TYPE_HK_QUEUE)
+		return 0;
+
+	/* The scan is restarted after every removal, skip what is already indexed */
+	for (int i = 0; i < hk_index.count; i++) {
+		if (hk_index.entry[i].offset == (uint32_t) offset)
+			return 0;
+	}
+
+	uint32_t time;
+	vmem->read(vmem, offset + OBJ_HEADER_LENGTH + 2, &time, sizeof(time));
+	time = be32toh(time);
+
+	if (hk_index.count >= PARAM_HK_INDEX) {
+		/* Index too small for the store, keep the newest. The scan
+		 * cannot continue past a removed object, so stop it here */
+		if (time <= hk_index.entry[0].time)
+			return -1;
+		param_hk_drop_oldest();
+	}
+
+	param_hk_index_insert(time, offset);
+	return 0;
+}
+
+static int param_hk_find_index_scancb(vmem_t * vmem, int offset, int verbose, void * ctx) {
+	if (objstore_read_obj_type(vmem, offset) == OBJ_TYPE_HK_INDEX)
+		return -1;
+	return 0;
+}
+
+void param_hk_server_init(void) {
+
+	lock = si_lock_init();
+
+	if (si_lock_take(lock, -1) != 0) {
+		printf("Lock timeout in %s\n", __FUNCTION__);
+		return;
+	}
+
+	hk_index_offset = objstore_scan(&vmem_hk, param_hk_find_index_scancb, 0, NULL);
+
+	if (hk_index_offset >= 0 && objstore_read_obj_length(&vmem_hk, hk_index_offset) == sizeof(hk_index)
+			&& objstore_read_obj(&vmem_hk, hk_index_offset, (void *) &hk_index, 0) == 0
+			&& hk_index.count <= PARAM_HK_INDEX) {
+		si_lock_give(lock);
+		return;
+	}
+
+	/* Missing, corrupt or resized index: rebuild it from the stored queues */
+	if (hk_index_offset >= 0)
+		objstore_rm_obj(&vmem_hk, hk_index_offset, 0);
+	hk_index_offset = -1;
+
+	memset(&hk_index, 0, sizeof(hk_index));
+	int offset;
+	while ((offset = objstore_scan(&vmem_hk, param_hk_rebuild_scancb, 0, NULL)) >= 0) {
+		objstore_rm_obj(&vmem_hk, offset, 0);
+	}
+
+	hk_index_offset = objstore_alloc(&vmem_hk, sizeof(hk_index), 0);
+	while (hk_index_offset < 0 && hk_index.count > 0) {
+		param_hk_drop_oldest();
+		hk_index_offset = objstore_alloc(&vmem_hk, sizeof(hk_index), 0);
+	}
+	if (hk_index_offset < 0)
+		printf("No room for hk index in %s\n", vmem_hk.name);
+
+	param_hk_index_save();
+	si_lock_give(lock);
+}
@@ -0,0 +1,85 @@
+#include <param/param_hk.h>
+
+#include <stdio.h>
+#include <time.h>
+#include <csp/csp.h>
+#include <sys/types.h>
+
+#include <param/param.h>
+#include <param/param_server.h>
+#include <param/param_queue.h>
+
+typedef void (*param_transaction_callback_f)(csp_packet_t *response, int verbose, int version, void * context);
+int param_transaction(csp_packet_t *packet, int host, int timeout, param_transaction_callback_f callback, int verbose, int version, void * context);
+
+typedef struct {
+	int count;
+	int partial;
+	uint32_t last;
+} param_hk_retrieve_t;
+
+static void param_transaction_callback_hk(csp_packet_t *response, int verbose, int version, void * context) {
+
+	param_hk_retrieve_t * retrieve = context;
+
+	if (response->data[0] == PARAM_HK_RESPONSE && (response->data[1] & PARAM_FLAG_PARTIAL))
+		retrieve->partial = 1;
+
+	if ((response->data[0] != PARAM_HK_RESPONSE) || (response->length <= PARAM_HK_HEADER_SIZE)) {
+		csp_buffer_free(response);
+		return;
+	}
+
+	uint32_t time = be32toh(response->data32[1]);
+	int length = response->length - PARAM_HK_HEADER_SIZE;
+
+	/* Apply with the time the queue was stored, instead of now */
+	param_queue_t queue;
+	param_queue_init(&queue, &response->data[PARAM_HK_HEADER_SIZE], length, length, PARAM_QUEUE_TYPE_SET, 2);
+	queue.last_node = response->id.src;
+	queue.client_timestamp = time;
+	queue.last_timestamp = time;
+	param_queue_apply(&queue, 0, response->id.src);
+
+	if (verbose) {
+		time_t t = time;
+		struct tm tm;
+		char buf[32];
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime_r(&t, &tm));
+		printf("  %s  prio %u, %d bytes\n", buf, response->data[2], length);
+	}
+
+	retrieve->count++;
+	retrieve->last = time;
+	csp_buffer_free(response);
+}
+
+int param_hk_retrieve(int server, uint32_t from, uint32_t to, int verbose, int timeout) {
+
+	csp_packet_t * packet = csp_buffer_get(PARAM_SERVER_MTU);
+	if (packet == NULL)
+		return -1;
+
+	packet->data[0] = PARAM_HK_REQUEST;
+	packet->data[1] = 0;
+	packet->data16[1] = 0;
+	packet->data32[1] = htobe32(from);
+	packet->data32[2] = htobe32(to);
+	packet->length = 12;
+	packet->id.pri = CSP_PRIO_NORM;
+
+	param_hk_retrieve_t retrieve = {};
+	if (param_transaction(packet, server, timeout, param_transaction_callback_hk, verbose, 2, &retrieve) < 0) {
+		if (verbose)
+			printf("No response from %d, %d queues received\n", server, retrieve.count);
+		return -1;
+	}
+
+	if (retrieve.partial) {
+		if (verbose)
+			printf("Server %d ran out of buffers, %d queues received up to %u\n", server, retrieve.count, (unsigned int) retrieve.last);
+		return -1;
+	}
+
+	return retrieve.count;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <slash/slash.h>
+#include <slash/optparse.h>
+#include <slash/dflopt.h>
+#include <csp/csp.h>
+
+#include <param/param.h>
+#include <param/param_hk.h>
+
+static int cmd_hk_retrieve(struct slash *slash) {
+
+	unsigned int timeout = slash_dfl_timeout;
+	unsigned int server = slash_dfl_node;
+	unsigned int seconds = 0;
+
+	optparse_t * parser = optparse_new("hk retrieve", "[from] [to]");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 't', "timeout", "NUM", 0, &timeout, "timeout in milliseconds (default = <env>)");
+	optparse_add_unsigned(parser, 's', "server", "NUM", 0, &server, "server to retrieve from (default = <env>))");
+	optparse_add_unsigned(parser, 'l', "last", "NUM", 0, &seconds, "the last NUM seconds, instead of from/to");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	/* UNIX times */
+	uint32_t from = 0;
+	uint32_t to = UINT32_MAX;
+	if (++argi < slash->argc)
+		from = strtoul(slash->argv[argi], NULL, 0);
+	if (++argi < slash->argc)
+		to = strtoul(slash->argv[argi], NULL, 0);
+
+	if (seconds > 0) {
+		csp_timestamp_t now;
+		csp_clock_get_time(&now);
+		from = now.tv_sec - seconds;
+		to = UINT32_MAX;
+	}
+
+	int count = param_hk_retrieve(server, from, to, 1, timeout);
+	optparse_del(parser);
+
+	if (count < 0)
+		return SLASH_EIO;
+
+	printf("Received %d queues\n", count);
+	return SLASH_SUCCESS;
+}
+slash_command_sub(hk, retrieve, cmd_hk_retrieve, "[OPTIONS] [from] [to]", "Retrieve stored housekeeping from a node");
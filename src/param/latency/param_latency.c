@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <param/param_latency.h>
+
+/* Slot key is host + 1, so zero marks a free slot. Claimed with compare and swap */
+static uint32_t param_latency_keys[PARAM_LATENCY_HOSTS];
+static param_latency_t param_latency[PARAM_LATENCY_HOSTS];
+
+static param_latency_t * param_latency_find(int host, int create) {
+
+	uint32_t key = host + 1;
+	for (int i = 0; i < PARAM_LATENCY_HOSTS; i++) {
+		uint32_t current = __atomic_load_n(&param_latency_keys[i], __ATOMIC_ACQUIRE);
+		if (current == key)
+			return &param_latency[i];
+		if (current == 0 && create) {
+			if (__atomic_compare_exchange_n(&param_latency_keys[i], &current, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				param_latency[i].host = host;
+				return &param_latency[i];
+			}
+			/* Lost the race, the slot may have been taken by the same host */
+			if (current == key)
+				return &param_latency[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int param_latency_bucket(uint32_t value) {
+	if (value < 16)
+		return value;
+	int exponent = 31 - __builtin_clz(value);
+	int bucket = 16 + (exponent - 4) * 8 + ((value >> (exponent - 3)) & 7);
+	return (bucket < PARAM_LATENCY_BUCKETS) ? bucket : PARAM_LATENCY_BUCKETS - 1;
+}
+
+static uint32_t param_latency_bucket_upper(int bucket) {
+	if (bucket < 16)
+		return bucket;
+	int exponent = (bucket - 16) / 8 + 4;
+	int sub = (bucket - 16) % 8;
+	return ((8 + sub + 1) << (exponent - 3)) - 1;
+}
+
+static void param_latency_add(param_latency_hist_t * hist, int value) {
+
+	if (value < 0)
+		return;
+
+	__atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->bucket[param_latency_bucket(value)], 1, __ATOMIC_RELAXED);
+
+	uint32_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	while ((uint32_t) value > max) {
+		if (__atomic_compare_exchange_n(&hist->max, &max, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+void param_latency_record(int host, int connect, int first, int end) {
+
+	param_latency_t * latency = param_latency_find(host, 1);
+	if (latency == NULL)
+		return;
+
+	__atomic_fetch_add(&latency->transactions, 1, __ATOMIC_RELAXED);
+	if (latency->last_failed)
+		__atomic_fetch_add(&latency->retries, 1, __ATOMIC_RELAXED);
+
+	if (connect < 0) {
+		__atomic_fetch_add(&latency->connect_failures, 1, __ATOMIC_RELAXED);
+		latency->last_failed = 1;
+		return;
+	}
+
+	if (end < 0)
+		__atomic_fetch_add(&latency->timeouts, 1, __ATOMIC_RELAXED);
+	latency->last_failed = (end < 0);
+
+	param_latency_add(&latency->hist[PARAM_LATENCY_CONNECT], connect);
+	param_latency_add(&latency->hist[PARAM_LATENCY_FIRST], first);
+	param_latency_add(&latency->hist[PARAM_LATENCY_END], end);
+}
+
+int param_latency_get(int host, param_latency_t * out) {
+	param_latency_t * latency = param_latency_find(host, 0);
+	if (latency == NULL)
+		return -1;
+	memcpy(out, latency, sizeof(*out));
+	return 0;
+}
+
+uint32_t param_latency_percentile(const param_latency_hist_t * hist, float fraction) {
+
+	if (hist->count == 0)
+		return 0;
+
+	uint32_t rank = fraction * hist->count;
+	if (rank >= hist->count)
+		rank = hist->count - 1;
+
+	uint32_t seen = 0;
+	for (int i = 0; i < PARAM_LATENCY_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen > rank)
+			return (param_latency_bucket_upper(i) < hist->max) ? param_latency_bucket_upper(i) : hist->max;
+	}
+
+	return hist->max;
+}
+
+void param_latency_clear(int host) {
+	for (int i = 0; i < PARAM_LATENCY_HOSTS; i++) {
+		if (host >= 0 && param_latency_keys[i] != (uint32_t) host + 1)
+			continue;
+		uint16_t saved = param_latency[i].host;
+		memset(&param_latency[i], 0, sizeof(param_latency[i]));
+		param_latency[i].host = saved;
+	}
+}
+
+void param_latency_print(int host) {
+
+	static const char * stage_names[PARAM_LATENCY_STAGES] = {"connect", "first", "end"};
+
+	for (int i = 0; i < PARAM_LATENCY_HOSTS; i++) {
+		uint32_t key = __atomic_load_n(&param_latency_keys[i], __ATOMIC_ACQUIRE);
+		if (key == 0 || (host >= 0 && key != (uint32_t) host + 1))
+			continue;
+
+		param_latency_t latency;
+		memcpy(&latency, &param_latency[i], sizeof(latency));
+
+		printf("Node %u: %"PRIu32" transactions, %"PRIu32" connect failures, %"PRIu32" timeouts, %"PRIu32" retries\n",
+			latency.host, latency.transactions, latency.connect_failures, latency.timeouts, latency.retries);
+
+		for (int stage = 0; stage < PARAM_LATENCY_STAGES; stage++) {
+			param_latency_hist_t * hist = &latency.hist[stage];
+			if (hist->count == 0)
+				continue;
+			printf("  %-8s n %-6"PRIu32" p50 %-6"PRIu32" p90 %-6"PRIu32" p99 %-6"PRIu32" max %"PRIu32" ms\n", stage_names[stage], hist->count,
+				param_latency_percentile(hist, 0.5), param_latency_percentile(hist, 0.9),
+				param_latency_percentile(hist, 0.99), hist->max);
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <slash/slash.h>
+#include <slash/optparse.h>
+
+#include <param/param_latency.h>
+
+static int cmd_latency(struct slash *slash) {
+
+	int node = -1;
+	int clear = 0;
+
+	optparse_t * parser = optparse_new("latency", "");
+	optparse_add_help(parser);
+	optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "only this node (default = all)");
+	optparse_add_set(parser, 'c', "clear", 1, &clear, "clear statistics");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (clear) {
+		param_latency_clear(node);
+	} else {
+		param_latency_print(node);
+	}
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command(latency, cmd_latency, "[OPTIONS]", "Show param client round-trip latency per node");
@@ -42,6 +42,14 @@ static param_t param_size_set[2] __attribute__((aligned(1)));
 static SLIST_HEAD(param_list_head_s, param_s) param_list_head = {};
 #endif
 
+#if PARAM_MASK_INDEX > 0
+/* Bumped whenever the list or a mask changes, invalidates the mask index */
+static uint32_t param_list_generation = 1;
+#define param_list_changed() __atomic_add_fetch(&param_list_generation, 1, __ATOMIC_RELAXED)
+#else
+#define param_list_changed()
+#endif
+
 uint8_t param_is_static(param_t * param) {
 
 	__attribute__((weak)) extern param_t __start_param;
@@ -54,6 +62,27 @@ uint8_t param_is_static(param_t * param) {
 	return 0;
 }
 
+#if PARAM_VERSIONS > 0
+static uint32_t param_versions[PARAM_VERSIONS];
+#endif
+
+uint32_t * param_version(param_t * param) {
+#if PARAM_VERSIONS > 0
+	__attribute__((weak)) extern param_t __start_param;
+
+	if (!param_is_static(param))
+		return NULL;
+
+	unsigned int idx = ((intptr_t) param - (intptr_t) &__start_param) / PARAM_STORAGE_SIZE;
+	if (idx >= PARAM_VERSIONS)
+		return NULL;
+
+	return &param_versions[idx];
+#else
+	return NULL;
+#endif
+}
+
 param_t * param_list_iterate(param_list_iterator * iterator) {
 
 	/**
@@ -137,12 +166,14 @@ int param_list_add(param_t * item) {
 			if(param->docstr && item->docstr){
 				strcpy(param->docstr, item->docstr);
 			}
+			param_list_changed();
 		}
 
 		return 1;
 	} else {
 #ifdef PARAM_HAVE_SYS_QUEUE
 		SLIST_INSERT_HEAD(&param_list_head, item, next);
+		param_list_changed();
 #else
 		return -1;
 #endif
@@ -176,6 +207,7 @@ int param_list_remove(int node, uint8_t verbose) {
 				printf("Removing param: %s:%u[%d]\n", param->name, param->node, param->array_size);
 			// Using SLIST_REMOVE() means we iterate twice, but it is simpler.
 			SLIST_REMOVE(&param_list_head, param, param_s, next);
+			param_list_changed();
 			param_list_destroy(param);
 			count++;
 		}
@@ -189,12 +221,136 @@ void param_list_remove_specific(param_t * param, uint8_t verbose, int destroy) {
         printf("Removing param: %s:%u[%d]\n", param->name, param->node, param->array_size);
     }
     SLIST_REMOVE(&param_list_head, param, param_s, next);
+    param_list_changed();
     if (destroy) {
         param_list_destroy(param);
     }
 }
 #endif
 
+#if PARAM_MASK_INDEX > 0
+
+#define PARAM_MASK_INDEX_WORDS ((PARAM_MASK_INDEX + 31) / 32)
+
+/**
+ * One membership bitmap per mask bit over the list order. A pull-all then becomes a
+ * few word wide OR/ANDNOT operations followed by a walk over the set bits.
+ */
+static struct {
+	uint8_t busy;
+	uint8_t valid;
+	uint32_t generation;
+	int count;
+	param_t * params[PARAM_MASK_INDEX];
+	uint32_t bits[32][PARAM_MASK_INDEX_WORDS];
+} param_mask_index;
+
+/* Must be called with index locked */
+static void param_mask_index_build(void) {
+
+	memset(param_mask_index.bits, 0, sizeof(param_mask_index.bits));
+	param_mask_index.count = 0;
+	param_mask_index.valid = 0;
+	param_mask_index.generation = __atomic_load_n(&param_list_generation, __ATOMIC_RELAXED);
+
+	param_t * param;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL) {
+
+		/* Too many parameters, callers fall back to linear search */
+		if (param_mask_index.count >= PARAM_MASK_INDEX)
+			return;
+
+		int idx = param_mask_index.count++;
+		param_mask_index.params[idx] = param;
+
+		uint32_t mask = param->mask;
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			mask &= mask - 1;
+			param_mask_index.bits[bit][idx / 32] |= 1UL << (idx % 32);
+		}
+	}
+
+	param_mask_index.valid = 1;
+}
+
+static int param_mask_index_foreach(uint32_t include_mask, uint32_t exclude_mask, param_list_mask_callback_f callback, void * context, int * result) {
+
+	if (__atomic_test_and_set(&param_mask_index.busy, __ATOMIC_ACQUIRE))
+		return -1;
+
+	if (param_mask_index.generation != __atomic_load_n(&param_list_generation, __ATOMIC_RELAXED))
+		param_mask_index_build();
+
+	if (!param_mask_index.valid) {
+		__atomic_clear(&param_mask_index.busy, __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	int words = (param_mask_index.count + 31) / 32;
+	uint32_t set[PARAM_MASK_INDEX_WORDS] = {0};
+
+	while (include_mask) {
+		int bit = __builtin_ctz(include_mask);
+		include_mask &= include_mask - 1;
+		for (int w = 0; w < words; w++)
+			set[w] |= param_mask_index.bits[bit][w];
+	}
+
+	while (exclude_mask) {
+		int bit = __builtin_ctz(exclude_mask);
+		exclude_mask &= exclude_mask - 1;
+		for (int w = 0; w < words; w++)
+			set[w] &= ~param_mask_index.bits[bit][w];
+	}
+
+	*result = 0;
+	for (int w = 0; w < words && *result >= 0; w++) {
+		uint32_t word = set[w];
+		while (word) {
+			int bit = __builtin_ctz(word);
+			word &= word - 1;
+			*result = callback(param_mask_index.params[w * 32 + bit], context);
+			if (*result < 0)
+				break;
+		}
+	}
+
+	__atomic_clear(&param_mask_index.busy, __ATOMIC_RELEASE);
+	return 0;
+}
+#endif
+
+int param_list_foreach_mask(uint32_t include_mask, uint32_t exclude_mask, param_list_mask_callback_f callback, void * context) {
+
+	int result = 0;
+
+#if PARAM_MASK_INDEX > 0
+	if (param_mask_index_foreach(include_mask, exclude_mask, callback, context, &result) == 0)
+		return result;
+#endif
+
+	param_t * param;
+	param_list_iterator i = {};
+	while ((param = param_list_iterate(&i)) != NULL) {
+
+		/* If none of the include matches, continue */
+		if ((param->mask & include_mask) == 0)
+			continue;
+
+		/* In any one of the exclude matches, continue */
+		if ((param->mask & exclude_mask) != 0)
+			continue;
+
+		result = callback(param, context);
+		if (result < 0)
+			break;
+	}
+
+	return result;
+}
+
 param_t * param_list_find_id(int node, int id) {
 	
 	if (node < 0)
@@ -629,6 +785,9 @@ param_t * param_list_create_remote(int id, int node, int type, uint32_t mask, in
 	param->vmem->big_endian = false;
 	param->vmem->restore = NULL;
 	param->vmem->write = NULL;
+	param->vmem->readv = NULL;
+	param->vmem->writev = NULL;
+	param->vmem->map = NULL;
 	
 	strlcpy(param->name, name, 36);
 	if (unit) {
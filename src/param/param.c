@@ -1,6 +1,8 @@
 #include <string.h>
 #include <param/param.h>
 #include <libparam.h>
+#include <param/param_trace.h>
+#include <vmem/vmem.h>
 
 #include <csp/csp.h>
 #include <sys/types.h>
@@ -10,16 +12,24 @@
 		if (i > (unsigned int) param->array_size) { \
 			return 0; \
 		} \
-		if (param->vmem && param->vmem->read) { \
-			_type data = 0; \
+		PARAM_TRACE_BEGIN(trace_start); \
+		_type data = 0; \
+		const void * ptr = (param->vmem) ? vmem_map(param->vmem, param->vaddr + i * param->array_step, sizeof(data), VMEM_MAP_READ) : NULL; \
+		if (ptr) { \
+			memcpy(&data, ptr, sizeof(data)); \
+			if (param->vmem->big_endian == 1) { \
+				data = _swapfct(data); \
+			} \
+		} else if (param->vmem && param->vmem->read) { \
 			param->vmem->read(param->vmem, param->vaddr + i * param->array_step, &data, sizeof(data)); \
 			if (param->vmem->big_endian == 1) { \
 				data = _swapfct(data); \
 			} \
-			return data; \
 		} else { \
-			return *(_type *)(param->addr + i * param->array_step); \
+			data = *(_type *)(param->addr + i * param->array_step); \
 		} \
+		PARAM_TRACE_END(trace_start, PARAM_TRACE_GET, param->id, param->node, i); \
+		return data; \
 	} \
 	_type param_get_##_name(param_t * param) { \
 		return param_get_##_name##_array(param, 0); \
@@ -72,23 +82,110 @@ void param_get(param_t * param, unsigned int offset, void * value) {
 
 void param_get_data(param_t * param, void * outbuf, int len)
 {
-	if (param->vmem && param->vmem->read) {
+	PARAM_TRACE_BEGIN(trace_start);
+	const void * ptr = (param->vmem) ? vmem_map(param->vmem, param->vaddr, len, VMEM_MAP_READ) : NULL;
+	if (ptr) {
+		memcpy(outbuf, ptr, len);
+	} else if (param->vmem && param->vmem->read) {
 		param->vmem->read(param->vmem, param->vaddr, outbuf, len);
 	} else {
 		memcpy(outbuf, param->addr, len);
 	}
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_GET_DATA, param->id, param->node, len);
+}
+
+#define PARAM_GET_ARRAY_IOV 16
+
+void param_get_array(param_t * param, unsigned int offset, unsigned int count, void * values) {
+
+	if (param->type == PARAM_TYPE_STRING || param->type == PARAM_TYPE_DATA)
+		return;
+	int size = param_typesize(param->type);
+	if (size <= 0)
+		return;
+
+	unsigned int elements = (param->array_size > 0) ? param->array_size : 1;
+	if (offset >= elements)
+		return;
+	if (count > elements - offset)
+		count = elements - offset;
+
+	PARAM_TRACE_BEGIN(trace_start);
+
+	uint8_t * out = values;
+	const uint8_t * src = NULL;
+	if (param->vmem) {
+		src = vmem_map(param->vmem, param->vaddr + offset * param->array_step, (count - 1) * param->array_step + size, VMEM_MAP_READ);
+	}
+	if (src == NULL && (param->vmem == NULL || param->vmem->read == NULL)) {
+		src = (const uint8_t *) param->addr + offset * param->array_step;
+	}
+
+	if (src && param->array_step == size) {
+		memcpy(out, src, count * size);
+	} else if (src) {
+		for (unsigned int i = 0; i < count; i++)
+			memcpy(out + i * size, src + i * param->array_step, size);
+	} else {
+
+		/* Gather the elements, the driver may merge them when array_step equals the size */
+		vmem_iovec_t iov[PARAM_GET_ARRAY_IOV];
+		for (unsigned int done = 0; done < count; ) {
+			int n = 0;
+			while (n < PARAM_GET_ARRAY_IOV && done + n < count) {
+				iov[n].addr = param->vaddr + (offset + done + n) * param->array_step;
+				iov[n].buf = out + (done + n) * size;
+				iov[n].len = size;
+				n++;
+			}
+			vmem_readv(param->vmem, iov, n);
+			done += n;
+		}
+	}
+
+	/* Like PARAM_GET, floating point values are never swapped */
+	if (param->vmem && param->vmem->big_endian == 1 && param->type != PARAM_TYPE_FLOAT && param->type != PARAM_TYPE_DOUBLE) {
+		for (unsigned int i = 0; i < count; i++) {
+			switch (size) {
+			case 2: *(uint16_t *) &out[i * size] = be16toh(*(uint16_t *) &out[i * size]); break;
+			case 4: *(uint32_t *) &out[i * size] = be32toh(*(uint32_t *) &out[i * size]); break;
+			case 8: *(uint64_t *) &out[i * size] = be64toh(*(uint64_t *) &out[i * size]); break;
+			}
+		}
+	}
+
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_GET, param->id, param->node, offset);
 }
 
 #ifndef PARAM_LOG
 #define param_log(...)
 #endif
 
+uint32_t param_change_seq = 0;
+
+void param_touch(param_t * param) {
+	/* Every write advances the sequence, also for params without a version slot */
+	uint32_t seq = __atomic_add_fetch(&param_change_seq, 1, __ATOMIC_RELAXED);
+	/* Zero is reserved for "never changed" */
+	if (seq == 0)
+		seq = __atomic_add_fetch(&param_change_seq, 1, __ATOMIC_RELAXED);
+	uint32_t * version = param_version(param);
+	if (version != NULL)
+		*version = seq;
+}
+
 #define PARAM_SET(_type, name_in, _swapfct) \
 	void __param_set_##name_in(param_t * param, _type value, bool do_callback, unsigned int i) { \
 		if (i > (unsigned int) param->array_size) { \
 			return; \
 		} \
-		if (param->vmem && param->vmem->write) { \
+		PARAM_TRACE_BEGIN(trace_start); \
+		void * ptr = (param->vmem) ? vmem_map(param->vmem, param->vaddr + i * param->array_step, sizeof(_type), VMEM_MAP_WRITE) : NULL; \
+		if (ptr) { \
+			if (param->vmem->big_endian == 1) \
+				value = _swapfct(value); \
+			memcpy(ptr, &value, sizeof(_type)); \
+		} else if (param->vmem && param->vmem->write) { \
 			if (param->vmem->big_endian == 1) \
 				value = _swapfct(value); \
 			param->vmem->write(param->vmem, param->vaddr + i * param->array_step, &value, sizeof(_type)); \
@@ -96,6 +193,8 @@ void param_get_data(param_t * param, void * outbuf, int len)
 			/* Aligned access directly to RAM */ \
 			*(_type*)(param->addr + i * param->array_step) = value; \
 		} \
+		param_touch(param); \
+		PARAM_TRACE_END(trace_start, PARAM_TRACE_SET, param->id, param->node, i); \
 		/* Callback */ \
 		if ((do_callback == true) && (param->callback)) { \
 			param->callback(param, i); \
@@ -167,7 +266,10 @@ void param_set(param_t * param, unsigned int offset, void * value) {
 void param_set_string(param_t * param, const char * inbuf, int len) {
 	param_set_data_nocallback(param, inbuf, len);
 	/* Termination */
-	if (param->vmem && param->vmem->write) {
+	void * ptr = (param->vmem) ? vmem_map(param->vmem, param->vaddr + len, 1, VMEM_MAP_WRITE) : NULL;
+	if (ptr) {
+		memcpy(ptr, "", 1);
+	} else if (param->vmem && param->vmem->write) {
 		param->vmem->write(param->vmem, param->vaddr + len, "", 1);
 	} else {
 		memcpy(param->addr + len , "", 1);
@@ -179,11 +281,17 @@ void param_set_string(param_t * param, const char * inbuf, int len) {
 }
 
 void param_set_data_nocallback(param_t * param, const void * inbuf, int len) {
-	if (param->vmem && param->vmem->write) {
+	PARAM_TRACE_BEGIN(trace_start);
+	void * ptr = (param->vmem) ? vmem_map(param->vmem, param->vaddr, len, VMEM_MAP_WRITE) : NULL;
+	if (ptr) {
+		memcpy(ptr, inbuf, len);
+	} else if (param->vmem && param->vmem->write) {
 		param->vmem->write(param->vmem, param->vaddr, inbuf, len);
 	} else {
 		memcpy(param->addr, inbuf, len);
 	}
+	param_touch(param);
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_SET_DATA, param->id, param->node, len);
 }
 
 void param_set_data(param_t * param, const void * inbuf, int len) {
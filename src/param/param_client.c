@@ -18,10 +18,12 @@
 #include <param/param_list.h>
 #include <param/param_server.h>
 #include <param/param_queue.h>
+#include <param/param_trace.h>
+#include <param/param_latency.h>
 
 typedef void (*param_transaction_callback_f)(csp_packet_t *response, int verbose, int version, void * context);
 
-static void param_transaction_callback_pull(csp_packet_t *response, int verbose, int version, void * context) {
+static void param_transaction_apply(csp_packet_t *response, int header, int verbose, int version) {
 
 	int from = response->id.src;
 	//csp_hex_dump("pull response", response->data, response->length);
@@ -30,7 +32,7 @@ static void param_transaction_callback_pull(csp_packet_t *response, int verbose,
 	param_queue_t queue;
 	csp_timestamp_t time_now;
 	csp_clock_get_time(&time_now);
-	param_queue_init(&queue, &response->data[2], response->length - 2, response->length - 2, PARAM_QUEUE_TYPE_SET, version);
+	param_queue_init(&queue, &response->data[header], response->length - header, response->length - header, PARAM_QUEUE_TYPE_SET, version);
 	queue.last_node = response->id.src;
 	queue.client_timestamp = time_now.tv_sec;
 	queue.last_timestamp = queue.client_timestamp;
@@ -63,10 +65,29 @@ static void param_transaction_callback_pull(csp_packet_t *response, int verbose,
 
 	}
 
+}
+
+static void param_transaction_callback_pull(csp_packet_t *response, int verbose, int version, void * context) {
+	/* Optional response byte counter */
+	if (context)
+		*(uint32_t *) context += response->length;
+	param_transaction_apply(response, 2, verbose, version);
 	csp_buffer_free(response);
 }
 
-int param_transaction(csp_packet_t *packet, int host, int timeout, param_transaction_callback_f callback, int verbose, int version, void * context) {
+static void param_transaction_callback_pull_since(csp_packet_t *response, int verbose, int version, void * context) {
+
+	if ((response->data[0] != PARAM_PULL_SINCE_RESPONSE) || (response->length < 8)) {
+		csp_buffer_free(response);
+		return;
+	}
+
+	*(uint32_t *) context = be32toh(response->data32[1]);
+	param_transaction_apply(response, 8, verbose, version);
+	csp_buffer_free(response);
+}
+
+static int __param_transaction(csp_packet_t *packet, int host, int timeout, param_transaction_callback_f callback, int verbose, int version, void * context) {
 
 	//csp_hex_dump("transaction", packet->data, packet->length);
 
@@ -77,13 +98,27 @@ int param_transaction(csp_packet_t *packet, int host, int timeout, param_transac
 		return -1;
 	}
 
+#if PARAM_LATENCY_HOSTS > 0
+	uint32_t time_start = csp_get_ms();
+#endif
+
 	csp_conn_t * conn = csp_connect(packet->id.pri, host, PARAM_PORT_SERVER, 0, CSP_O_CRC32);
 	if (conn == NULL) {
 		printf("param transaction failure\n");
 		csp_buffer_free(packet);
+#if PARAM_LATENCY_HOSTS > 0
+		param_latency_record(host, -1, -1, -1);
+#endif
 		return -1;
 	}
 
+#if PARAM_LATENCY_HOSTS > 0
+	uint32_t time_sent = csp_get_ms();
+	int latency_connect = time_sent - time_start;
+	int latency_first = -1;
+	int latency_end = -1;
+#endif
+
 	csp_send(conn, packet);
 
 	if (timeout == -1) {
@@ -95,7 +130,14 @@ int param_transaction(csp_packet_t *packet, int host, int timeout, param_transac
 	int result = -1;
 	while((packet = csp_read(conn, timeout)) != NULL) {
 
-		int end = (packet->data[1] == PARAM_FLAG_END);
+		int end = (packet->data[1] & PARAM_FLAG_END) != 0;
+
+#if PARAM_LATENCY_HOSTS > 0
+		if (latency_first < 0)
+			latency_first = csp_get_ms() - time_sent;
+		if (end)
+			latency_end = csp_get_ms() - time_sent;
+#endif
 
 		//csp_hex_dump("response", packet->data, packet->length);
 
@@ -112,12 +154,26 @@ int param_transaction(csp_packet_t *packet, int host, int timeout, param_transac
 
 	}
 
+#if PARAM_LATENCY_HOSTS > 0
+	param_latency_record(host, latency_connect, latency_first, latency_end);
+#endif
+
 	//printf("Successful param transaction, result: %d\n", result);
 	csp_close(conn);
 	return result;
 }
 
-int param_pull_all(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, int timeout, int version) {
+int param_transaction(csp_packet_t *packet, int host, int timeout, param_transaction_callback_f callback, int verbose, int version, void * context) {
+	PARAM_TRACE_BEGIN(trace_start);
+#if PARAM_TRACE > 0
+	uint16_t length = packet->length;
+#endif
+	int result = __param_transaction(packet, host, timeout, callback, verbose, version, context);
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_TRANSACTION, 0, host, length);
+	return result;
+}
+
+int param_pull_all_bytes(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, int timeout, int version, uint32_t * bytes) {
 
 	csp_packet_t *packet = csp_buffer_get(PARAM_SERVER_MTU);
 	if (packet == NULL)
@@ -132,7 +188,48 @@ int param_pull_all(uint8_t prio, int verbose, int host, uint32_t include_mask, u
 	packet->data32[2] = htobe32(exclude_mask);
 	packet->length = 12;
 	packet->id.pri = prio;
-	return param_transaction(packet, host, timeout, param_transaction_callback_pull, verbose, version, NULL);
+	if (bytes)
+		*bytes = packet->length;
+	return param_transaction(packet, host, timeout, param_transaction_callback_pull, verbose, version, bytes);
+
+}
+
+int param_pull_all(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, int timeout, int version) {
+	return param_pull_all_bytes(prio, verbose, host, include_mask, exclude_mask, timeout, version, NULL);
+}
+
+static int param_pull_all_since_request(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, uint32_t since, uint32_t * seq, int timeout) {
+
+	csp_packet_t *packet = csp_buffer_get(PARAM_SERVER_MTU);
+	if (packet == NULL)
+		return -2;
+	packet->data[0] = PARAM_PULL_ALL_SINCE_REQUEST;
+	packet->data[1] = 0;
+	packet->data32[1] = htobe32(include_mask);
+	packet->data32[2] = htobe32(exclude_mask);
+	packet->data32[3] = htobe32(since);
+	packet->length = 16;
+	packet->id.pri = prio;
+	return param_transaction(packet, host, timeout, param_transaction_callback_pull_since, verbose, 2, seq);
+
+}
+
+int param_pull_all_since(uint8_t prio, int verbose, int host, uint32_t include_mask, uint32_t exclude_mask, uint32_t * since, int timeout) {
+
+	uint32_t seq = *since;
+	int result = param_pull_all_since_request(prio, verbose, host, include_mask, exclude_mask, *since, &seq, timeout);
+	if (result != 0)
+		return result;
+
+	/* Server sequence went backwards, it has rebooted: everything must be pulled again */
+	if ((*since != 0) && ((int32_t) (seq - *since) < 0)) {
+		result = param_pull_all_since_request(prio, verbose, host, include_mask, exclude_mask, 0, &seq, timeout);
+		if (result != 0)
+			return result;
+	}
+
+	*since = seq;
+	return 0;
 
 }
 
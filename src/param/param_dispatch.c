@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <csp/csp.h>
+#include <csp/arch/csp_queue.h>
+#include <sys/types.h>
+
+#include <param/param.h>
+#include <param/param_queue.h>
+#include <param/param_server.h>
+#include <param/param_list.h>
+
+/* One queue per CSP priority, served highest priority first */
+#define PARAM_DISPATCH_PRIOS 4
+
+static csp_static_queue_t param_dispatch_queue_static[PARAM_DISPATCH_PRIOS];
+static char param_dispatch_queue_buf[PARAM_DISPATCH_PRIOS][PARAM_DISPATCH_QUEUE_LENGTH * sizeof(csp_packet_t *)];
+static csp_queue_handle_t param_dispatch_queue[PARAM_DISPATCH_PRIOS];
+
+/* The doorbell holds one token per queued packet, so idle workers block on a single queue */
+static csp_static_queue_t param_dispatch_doorbell_static;
+static char param_dispatch_doorbell_buf[PARAM_DISPATCH_PRIOS * PARAM_DISPATCH_QUEUE_LENGTH];
+static csp_queue_handle_t param_dispatch_doorbell;
+
+uint32_t param_dispatch_dropped = 0;
+
+void param_serve_dispatch_init(void) {
+	for (int i = 0; i < PARAM_DISPATCH_PRIOS; i++) {
+		param_dispatch_queue[i] = csp_queue_create_static(PARAM_DISPATCH_QUEUE_LENGTH, sizeof(csp_packet_t *), param_dispatch_queue_buf[i], &param_dispatch_queue_static[i]);
+	}
+	param_dispatch_doorbell = csp_queue_create_static(PARAM_DISPATCH_PRIOS * PARAM_DISPATCH_QUEUE_LENGTH, sizeof(uint8_t), param_dispatch_doorbell_buf, &param_dispatch_doorbell_static);
+}
+
+/**
+ * A pull request for RAM only parameters is cheaper to answer than to queue.
+ * Anything touching VMEM, the full list or other subsystems goes to the workers.
+ */
+static int param_dispatch_is_ram_pull(csp_packet_t * packet) {
+
+	int version;
+	switch(packet->data[0]) {
+		case PARAM_PULL_REQUEST: version = 1; break;
+		case PARAM_PULL_REQUEST_V2: version = 2; break;
+		default: return 0;
+	}
+
+	/* Ack with pull requests must be handled as pushes */
+	if (packet->data[1] == 1)
+		return 0;
+
+	param_queue_t queue;
+	param_queue_init(&queue, &packet->data[2], packet->length - 2, packet->length - 2, PARAM_QUEUE_TYPE_GET, version);
+
+	mpack_reader_t reader;
+	mpack_reader_init_data(&reader, queue.buffer, queue.used);
+	while(reader.data < reader.end) {
+		int id, node, offset = -1;
+		long unsigned int timestamp = 0;
+		param_deserialize_id(&reader, &id, &node, &timestamp, &offset, &queue);
+		if (mpack_reader_error(&reader) != mpack_ok)
+			return 0;
+		if (packet->id.dst == node)
+			node = 0;
+		param_t * param = param_list_find_id(node, id);
+		if (param && param->vmem)
+			return 0;
+	}
+
+	return 1;
+}
+
+void param_serve_dispatch(csp_packet_t * packet) {
+
+	if (param_dispatch_is_ram_pull(packet)) {
+		param_serve(packet);
+		return;
+	}
+
+	int prio = packet->id.pri;
+	if (prio >= PARAM_DISPATCH_PRIOS)
+		prio = PARAM_DISPATCH_PRIOS - 1;
+
+	if (csp_queue_enqueue(param_dispatch_queue[prio], &packet, 0) != CSP_QUEUE_OK) {
+		param_dispatch_dropped++;
+		csp_buffer_free(packet);
+		return;
+	}
+
+	uint8_t token = prio;
+	csp_queue_enqueue(param_dispatch_doorbell, &token, 0);
+}
+
+void param_serve_worker_loop(void * param) {
+
+	while(1) {
+
+		uint8_t token;
+		if (csp_queue_dequeue(param_dispatch_doorbell, &token, CSP_MAX_DELAY) != CSP_QUEUE_OK)
+			continue;
+
+		/* Take the most urgent packet, not necessarily the one that rang */
+		for (int prio = 0; prio < PARAM_DISPATCH_PRIOS; prio++) {
+			csp_packet_t * packet;
+			if (csp_queue_dequeue(param_dispatch_queue[prio], &packet, 0) == CSP_QUEUE_OK) {
+				param_serve(packet);
+				break;
+			}
+		}
+
+	}
+
+}
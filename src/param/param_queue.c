@@ -10,12 +10,21 @@
 
 #include <csp/csp.h>
 #include <mpack/mpack.h>
+#include <libparam.h>
 
 #include <param/param.h>
 #include <param/param_server.h>
 #include <param/param_queue.h>
 #include <param/param_list.h>
 #include <param/param_string.h>
+#include <param/param_stats.h>
+#include <param/param_trace.h>
+#if PARAM_HISTORY > 0
+#include <param/param_history.h>
+#endif
+#ifdef PARAM_HAVE_ARCHIVE
+#include <param/param_archive.h>
+#endif
 
 #include "param_serializer.h"
 
@@ -77,6 +86,7 @@ int param_queue_add(param_queue_t *queue, param_t *param, int offset, void *valu
 int param_queue_apply(param_queue_t *queue, int apply_local, int from) {
 	int return_code = 0;
 	int atomic_write = 0;
+	PARAM_TRACE_BEGIN(trace_start);
 
 	mpack_reader_t reader;
 	mpack_reader_init_data(&reader, queue->buffer, queue->used);
@@ -116,9 +126,17 @@ int param_queue_apply(param_queue_t *queue, int apply_local, int from) {
 			}
 
 			param_deserialize_from_mpack_to_param(NULL, queue, param, offset, &reader);
+			param_stats_add(PARAM_STATS_APPLIED, 1);
+#if PARAM_HISTORY > 0
+			param_history_record(param, timestamp);
+#endif
+#ifdef PARAM_HAVE_ARCHIVE
+			param_archive_record(param, timestamp);
+#endif
 		} else {
 			// We couldn't find all parameters. Skip this one.
 			return_code = -1;
+			param_stats_add(PARAM_STATS_UNKNOWN, 1);
 
 			mpack_tag_t tag = mpack_read_tag(&reader);
 			if (mpack_reader_error(&reader) != mpack_ok) {
@@ -172,6 +190,7 @@ int param_queue_apply(param_queue_t *queue, int apply_local, int from) {
 			param_exit_critical();
 	}
 
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_APPLY, 0, from, queue->used);
 	return return_code;
 }
 
@@ -12,6 +12,7 @@
 #include <param/param.h>
 #include <param/param_server.h>
 #include "param_serializer.h"
+#include <vmem/vmem.h>
 
 #include <csp/arch/csp_time.h>
 #include <sys/types.h>
@@ -20,6 +21,9 @@
 
 #include <mpack/mpack.h>
 
+/* Size of the array prefetch buffer, in 64 bit words */
+#define PARAM_SERIALIZE_CHUNK 16
+
 static inline uint16_t param_get_short_id(param_t * param, unsigned int isarray, unsigned int reserved) {
 	uint16_t node = param->node;
 	return (node << 11) | ((isarray & 0x1) << 10) | ((reserved & 0x1) << 2) | ((param->id) & 0x1FF);
@@ -189,80 +193,108 @@ int param_serialize_to_mpack(param_t * param, int offset, mpack_writer_t * write
 		mpack_start_array(writer, count);
 	}
 
+	/* Whole arrays are encoded in place when mapped in process memory and aligned,
+	 * otherwise fetched a chunk at a time, instead of one VMEM call per element */
+	uint64_t chunk[PARAM_SERIALIZE_CHUNK];
+	int chunk_start = offset, chunk_count = 0;
+	int size = param_typesize(param->type);
+	const uint8_t * mapped = NULL;
+	if (value == NULL && count > 1 && size > 0) {
+		if (param->vmem == NULL) {
+			mapped = (const uint8_t *) param->addr + offset * param->array_step;
+		} else if (param->vmem->big_endian != 1) {
+			mapped = vmem_map(param->vmem, param->vaddr + offset * param->array_step, (count - 1) * param->array_step + size, VMEM_MAP_READ);
+		}
+		if (((uintptr_t) mapped | param->array_step) % size != 0)
+			mapped = NULL;
+	}
+
 	for(int i = offset; i < offset + count; i++) {
 
+		void * elem = value;
+		if (mapped) {
+			elem = (void *) (mapped + (i - offset) * param->array_step);
+		} else if (value == NULL && count > 1 && size > 0) {
+			if (i >= chunk_start + chunk_count) {
+				chunk_start = i;
+				chunk_count = VMEM_MIN(offset + count - i, PARAM_SERIALIZE_CHUNK * (int) sizeof(uint64_t) / size);
+				param_get_array(param, i, chunk_count, chunk);
+			}
+			elem = (uint8_t *) chunk + (i - chunk_start) * size;
+		}
+
 		switch (param->type) {
 		case PARAM_TYPE_UINT8:
 		case PARAM_TYPE_XINT8:
-			if (value) {
-				mpack_write_uint(writer, *(uint8_t *) value);
+			if (elem) {
+				mpack_write_uint(writer, *(uint8_t *) elem);
 			} else {
 				mpack_write_uint(writer, param_get_uint8_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_UINT16:
 		case PARAM_TYPE_XINT16:
-			if (value) {
-				mpack_write_uint(writer, *(uint16_t *) value);
+			if (elem) {
+				mpack_write_uint(writer, *(uint16_t *) elem);
 			} else {
 				mpack_write_uint(writer, param_get_uint16_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_UINT32:
 		case PARAM_TYPE_XINT32:
-			if (value) {
-				mpack_write_uint(writer, *(uint32_t *) value);
+			if (elem) {
+				mpack_write_uint(writer, *(uint32_t *) elem);
 			} else {
 				mpack_write_uint(writer, param_get_uint32_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_UINT64:
 		case PARAM_TYPE_XINT64:
-			if (value) {
-				mpack_write_uint(writer, *(uint64_t *) value);
+			if (elem) {
+				mpack_write_uint(writer, *(uint64_t *) elem);
 			} else {
 				mpack_write_uint(writer, param_get_uint64_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_INT8:
-			if (value) {
-				mpack_write_int(writer, *(int8_t *) value);
+			if (elem) {
+				mpack_write_int(writer, *(int8_t *) elem);
 			} else {
 				mpack_write_int(writer, param_get_int8_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_INT16:
-			if (value) {
-				mpack_write_int(writer, *(int16_t *) value);
+			if (elem) {
+				mpack_write_int(writer, *(int16_t *) elem);
 			} else {
 				mpack_write_int(writer, param_get_int16_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_INT32:
-			if (value) {
-				mpack_write_int(writer, *(int32_t *) value);
+			if (elem) {
+				mpack_write_int(writer, *(int32_t *) elem);
 			} else {
 				mpack_write_int(writer, param_get_int32_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_INT64:
-			if (value) {
-				mpack_write_int(writer, *(int64_t *) value);
+			if (elem) {
+				mpack_write_int(writer, *(int64_t *) elem);
 			} else {
 				mpack_write_int(writer, param_get_int64_array(param, i));
 			}
 			break;
 #if MPACK_FLOAT
 		case PARAM_TYPE_FLOAT:
-			if (value) {
-				mpack_write_float(writer, *(float *) value);
+			if (elem) {
+				mpack_write_float(writer, *(float *) elem);
 			} else {
 				mpack_write_float(writer, param_get_float_array(param, i));
 			}
 			break;
 		case PARAM_TYPE_DOUBLE:
-			if (value) {
-				mpack_write_double(writer, *(double *) value);
+			if (elem) {
+				mpack_write_double(writer, *(double *) elem);
 			} else {
 				mpack_write_double(writer, param_get_double_array(param, i));
 			}
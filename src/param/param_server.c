@@ -13,32 +13,71 @@
 #include <param/param.h>
 #include <param/param_queue.h>
 #include <param/param_server.h>
+#include <param/param_stats.h>
 #include <param/param_list.h>
 #include <param/param_scheduler.h>
 #include <param/param_commands.h>
+#if PARAM_PULL_CACHE > 0
+#include "param_server_cache.h"
+#endif
+#if PARAM_COALESCE > 0
+#include "param_server_coalesce.h"
+#endif
+#ifdef PARAM_HAVE_SUBSCRIBE
+#include <param/param_subscribe.h>
+#endif
+#ifdef PARAM_HAVE_HK
+#include <param/param_hk.h>
+#endif
 
 struct param_serve_context {
 	csp_packet_t * request;
 	csp_packet_t * response;
 	param_queue_t q_response;
+	int since;		/* Respond with PARAM_PULL_SINCE_RESPONSE */
+	uint32_t seq;		/* Change sequence at start of request */
+	uint32_t since_seq;	/* Only params changed after this, 0 = all */
+#if PARAM_PULL_CACHE > 0
+	param_server_cache_entry_t * cache;
+#endif
+#if PARAM_COALESCE > 0
+	param_server_coalesce_entry_t * coalesce;
+#endif
 };
 
+static int __header(struct param_serve_context *ctx) {
+	return (ctx->since) ? 8 : 2;
+}
+
 static int __allocate(struct param_serve_context *ctx) {
 	ctx->response = csp_buffer_get(PARAM_SERVER_MTU);
-	if (ctx->response == NULL)
+	if (ctx->response == NULL) {
+		param_stats_add(PARAM_STATS_NOBUF, 1);
 		return -1;
-	param_queue_init(&ctx->q_response, &ctx->response->data[2], PARAM_SERVER_MTU, 0, PARAM_QUEUE_TYPE_SET, ctx->q_response.version);
+	}
+	param_queue_init(&ctx->q_response, &ctx->response->data[__header(ctx)], PARAM_SERVER_MTU - __header(ctx), 0, PARAM_QUEUE_TYPE_SET, ctx->q_response.version);
 	return 0;
 }
 
 static void __send(struct param_serve_context *ctx, int end) {
-	if (ctx->q_response.version == 1) {
+	if (ctx->since) {
+		ctx->response->data[0] = PARAM_PULL_SINCE_RESPONSE;
+		ctx->response->data16[1] = 0;
+		ctx->response->data32[1] = htobe32(ctx->seq);
+	} else if (ctx->q_response.version == 1) {
 		ctx->response->data[0] = PARAM_PULL_RESPONSE;
 	} else {
 		ctx->response->data[0] = PARAM_PULL_RESPONSE_V2;
 	}
 	ctx->response->data[1] = (end) ? PARAM_FLAG_END : 0;
-	ctx->response->length = ctx->q_response.used + 2;
+	ctx->response->length = ctx->q_response.used + __header(ctx);
+#if PARAM_PULL_CACHE > 0
+	param_server_cache_record(ctx->cache, ctx->response);
+#endif
+#if PARAM_COALESCE > 0
+	param_server_coalesce_send(ctx->coalesce, ctx->response);
+#endif
+	param_stats_add(PARAM_STATS_BYTES_OUT, ctx->response->length);
 	csp_sendto_reply(ctx->request, ctx->response, CSP_O_SAME);
 }
 
@@ -60,15 +99,75 @@ static int __add(struct param_serve_context *ctx, param_t * param, int offset) {
 	return  0;
 }
 
-static void param_serve_pull_request(csp_packet_t * request, int all, int version) {
+static void param_serve_request(csp_packet_t * packet);
+
+/* Release cache and coalescing entries of the request */
+static void __finish(struct param_serve_context *ctx, int complete) {
+#if PARAM_PULL_CACHE > 0
+	param_server_cache_end(ctx->cache, complete);
+#endif
+#if PARAM_COALESCE > 0
+	/* Waiters were counted on arrival, serve them without counting them again */
+	csp_packet_t * live[PARAM_SERVER_COALESCE_WAITERS];
+	int live_count = param_server_coalesce_end(ctx->coalesce, complete, live);
+	for (int i = 0; i < live_count; i++) {
+		param_serve_request(live[i]);
+	}
+#endif
+}
+
+static int __add_all(param_t * param, void * context) {
+
+	struct param_serve_context *ctx = context;
+
+	/* Unchanged since the requested sequence, untracked params are always sent */
+	if (ctx->since_seq) {
+		uint32_t * version = param_version(param);
+		if (version && (int32_t) (*version - ctx->since_seq) <= 0)
+			return 0;
+	}
+
+	return __add(ctx, param, -1);
+}
+
+static void param_serve_pull_request(csp_packet_t * request, int all, int version, int since) {
 
 	struct param_serve_context ctx;
 	ctx.request = request;
 	ctx.q_response.version = version;
+	ctx.since = since;
+	ctx.seq = __atomic_load_n(&param_change_seq, __ATOMIC_RELAXED);
+	ctx.since_seq = 0;
+	if (since && request->length >= 16) {
+		ctx.since_seq = be32toh(request->data32[3]);
+	}
 	/* If packet->data[1] == 1 ack with pull response */
 	int ack_with_pull = request->data[1] == 1 ? 1 : 0;
 
+#if PARAM_PULL_CACHE > 0
+	ctx.cache = NULL;
+	uint32_t cache_include_mask = be32toh(request->data32[1]);
+	uint32_t cache_exclude_mask = (version >= 2) ? be32toh(request->data32[2]) : 0;
+	if (all && !since) {
+		if (param_server_cache_replay(request, cache_include_mask, cache_exclude_mask, version, ctx.seq) == 0)
+			return;
+	}
+#endif
+
+#if PARAM_COALESCE > 0
+	/* Identical request in progress, the leader answers for us */
+	if (param_server_coalesce_begin(request, &ctx.coalesce) == 0)
+		return;
+#endif
+
+#if PARAM_PULL_CACHE > 0
+	if (all && !since) {
+		ctx.cache = param_server_cache_begin(cache_include_mask, cache_exclude_mask, version, ctx.seq);
+	}
+#endif
+
 	if (__allocate(&ctx) < 0) {
+		__finish(&ctx, 0);
 		csp_buffer_free(request);
 		return;
 	}
@@ -130,6 +229,7 @@ static void param_serve_pull_request(csp_packet_t * request, int all, int versio
 					offset = -1;
 				} 
 				if (__add(&ctx, param, offset) < 0) {
+					__finish(&ctx, 0);
 					csp_buffer_free(request);
 					return;
 				}
@@ -138,32 +238,22 @@ static void param_serve_pull_request(csp_packet_t * request, int all, int versio
 
 	} else {
 
-		/* Loop the full parameter list */
-		param_t * param;
-		param_list_iterator i = {};
-		while ((param = param_list_iterate(&i)) != NULL) {
-			uint32_t include_mask = be32toh(ctx.request->data32[1]);
-			uint32_t exclude_mask = 0x00000000;
-			if (version >= 2) {
-			    exclude_mask = be32toh(ctx.request->data32[2]);
-			}
-
-			/* If none of the include matches, continue */
-			if ((param->mask & include_mask) == 0)
-				continue;
+		/* Loop the parameters matching the masks */
+		uint32_t include_mask = be32toh(ctx.request->data32[1]);
+		uint32_t exclude_mask = 0x00000000;
+		if (version >= 2) {
+			exclude_mask = be32toh(ctx.request->data32[2]);
+		}
 
-			/* In any one of the exclude matches, continue */
-			if ((param->mask & exclude_mask) != 0)
-				continue;
-			
-			if (__add(&ctx, param, -1) < 0) {
-				csp_buffer_free(request);
-				return;
-			}
+		if (param_list_foreach_mask(include_mask, exclude_mask, __add_all, &ctx) < 0) {
+			__finish(&ctx, 0);
+			csp_buffer_free(request);
+			return;
 		}
 	}
 
 	__send(&ctx, 1);
+	__finish(&ctx, 1);
 
 	csp_buffer_free(request);
 
@@ -193,31 +283,36 @@ static void param_serve_push(csp_packet_t * packet, int send_ack, int version, i
 
 	/* If packet->data[1] == 1 ack with pull request */
 	if (packet->data[1] == 1) {
-		param_serve_pull_request(packet, 0, 2);
+		param_serve_pull_request(packet, 0, 2, 0);
 	} else {
 		/* Send ack */
 		packet->data[0] = PARAM_PUSH_RESPONSE;
 		packet->data[1] = PARAM_FLAG_END;
 		packet->length = 2;
+		param_stats_add(PARAM_STATS_BYTES_OUT, packet->length);
 		csp_sendto_reply(packet, packet, CSP_O_SAME);
 	}
 }
 
 
-void param_serve(csp_packet_t * packet) {
+static void param_serve_request(csp_packet_t * packet) {
+
 	switch(packet->data[0]) {
 		case PARAM_PULL_REQUEST:
-			param_serve_pull_request(packet, 0, 1);
+			param_serve_pull_request(packet, 0, 1, 0);
 			break;
 		case PARAM_PULL_REQUEST_V2:
-		    param_serve_pull_request(packet, 0, 2);
+		    param_serve_pull_request(packet, 0, 2, 0);
 		    break;
 
 		case PARAM_PULL_ALL_REQUEST:
-			param_serve_pull_request(packet, 1, 1);
+			param_serve_pull_request(packet, 1, 1, 0);
 			break;
 		case PARAM_PULL_ALL_REQUEST_V2:
-			param_serve_pull_request(packet, 1, 2);
+			param_serve_pull_request(packet, 1, 2, 0);
+			break;
+		case PARAM_PULL_ALL_SINCE_REQUEST:
+			param_serve_pull_request(packet, 1, 2, 1);
 			break;
 
 		case PARAM_PULL_RESPONSE:
@@ -316,6 +411,22 @@ void param_serve(csp_packet_t * packet) {
 			param_serve_command_rm_all(packet);
 			break;
 		
+#endif
+
+#ifdef PARAM_HAVE_SUBSCRIBE
+
+		case PARAM_SUBSCRIBE_REQUEST:
+			param_serve_subscribe(packet);
+			break;
+
+#endif
+
+#ifdef PARAM_HAVE_HK
+
+		case PARAM_HK_REQUEST:
+			param_serve_hk(packet);
+			break;
+
 #endif
 
 		default:
@@ -324,6 +435,16 @@ void param_serve(csp_packet_t * packet) {
 			break;
 	}
 
+}
+
+void param_serve(csp_packet_t * packet) {
+
+	uint32_t start = param_stats_start();
+	param_stats_request(packet->data[0], packet->length);
+
+	param_serve_request(packet);
+
+	param_stats_time(start);
 
 }
 
@@ -0,0 +1,149 @@
+#include "param_server_cache.h"
+
+#include <string.h>
+#include <csp/csp.h>
+#include <csp/arch/csp_time.h>
+
+#include <param/param.h>
+#include <param/param_server.h>
+#include <param/param_stats.h>
+
+struct param_server_cache_entry_s {
+	uint32_t include_mask;
+	uint32_t exclude_mask;
+	uint32_t seq;
+	uint32_t created;
+	uint8_t version;
+	uint8_t valid;
+	uint8_t overflow;
+	uint8_t busy;		/* Atomic try-lock, a busy entry is simply bypassed */
+	uint16_t used;
+	uint16_t packets;
+	uint8_t data[PARAM_SERVER_CACHE_SIZE] __attribute__((aligned(4)));
+};
+
+static param_server_cache_entry_t param_server_cache[PARAM_PULL_CACHE];
+
+static int param_server_cache_trylock(param_server_cache_entry_t * entry) {
+	return __atomic_test_and_set(&entry->busy, __ATOMIC_ACQUIRE) ? -1 : 0;
+}
+
+static void param_server_cache_unlock(param_server_cache_entry_t * entry) {
+	__atomic_clear(&entry->busy, __ATOMIC_RELEASE);
+}
+
+static int param_server_cache_match(param_server_cache_entry_t * entry, uint32_t include_mask, uint32_t exclude_mask, int version) {
+	return entry->include_mask == include_mask && entry->exclude_mask == exclude_mask && entry->version == version;
+}
+
+int param_server_cache_replay(csp_packet_t * request, uint32_t include_mask, uint32_t exclude_mask, int version, uint32_t seq) {
+
+	uint32_t now = csp_get_ms();
+
+	for (int i = 0; i < PARAM_PULL_CACHE; i++) {
+		param_server_cache_entry_t * entry = &param_server_cache[i];
+
+		if (param_server_cache_trylock(entry) < 0)
+			continue;
+
+		if (!entry->valid || !param_server_cache_match(entry, include_mask, exclude_mask, version)
+				|| entry->seq != seq || now - entry->created >= PARAM_SERVER_CACHE_TTL) {
+			param_server_cache_unlock(entry);
+			continue;
+		}
+
+		/* Get every buffer first, a partial replay would leave the client without the END flag */
+		csp_packet_t * responses[entry->packets];
+		int allocated = 0;
+		while (allocated < entry->packets) {
+			responses[allocated] = csp_buffer_get(PARAM_SERVER_MTU);
+			if (responses[allocated] == NULL)
+				break;
+			allocated++;
+		}
+		if (allocated < entry->packets) {
+			param_stats_add(PARAM_STATS_NOBUF, 1);
+			while (allocated > 0)
+				csp_buffer_free(responses[--allocated]);
+			param_server_cache_unlock(entry);
+			return -1;
+		}
+
+		/* Replay recorded packets: [uint16 length][data] */
+		unsigned int pos = 0;
+		for (int j = 0; j < entry->packets; j++) {
+			uint16_t length;
+			memcpy(&length, &entry->data[pos], sizeof(length));
+			pos += sizeof(length);
+
+			csp_packet_t * response = responses[j];
+			memcpy(response->data, &entry->data[pos], length);
+			response->length = length;
+			param_stats_add(PARAM_STATS_BYTES_OUT, length);
+			csp_sendto_reply(request, response, CSP_O_SAME);
+			pos += length;
+		}
+
+		param_server_cache_unlock(entry);
+		csp_buffer_free(request);
+		return 0;
+	}
+
+	return -1;
+}
+
+param_server_cache_entry_t * param_server_cache_begin(uint32_t include_mask, uint32_t exclude_mask, int version, uint32_t seq) {
+
+	/* Prefer the entry with the same key, then an empty one, then the oldest */
+	param_server_cache_entry_t * victim = NULL;
+	for (int i = 0; i < PARAM_PULL_CACHE; i++) {
+		param_server_cache_entry_t * entry = &param_server_cache[i];
+		if (entry->valid && param_server_cache_match(entry, include_mask, exclude_mask, version)) {
+			victim = entry;
+			break;
+		}
+		if (victim == NULL || (victim->valid && (!entry->valid || (int32_t) (entry->created - victim->created) < 0)))
+			victim = entry;
+	}
+
+	if (param_server_cache_trylock(victim) < 0)
+		return NULL;
+
+	victim->valid = 0;
+	victim->overflow = 0;
+	victim->used = 0;
+	victim->packets = 0;
+	victim->include_mask = include_mask;
+	victim->exclude_mask = exclude_mask;
+	victim->version = version;
+	victim->seq = seq;
+	return victim;
+}
+
+void param_server_cache_record(param_server_cache_entry_t * entry, csp_packet_t * packet) {
+
+	if (entry == NULL || entry->overflow)
+		return;
+
+	uint16_t length = packet->length;
+	if (entry->used + sizeof(length) + length > PARAM_SERVER_CACHE_SIZE) {
+		entry->overflow = 1;
+		return;
+	}
+
+	memcpy(&entry->data[entry->used], &length, sizeof(length));
+	entry->used += sizeof(length);
+	memcpy(&entry->data[entry->used], packet->data, length);
+	entry->used += length;
+	entry->packets++;
+}
+
+void param_server_cache_end(param_server_cache_entry_t * entry, int complete) {
+
+	if (entry == NULL)
+		return;
+
+	entry->valid = complete && !entry->overflow;
+	entry->created = csp_get_ms();
+	param_server_cache_unlock(entry);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <csp/csp.h>
+
+/**
+ * Cache of serialized pull-all responses.
+ *
+ * The packets sent in response to a pull-all are recorded, and an identical request
+ * (same masks and version) arriving within PARAM_SERVER_CACHE_TTL ms, with no setter
+ * called in between, is answered by replaying them.
+ */
+
+#ifndef PARAM_SERVER_CACHE_TTL
+#define PARAM_SERVER_CACHE_TTL 200
+#endif
+
+#ifndef PARAM_SERVER_CACHE_SIZE
+#define PARAM_SERVER_CACHE_SIZE 2048
+#endif
+
+typedef struct param_server_cache_entry_s param_server_cache_entry_t;
+
+/**
+ * Answer request from cache
+ * @return 0 if the request was answered and freed, -1 on cache miss or when there are
+ *         not enough buffers for the whole response, the request must then be served live
+ */
+int param_server_cache_replay(csp_packet_t * request, uint32_t include_mask, uint32_t exclude_mask, int version, uint32_t seq);
+
+/**
+ * Start recording a response
+ * @return entry to pass to record/end, NULL if no entry is available
+ */
+param_server_cache_entry_t * param_server_cache_begin(uint32_t include_mask, uint32_t exclude_mask, int version, uint32_t seq);
+void param_server_cache_record(param_server_cache_entry_t * entry, csp_packet_t * packet);
+void param_server_cache_end(param_server_cache_entry_t * entry, int complete);
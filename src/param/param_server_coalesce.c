@@ -0,0 +1,190 @@
+#include "param_server_coalesce.h"
+
+#include <string.h>
+#include <csp/csp.h>
+
+#include <param/param.h>
+#include <param/param_server.h>
+#include <param/param_stats.h>
+
+/**
+ * NOTE: The lock functions are external hooks,
+ * and must therefore be implemented by the user.
+ */
+int si_lock_take(void* lock, int block_time_ms);
+int si_lock_give(void* lock);
+void* si_lock_init(void);
+
+static void* lock = NULL;
+
+struct param_server_coalesce_entry_s {
+	uint8_t used;
+	uint8_t overflow;		/* The record is incomplete, waiters are served live */
+	uint16_t dst;
+	uint16_t length;
+	uint8_t request[PARAM_SERVER_MTU];
+	int waiter_count;
+	csp_packet_t * waiters[PARAM_SERVER_COALESCE_WAITERS];
+	uint16_t record_count;
+	uint16_t record_used;
+	uint8_t record[PARAM_SERVER_COALESCE_SIZE];
+};
+
+static param_server_coalesce_entry_t param_server_coalesce[PARAM_COALESCE];
+
+void param_serve_coalesce_init(void) {
+	lock = si_lock_init();
+}
+
+static int param_server_coalesce_allowed(csp_packet_t * request) {
+
+	if (request->length > PARAM_SERVER_MTU)
+		return 0;
+
+	/* Ack with pull has side effects */
+	if (request->data[1] == 1)
+		return 0;
+
+	switch(request->data[0]) {
+		case PARAM_PULL_REQUEST:
+		case PARAM_PULL_REQUEST_V2:
+		case PARAM_PULL_ALL_REQUEST:
+		case PARAM_PULL_ALL_REQUEST_V2:
+		case PARAM_PULL_ALL_SINCE_REQUEST:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Send recorded packets: [uint16 length][data]
+ * All buffers are taken before the first send, so the waiter gets the whole response or nothing.
+ * @return 0 if sent, -1 if out of buffers
+ */
+static int param_server_coalesce_replay(param_server_coalesce_entry_t * entry, csp_packet_t * request) {
+
+	csp_packet_t * responses[PARAM_SERVER_COALESCE_PACKETS];
+
+	unsigned int pos = 0;
+	for (int i = 0; i < entry->record_count; i++) {
+		uint16_t length;
+		memcpy(&length, &entry->record[pos], sizeof(length));
+		pos += sizeof(length);
+
+		responses[i] = csp_buffer_get(PARAM_SERVER_MTU);
+		if (responses[i] == NULL) {
+			param_stats_add(PARAM_STATS_NOBUF, 1);
+			while (i-- > 0)
+				csp_buffer_free(responses[i]);
+			return -1;
+		}
+		memcpy(responses[i]->data, &entry->record[pos], length);
+		responses[i]->length = length;
+		pos += length;
+	}
+
+	for (int i = 0; i < entry->record_count; i++) {
+		param_stats_add(PARAM_STATS_BYTES_OUT, responses[i]->length);
+		csp_sendto_reply(request, responses[i], CSP_O_SAME);
+	}
+	return 0;
+}
+
+int param_server_coalesce_begin(csp_packet_t * request, param_server_coalesce_entry_t ** leader) {
+
+	*leader = NULL;
+
+	if (lock == NULL || !param_server_coalesce_allowed(request))
+		return -1;
+
+	if (si_lock_take(lock, 100) != 0)
+		return -1;
+
+	param_server_coalesce_entry_t * free_entry = NULL;
+	for (int i = 0; i < PARAM_COALESCE; i++) {
+		param_server_coalesce_entry_t * entry = &param_server_coalesce[i];
+
+		if (!entry->used) {
+			if (free_entry == NULL)
+				free_entry = entry;
+			continue;
+		}
+
+		if (entry->dst != request->id.dst || entry->length != request->length || memcmp(entry->request, request->data, request->length) != 0)
+			continue;
+
+		if (entry->overflow || entry->waiter_count >= PARAM_SERVER_COALESCE_WAITERS)
+			break;
+
+		entry->waiters[entry->waiter_count++] = request;
+		si_lock_give(lock);
+		return 0;
+	}
+
+	if (free_entry) {
+		free_entry->used = 1;
+		free_entry->overflow = 0;
+		free_entry->dst = request->id.dst;
+		free_entry->length = request->length;
+		memcpy(free_entry->request, request->data, request->length);
+		free_entry->waiter_count = 0;
+		free_entry->record_count = 0;
+		free_entry->record_used = 0;
+		*leader = free_entry;
+	}
+
+	si_lock_give(lock);
+	return -1;
+}
+
+void param_server_coalesce_send(param_server_coalesce_entry_t * entry, csp_packet_t * response) {
+
+	if (entry == NULL)
+		return;
+
+	if (si_lock_take(lock, 100) != 0) {
+		/* The record misses this packet, stop attaching and serve the waiters live at the end */
+		__atomic_store_n(&entry->overflow, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	uint16_t length = response->length;
+	if (!entry->overflow && entry->record_count < PARAM_SERVER_COALESCE_PACKETS && entry->record_used + sizeof(length) + length <= PARAM_SERVER_COALESCE_SIZE) {
+		memcpy(&entry->record[entry->record_used], &length, sizeof(length));
+		entry->record_used += sizeof(length);
+		memcpy(&entry->record[entry->record_used], response->data, length);
+		entry->record_used += length;
+		entry->record_count++;
+	} else {
+		entry->overflow = 1;
+	}
+
+	si_lock_give(lock);
+}
+
+int param_server_coalesce_end(param_server_coalesce_entry_t * entry, int complete, csp_packet_t ** live) {
+
+	if (entry == NULL)
+		return 0;
+
+	/* Release even if the lock times out, the entry would be lost otherwise */
+	int locked = (si_lock_take(lock, 1000) == 0);
+
+	/* Waiters that cannot be sent the whole recorded response are served on their own */
+	int live_count = 0;
+	int replay = complete && locked && !__atomic_load_n(&entry->overflow, __ATOMIC_RELAXED);
+	for (int i = 0; i < entry->waiter_count; i++) {
+		if (replay && param_server_coalesce_replay(entry, entry->waiters[i]) == 0) {
+			csp_buffer_free(entry->waiters[i]);
+		} else {
+			live[live_count++] = entry->waiters[i];
+		}
+	}
+	entry->waiter_count = 0;
+	entry->used = 0;
+	if (locked)
+		si_lock_give(lock);
+
+	return live_count;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <csp/csp.h>
+
+/**
+ * Coalescing of identical concurrent pull requests.
+ *
+ * The first request becomes the leader and is served normally. Identical requests
+ * arriving while it is in progress attach to it as waiters. The leader's response
+ * is recorded, up to PARAM_SERVER_COALESCE_PACKETS packets in a PARAM_SERVER_COALESCE_SIZE
+ * record, and replayed to each waiter when the leader is done. A waiter gets either the
+ * whole recording or, when the record overflowed, the leader failed or no buffers are
+ * left for the replay, a live response of its own, never both. Once the record
+ * overflows no more requests can attach.
+ */
+
+#ifndef PARAM_SERVER_COALESCE_SIZE
+#define PARAM_SERVER_COALESCE_SIZE 1024
+#endif
+
+#ifndef PARAM_SERVER_COALESCE_PACKETS
+#define PARAM_SERVER_COALESCE_PACKETS 8
+#endif
+
+#ifndef PARAM_SERVER_COALESCE_WAITERS
+#define PARAM_SERVER_COALESCE_WAITERS 4
+#endif
+
+typedef struct param_server_coalesce_entry_s param_server_coalesce_entry_t;
+
+/**
+ * Attach to an identical request in progress, or become the leader
+ * @param leader        output, entry to pass to send/end when the caller must serve the request
+ * @return 0 if the request was attached (and is now owned by the leader), -1 if it must be served
+ */
+int param_server_coalesce_begin(csp_packet_t * request, param_server_coalesce_entry_t ** leader);
+void param_server_coalesce_send(param_server_coalesce_entry_t * entry, csp_packet_t * response);
+
+/**
+ * Release the entry and replay the recorded response to the waiters.
+ * @param complete      the leader sent its whole response
+ * @param live          output, PARAM_SERVER_COALESCE_WAITERS requests the caller must serve itself
+ * @return number of requests in live
+ */
+int param_server_coalesce_end(param_server_coalesce_entry_t * entry, int complete, csp_packet_t ** live);
@@ -17,12 +17,17 @@
 #include <csp/csp.h>
 #include <csp/csp_hooks.h>
 
+#include <libparam.h>
+
 #include <param/param.h>
 #include <param/param_list.h>
 #include <param/param_client.h>
 #include <param/param_server.h>
 #include <param/param_queue.h>
 #include <param/param_string.h>
+#ifdef PARAM_HAVE_CACHE
+#include <param/param_cache.h>
+#endif
 
 #include "param_slash.h"
 #include "param_wildcard.h"
@@ -174,12 +179,18 @@ static int cmd_get(struct slash *slash) {
 	int node = slash_dfl_node;
 	int paramver = 2;
 	int server = 0;
+#ifdef PARAM_HAVE_CACHE
+	int refresh = 0;
+#endif
 
     optparse_t * parser = optparse_new("get", "<name>");
     optparse_add_help(parser);
     optparse_add_int(parser, 'n', "node", "NUM", 0, &node, "node (default = <env>)");
 	optparse_add_int(parser, 's', "server", "NUM", 0, &server, "server to get parameters from (default = node))");
     optparse_add_int(parser, 'v', "paramver", "NUM", 0, &paramver, "parameter system version (default = 2)");
+#ifdef PARAM_HAVE_CACHE
+	optparse_add_set(parser, 'r', "refresh", 1, &refresh, "bypass cache and pull from remote");
+#endif
 
     int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
     if (argi < 0) {
@@ -229,7 +240,15 @@ static int cmd_get(struct slash *slash) {
 		if (server > 0)
 			dest = server;
 
-		if (param_pull_single(param, offset, CSP_PRIO_HIGH, 1, dest, slash_dfl_timeout, paramver) < 0) {
+		int result;
+#ifdef PARAM_HAVE_CACHE
+		if (!refresh)
+			result = param_pull_single_cached(param, offset, CSP_PRIO_HIGH, 1, dest, slash_dfl_timeout, paramver);
+		else
+#endif
+			result = param_pull_single(param, offset, CSP_PRIO_HIGH, 1, dest, slash_dfl_timeout, paramver);
+
+		if (result < 0) {
 			printf("No response\n");
             optparse_del(parser);
 			return SLASH_EIO;
@@ -513,6 +532,35 @@ static int cmd_run(struct slash *slash) {
 }
 slash_command_sub(cmd, run, cmd_run, "", NULL);
 
+/* Last known change sequence per node and masks, for pull --changed */
+static struct {
+	uint8_t used;
+	uint16_t node;
+	uint32_t include_mask;
+	uint32_t exclude_mask;
+	uint32_t seq;
+} pull_since[16];
+
+static uint32_t * pull_since_get(uint16_t node, uint32_t include_mask, uint32_t exclude_mask) {
+	unsigned int slot = 0;
+	for (unsigned int i = 0; i < sizeof(pull_since) / sizeof(pull_since[0]); i++) {
+		if (pull_since[i].used && pull_since[i].node == node
+				&& pull_since[i].include_mask == include_mask && pull_since[i].exclude_mask == exclude_mask) {
+			return &pull_since[i].seq;
+		}
+		if (!pull_since[i].used && pull_since[slot].used) {
+			slot = i;
+		}
+	}
+	/* New entry, or recycle the first one when the table is full */
+	pull_since[slot].used = 1;
+	pull_since[slot].node = node;
+	pull_since[slot].include_mask = include_mask;
+	pull_since[slot].exclude_mask = exclude_mask;
+	pull_since[slot].seq = 0;
+	return &pull_since[slot].seq;
+}
+
 static int cmd_pull(struct slash *slash) {
 
 	unsigned int timeout = slash_dfl_timeout;
@@ -521,6 +569,7 @@ static int cmd_pull(struct slash *slash) {
 	char * exclude_mask_str = NULL;
 	char * nodes_str = NULL;
 	int paramver = 2;
+	int changed = 0;
 
 	optparse_t * parser = optparse_new("pull", "");
 	optparse_add_help(parser);
@@ -530,6 +579,7 @@ static int cmd_pull(struct slash *slash) {
 	optparse_add_string(parser, 'e', "emask", "MASK", &exclude_mask_str, "Exclude mask (param letters)");
 	optparse_add_string(parser, 'n', "nodes", "NODES", &nodes_str, "Comma separated list of nodes to pull parameters from");
 	optparse_add_int(parser, 'v', "paramver", "NUM", 0, &paramver, "parameter system version (default = 2)");
+	optparse_add_set(parser, 'c', "changed", 1, &changed, "only pull values changed since last pull --changed");
 
     int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
     if (argi < 0) {
@@ -580,7 +630,13 @@ static int cmd_pull(struct slash *slash) {
 		num_nodes = idx;
 	}	
 	for (uint8_t i = 0; i < num_nodes; i++) {
-		if (param_pull_all(CSP_PRIO_HIGH, 1, nodes[i], include_mask, exclude_mask, timeout, paramver)) {
+		int error;
+		if (changed) {
+			error = param_pull_all_since(CSP_PRIO_HIGH, 1, nodes[i], include_mask, exclude_mask, pull_since_get(nodes[i], include_mask, exclude_mask), timeout);
+		} else {
+			error = param_pull_all(CSP_PRIO_HIGH, 1, nodes[i], include_mask, exclude_mask, timeout, paramver);
+		}
+		if (error) {
 			printf("No response from %d\n", nodes[i]);
 			result = SLASH_EIO;
 		}
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <string.h>
+#include <csp/arch/csp_time.h>
+
+#include <vmem/vmem.h>
+#include <vmem/vmem_ram.h>
+#include <param/param.h>
+#include <param/param_stats.h>
+
+/* Keep every slot on its own cache line, so threads never share one */
+typedef struct {
+	uint32_t counter[PARAM_STATS_WORDS];
+} __attribute__((aligned(64))) param_stats_slot_t;
+
+static param_stats_slot_t param_stats_slots[PARAM_STATS_SLOTS];
+static uint32_t param_stats_slots_used = 0;
+static __thread param_stats_slot_t * param_stats_slot = NULL;
+
+static param_stats_slot_t * param_stats_slot_get(void) {
+
+	if (param_stats_slot == NULL) {
+		uint32_t idx = __atomic_fetch_add(&param_stats_slots_used, 1, __ATOMIC_RELAXED);
+		if (idx >= PARAM_STATS_SLOTS)
+			idx = PARAM_STATS_SLOTS - 1;
+		param_stats_slot = &param_stats_slots[idx];
+	}
+
+	return param_stats_slot;
+}
+
+void param_stats_add(int counter, uint32_t value) {
+	if (counter < 0 || counter >= PARAM_STATS_WORDS)
+		return;
+	/* Relaxed atomic, since the last slot may be shared */
+	__atomic_fetch_add(&param_stats_slot_get()->counter[counter], value, __ATOMIC_RELAXED);
+}
+
+void param_stats_request(int type, uint32_t length) {
+	if (type >= PARAM_STATS_TYPES)
+		type = PARAM_STATS_TYPES - 1;
+	param_stats_add(PARAM_STATS_REQUESTS + type, 1);
+	param_stats_add(PARAM_STATS_BYTES_IN, length);
+}
+
+uint32_t param_stats_start(void) {
+	return csp_get_ms();
+}
+
+void param_stats_time(uint32_t start) {
+	uint32_t elapsed = csp_get_ms() - start;
+	int bucket = 0;
+	while (elapsed > 0 && bucket < PARAM_STATS_BUCKETS - 1) {
+		elapsed >>= 1;
+		bucket++;
+	}
+	param_stats_add(PARAM_STATS_TIME + bucket, 1);
+}
+
+void param_stats_get(uint32_t * out) {
+	memset(out, 0, PARAM_STATS_WORDS * sizeof(uint32_t));
+	for (int i = 0; i < PARAM_STATS_SLOTS; i++) {
+		for (int j = 0; j < PARAM_STATS_WORDS; j++) {
+			out[j] += __atomic_load_n(&param_stats_slots[i].counter[j], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static void param_stats_reset_range(int first, int count) {
+	for (int i = 0; i < PARAM_STATS_SLOTS; i++) {
+		for (int j = first; j < first + count && j < PARAM_STATS_WORDS; j++) {
+			__atomic_store_n(&param_stats_slots[i].counter[j], 0, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void param_stats_reset(void) {
+	param_stats_reset_range(0, PARAM_STATS_WORDS);
+}
+
+/**
+ * The stats VMEM has no storage of its own, the address space is a view
+ * of the aggregated counters. Any write resets the counters it covers.
+ */
+static uint32_t param_stats_view[PARAM_STATS_WORDS];
+
+static void param_stats_vmem_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t len) {
+	if (addr + len > sizeof(param_stats_view))
+		return;
+	uint32_t snapshot[PARAM_STATS_WORDS];
+	param_stats_get(snapshot);
+	memcpy(dataout, (uint8_t *) snapshot + addr, len);
+}
+
+static void param_stats_vmem_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len) {
+	if (addr + len > sizeof(param_stats_view))
+		return;
+	param_stats_reset_range(addr / sizeof(uint32_t), (len + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+}
+
+__attribute__((section("vmem")))
+__attribute__((aligned(1)))
+__attribute__((used))
+vmem_t vmem_stats = {
+	.type = VMEM_TYPE_DRIVER,
+	.name = "stats",
+	.size = sizeof(param_stats_view),
+	.read = param_stats_vmem_read,
+	.write = param_stats_vmem_write,
+	VMEM_STATIC_RAM_ADDR_VADDR_INITIALIZER(param_stats_view),
+	.ack_with_pull = 1,
+};
+
+#define STATS_ADDR(counter) ((counter) * sizeof(uint32_t))
+
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 0, srv_applied, PARAM_TYPE_UINT32, 0, 0, PM_TELEM, NULL, "", stats, STATS_ADDR(PARAM_STATS_APPLIED), "Parameter entries applied");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 1, srv_unknown, PARAM_TYPE_UINT32, 0, 0, PM_TELEM | PM_ERRCNT, NULL, "", stats, STATS_ADDR(PARAM_STATS_UNKNOWN), "Parameter entries skipped, unknown parameter");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 2, srv_bytes_in, PARAM_TYPE_UINT32, 0, 0, PM_TELEM, NULL, "B", stats, STATS_ADDR(PARAM_STATS_BYTES_IN), "Request bytes received");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 3, srv_bytes_out, PARAM_TYPE_UINT32, 0, 0, PM_TELEM, NULL, "B", stats, STATS_ADDR(PARAM_STATS_BYTES_OUT), "Response bytes sent");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 4, srv_nobuf, PARAM_TYPE_UINT32, 0, 0, PM_TELEM | PM_ERRCNT, NULL, "", stats, STATS_ADDR(PARAM_STATS_NOBUF), "Buffer allocation failures");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 5, srv_vmem_req, PARAM_TYPE_UINT32, 0, 0, PM_TELEM, NULL, "", stats, STATS_ADDR(PARAM_STATS_VMEM_REQUESTS), "VMEM server requests");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 6, srv_list_req, PARAM_TYPE_UINT32, 0, 0, PM_TELEM, NULL, "", stats, STATS_ADDR(PARAM_STATS_LIST_REQUESTS), "List server requests");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 7, srv_req, PARAM_TYPE_UINT32, PARAM_STATS_TYPES, sizeof(uint32_t), PM_TELEM, NULL, "", stats, STATS_ADDR(PARAM_STATS_REQUESTS), "Param server requests per packet type");
+PARAM_DEFINE_STATIC_VMEM(PARAMID_STATS_BASE + 8, srv_time, PARAM_TYPE_UINT32, PARAM_STATS_BUCKETS, sizeof(uint32_t), PM_TELEM, NULL, "", stats, STATS_ADDR(PARAM_STATS_TIME), "Param server service time, log2 ms buckets");
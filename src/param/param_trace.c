@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <csp/arch/csp_time.h>
+
+#include <vmem/vmem.h>
+#include <vmem/vmem_ram.h>
+#include <param/param_trace.h>
+
+static param_trace_buffer_t param_trace_buffer = {
+	.magic = PARAM_TRACE_MAGIC,
+	.version = PARAM_TRACE_VERSION,
+	.threads = PARAM_TRACE_THREADS,
+	.entries = PARAM_TRACE,
+};
+
+VMEM_DEFINE_STATIC_RAM_ADDR(trace, "trace", sizeof(param_trace_buffer), &param_trace_buffer);
+
+static uint32_t param_trace_threads_used = 0;
+static __thread int param_trace_thread = -1;
+
+__attribute__((weak)) uint32_t param_trace_clock(void) {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return csp_get_ms() * 1000;
+#endif
+}
+
+void param_trace_event(uint8_t op, uint16_t id, uint16_t node, uint16_t length, uint32_t start) {
+
+	uint32_t now = param_trace_clock();
+
+	if (param_trace_thread < 0) {
+		uint32_t thread = __atomic_fetch_add(&param_trace_threads_used, 1, __ATOMIC_RELAXED);
+		param_trace_thread = (thread < PARAM_TRACE_THREADS) ? thread : PARAM_TRACE_THREADS - 1;
+	}
+
+	/* The ring is normally private, the atomic only matters for the shared last ring */
+	int thread = param_trace_thread;
+	uint32_t head = __atomic_fetch_add(&param_trace_buffer.head[thread], 1, __ATOMIC_RELAXED);
+	param_trace_event_t * event = &param_trace_buffer.ring[thread][head % PARAM_TRACE];
+
+	event->time = start;
+	event->duration = now - start;
+	event->id = id;
+	event->node = node;
+	event->op = op;
+	event->thread = thread;
+	event->length = length;
+}
+
+void param_trace_clear(void) {
+	for (int i = 0; i < PARAM_TRACE_THREADS; i++) {
+		__atomic_store_n(&param_trace_buffer.head[i], 0, __ATOMIC_RELAXED);
+	}
+}
+
+#ifdef PARAM_HAVE_FOPEN
+int param_trace_dump(const char * filename) {
+
+	FILE * stream = fopen(filename, "wb");
+	if (stream == NULL)
+		return -1;
+
+	size_t written = fwrite(&param_trace_buffer, 1, sizeof(param_trace_buffer), stream);
+	fclose(stream);
+
+	return (written == sizeof(param_trace_buffer)) ? 0 : -1;
+}
+#endif
@@ -0,0 +1,336 @@
+#include <param/param_subscribe.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <csp/csp.h>
+#include <csp/csp_crc32.h>
+#include <csp/arch/csp_time.h>
+#include <sys/types.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_queue.h>
+#include <param/param_server.h>
+
+/**
+ * NOTE: The lock functions are external hooks,
+ * and must therefore be implemented by the user.
+ */
+int si_lock_take(void* lock, int block_time_ms);
+int si_lock_give(void* lock);
+void* si_lock_init(void);
+
+static void* lock = NULL;
+
+typedef struct {
+	param_t * param;
+	uint32_t crc;		/* Checksum of last sent value */
+	double value;		/* Last sent value, numeric scalars only */
+	uint8_t sent;
+} param_subscription_entry_t;
+
+typedef struct {
+	uint8_t used;
+	uint16_t node;
+	uint32_t interval;
+	float deadband;
+	uint32_t expires;
+	uint32_t last_update;
+	int count;
+	param_subscription_entry_t entries[PARAM_SUBSCRIBE_PARAMS];
+} param_subscription_t;
+
+static param_subscription_t subscriptions[PARAM_SUBSCRIBE_MAX];
+
+_Static_assert(PARAM_SUBSCRIBE_PARAMS <= 255, "PARAM_SUBSCRIBE_PARAMS must fit in the uint8_t count of the response");
+
+static uint32_t param_subscribe_crc(param_t * param) {
+
+	csp_crc32_t crc;
+	csp_crc32_init(&crc);
+
+	int size = param_size(param);
+	int count = 1;
+	if ((param->type != PARAM_TYPE_STRING) && (param->type != PARAM_TYPE_DATA) && (param->array_size > 1))
+		count = param->array_size;
+
+	uint8_t buf[64];
+	for (int i = 0; i < count; i++) {
+		for (int offset = 0; offset < size; offset += sizeof(buf)) {
+			int chunk = size - offset;
+			if (chunk > (int) sizeof(buf))
+				chunk = sizeof(buf);
+			if (param->vmem && param->vmem->read) {
+				param->vmem->read(param->vmem, param->vaddr + i * param->array_step + offset, buf, chunk);
+			} else {
+				memcpy(buf, param->addr + i * param->array_step + offset, chunk);
+			}
+			csp_crc32_update(&crc, buf, chunk);
+		}
+	}
+
+	return csp_crc32_final(&crc);
+}
+
+static int param_subscribe_number(param_t * param, double * value) {
+
+	if (param->array_size > 1)
+		return -1;
+
+	switch(param->type) {
+		case PARAM_TYPE_UINT8:
+		case PARAM_TYPE_XINT8: *value = param_get_uint8(param); return 0;
+		case PARAM_TYPE_UINT16:
+		case PARAM_TYPE_XINT16: *value = param_get_uint16(param); return 0;
+		case PARAM_TYPE_UINT32:
+		case PARAM_TYPE_XINT32: *value = param_get_uint32(param); return 0;
+		case PARAM_TYPE_UINT64:
+		case PARAM_TYPE_XINT64: *value = param_get_uint64(param); return 0;
+		case PARAM_TYPE_INT8: *value = param_get_int8(param); return 0;
+		case PARAM_TYPE_INT16: *value = param_get_int16(param); return 0;
+		case PARAM_TYPE_INT32: *value = param_get_int32(param); return 0;
+		case PARAM_TYPE_INT64: *value = param_get_int64(param); return 0;
+		case PARAM_TYPE_FLOAT: *value = param_get_float(param); return 0;
+		case PARAM_TYPE_DOUBLE: *value = param_get_double(param); return 0;
+		default: return -1;
+	}
+}
+
+/* Returns 1 if the value differs enough from the last sent one, the new snapshot is returned in next */
+static int param_subscribe_changed(param_subscription_t * sub, param_subscription_entry_t * entry, param_subscription_entry_t * next) {
+
+	double value = 0;
+	int numeric = (param_subscribe_number(entry->param, &value) == 0);
+
+	*next = *entry;
+	next->value = value;
+	next->sent = 1;
+
+	if ((sub->deadband > 0) && numeric) {
+		double delta = value - entry->value;
+		if (delta < 0)
+			delta = -delta;
+		return !(entry->sent && delta < sub->deadband);
+	}
+
+	next->crc = param_subscribe_crc(entry->param);
+	return !(entry->sent && next->crc == entry->crc);
+}
+
+static csp_packet_t * param_subscribe_allocate(param_queue_t * queue) {
+	csp_packet_t * packet = csp_buffer_get(PARAM_SERVER_MTU);
+	if (packet == NULL)
+		return NULL;
+	param_queue_init(queue, &packet->data[2], PARAM_SERVER_MTU - 2, 0, PARAM_QUEUE_TYPE_SET, 2);
+	return packet;
+}
+
+static void param_subscribe_send(param_subscription_t * sub, csp_packet_t * packet, param_queue_t * queue, int end) {
+	packet->data[0] = PARAM_PULL_RESPONSE_V2;
+	packet->data[1] = (end) ? PARAM_FLAG_END : 0;
+	packet->length = queue->used + 2;
+	csp_sendto(CSP_PRIO_NORM, sub->node, PARAM_PORT_SERVER, PARAM_PORT_SERVER, CSP_O_NONE, packet);
+}
+
+static void param_subscribe_update_one(param_subscription_t * sub) {
+
+	csp_packet_t * packet = NULL;
+	param_queue_t queue;
+
+	for (int i = 0; i < sub->count; i++) {
+		param_subscription_entry_t * entry = &sub->entries[i];
+		param_subscription_entry_t next;
+
+		if (!param_subscribe_changed(sub, entry, &next))
+			continue;
+
+		if (packet == NULL) {
+			packet = param_subscribe_allocate(&queue);
+			if (packet == NULL) {
+				/* Retry on next update, the snapshots of unsent values are kept */
+				return;
+			}
+		}
+
+		if (param_queue_add(&queue, entry->param, -1, NULL) != 0) {
+
+			/* Flush */
+			param_subscribe_send(sub, packet, &queue, 0);
+			packet = param_subscribe_allocate(&queue);
+			if (packet == NULL) {
+				return;
+			}
+
+			/* Retry on fresh buffer */
+			if (param_queue_add(&queue, entry->param, -1, NULL) != 0) {
+				printf("warn: param too big for mtu\n");
+				continue;
+			}
+		}
+
+		/* Only a queued value becomes the new reference */
+		*entry = next;
+	}
+
+	if (packet)
+		param_subscribe_send(sub, packet, &queue, 1);
+}
+
+void param_subscribe_server_update(uint32_t now_ms) {
+
+	if (lock == NULL || si_lock_take(lock, 1000) != 0)
+		return;
+
+	for (int i = 0; i < PARAM_SUBSCRIBE_MAX; i++) {
+		param_subscription_t * sub = &subscriptions[i];
+		if (!sub->used)
+			continue;
+
+		if ((int32_t) (now_ms - sub->expires) >= 0) {
+			sub->used = 0;
+			continue;
+		}
+
+		if ((int32_t) (now_ms - sub->last_update) < (int32_t) sub->interval)
+			continue;
+
+		sub->last_update = now_ms;
+		param_subscribe_update_one(sub);
+	}
+
+	si_lock_give(lock);
+}
+
+void param_subscribe_loop(void * param) {
+	while(1) {
+		param_subscribe_server_update(csp_get_ms());
+		usleep(100000);
+	}
+}
+
+static int param_subscribe_add(param_subscription_t * sub, param_t * param) {
+
+	if (sub->count >= PARAM_SUBSCRIBE_PARAMS)
+		return -1;
+
+	/* No duplicates */
+	for (int i = 0; i < sub->count; i++) {
+		if (sub->entries[i].param == param)
+			return 0;
+	}
+
+	param_subscription_entry_t * entry = &sub->entries[sub->count++];
+	entry->param = param;
+	entry->crc = 0;
+	entry->value = 0;
+	entry->sent = 0;
+	return 0;
+}
+
+void param_serve_subscribe(csp_packet_t * request) {
+
+	int server_addr = request->id.dst;
+	int count = 0;
+
+	if (lock == NULL || si_lock_take(lock, 1000) != 0) {
+		csp_buffer_free(request);
+		return;
+	}
+
+	/* One subscription per subscriber, replace any existing */
+	param_subscription_t * sub = NULL;
+	for (int i = 0; i < PARAM_SUBSCRIBE_MAX; i++) {
+		if (subscriptions[i].used && subscriptions[i].node == request->id.src) {
+			sub = &subscriptions[i];
+			sub->used = 0;
+			break;
+		}
+	}
+
+	if (request->length < PARAM_SUBSCRIBE_HEADER_SIZE || (request->data[1] & PARAM_SUBSCRIBE_FLAG_CANCEL)) {
+		goto out;
+	}
+
+	if (sub == NULL) {
+		for (int i = 0; i < PARAM_SUBSCRIBE_MAX; i++) {
+			if (!subscriptions[i].used) {
+				sub = &subscriptions[i];
+				break;
+			}
+		}
+	}
+
+	if (sub == NULL) {
+		printf("Subscription table full\n");
+		goto out;
+	}
+
+	uint32_t include_mask = be32toh(request->data32[1]);
+	uint32_t exclude_mask = be32toh(request->data32[2]);
+	uint32_t deadband_bits = be32toh(request->data32[4]);
+	uint32_t lease = be32toh(request->data32[5]);
+	if (lease == 0)
+		lease = PARAM_SUBSCRIBE_LEASE_DEFAULT;
+
+	uint32_t now = csp_get_ms();
+	sub->node = request->id.src;
+	sub->interval = be32toh(request->data32[3]);
+	memcpy(&sub->deadband, &deadband_bits, sizeof(float));
+	sub->expires = now + lease * 1000;
+	sub->last_update = now - sub->interval;
+	sub->count = 0;
+
+	if (request->length > PARAM_SUBSCRIBE_HEADER_SIZE) {
+
+		/* Explicit list of parameters */
+		param_queue_t q_request;
+		int len = request->length - PARAM_SUBSCRIBE_HEADER_SIZE;
+		param_queue_init(&q_request, &request->data[PARAM_SUBSCRIBE_HEADER_SIZE], len, len, PARAM_QUEUE_TYPE_GET, 2);
+
+		mpack_reader_t reader;
+		mpack_reader_init_data(&reader, q_request.buffer, q_request.used);
+		while(reader.data < reader.end) {
+			int id, node, offset = -1;
+			long unsigned int timestamp = 0;
+			param_deserialize_id(&reader, &id, &node, &timestamp, &offset, &q_request);
+			if (server_addr == node)
+				node = 0;
+			param_t * param = param_list_find_id(node, id);
+			if (param && param_subscribe_add(sub, param) < 0)
+				break;
+		}
+
+	} else {
+
+		param_t * param;
+		param_list_iterator i = {};
+		while ((param = param_list_iterate(&i)) != NULL) {
+			if ((param->mask & include_mask) == 0)
+				continue;
+			if ((param->mask & exclude_mask) != 0)
+				continue;
+			if (param_subscribe_add(sub, param) < 0) {
+				printf("Subscription truncated to %u params\n", PARAM_SUBSCRIBE_PARAMS);
+				break;
+			}
+		}
+
+	}
+
+	count = sub->count;
+	sub->used = (count > 0);
+
+out:
+	si_lock_give(lock);
+
+	request->data[0] = PARAM_SUBSCRIBE_RESPONSE;
+	request->data[1] = PARAM_FLAG_END;
+	request->data[2] = count;
+	request->length = 3;
+	csp_sendto_reply(request, request, CSP_O_SAME);
+}
+
+void param_subscribe_server_init(void) {
+	lock = si_lock_init();
+}
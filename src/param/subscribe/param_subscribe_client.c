@@ -0,0 +1,91 @@
+#include <param/param_subscribe.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <csp/csp.h>
+#include <sys/types.h>
+
+#include <param/param.h>
+#include <param/param_server.h>
+#include <param/param_queue.h>
+
+typedef void (*param_transaction_callback_f)(csp_packet_t *response, int verbose, int version, void * context);
+int param_transaction(csp_packet_t *packet, int host, int timeout, param_transaction_callback_f callback, int verbose, int version, void * context);
+
+static void param_transaction_callback_subscribe(csp_packet_t *response, int verbose, int version, void * context) {
+
+	if (response->data[0] == PARAM_SUBSCRIBE_RESPONSE && response->length >= 3) {
+		*(int *) context = response->data[2];
+	}
+
+	csp_buffer_free(response);
+}
+
+static int param_subscribe_request(int server, uint8_t flags, uint32_t include_mask, uint32_t exclude_mask, param_queue_t * queue, uint32_t interval, float deadband, uint32_t lease, int verbose, int timeout) {
+
+	csp_packet_t * packet = csp_buffer_get(PARAM_SERVER_MTU);
+	if (packet == NULL)
+		return -1;
+
+	uint32_t deadband_bits;
+	memcpy(&deadband_bits, &deadband, sizeof(float));
+
+	packet->data[0] = PARAM_SUBSCRIBE_REQUEST;
+	packet->data[1] = flags;
+	packet->data16[1] = 0;
+	packet->data32[1] = htobe32(include_mask);
+	packet->data32[2] = htobe32(exclude_mask);
+	packet->data32[3] = htobe32(interval);
+	packet->data32[4] = htobe32(deadband_bits);
+	packet->data32[5] = htobe32(lease);
+	packet->length = PARAM_SUBSCRIBE_HEADER_SIZE;
+
+	if (queue && queue->used > 0) {
+		if (queue->version != 2 || queue->used > PARAM_SERVER_MTU - PARAM_SUBSCRIBE_HEADER_SIZE) {
+			csp_buffer_free(packet);
+			return -1;
+		}
+		memcpy(&packet->data[PARAM_SUBSCRIBE_HEADER_SIZE], queue->buffer, queue->used);
+		packet->length += queue->used;
+	}
+
+	packet->id.pri = CSP_PRIO_NORM;
+
+	int count = 0;
+	if (param_transaction(packet, server, timeout, param_transaction_callback_subscribe, verbose, 2, &count) < 0) {
+		return -1;
+	}
+
+	return count;
+}
+
+int param_subscribe(int server, uint32_t include_mask, uint32_t exclude_mask, param_queue_t * queue, uint32_t interval, float deadband, uint32_t lease, int verbose, int timeout) {
+
+	int count = param_subscribe_request(server, 0, include_mask, exclude_mask, queue, interval, deadband, lease, verbose, timeout);
+
+	if (verbose) {
+		if (count < 0) {
+			printf("No response from %d\n", server);
+		} else if (count == 0) {
+			printf("\033[0;31mSubscription rejected by %d\033[0m\n", server);
+		} else {
+			printf("Subscribed to %d params on %d\n", count, server);
+		}
+	}
+
+	if (count == 0)
+		return -1;
+	return count;
+}
+
+int param_unsubscribe(int server, int verbose, int timeout) {
+
+	int count = param_subscribe_request(server, PARAM_SUBSCRIBE_FLAG_CANCEL, 0, 0, NULL, 0, 0, 0, verbose, timeout);
+	if (count < 0) {
+		if (verbose)
+			printf("No response from %d\n", server);
+		return -1;
+	}
+
+	return 0;
+}
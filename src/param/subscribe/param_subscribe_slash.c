@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <slash/slash.h>
+#include <slash/optparse.h>
+#include <slash/dflopt.h>
+
+#include <param/param.h>
+#include <param/param_list.h>
+#include <param/param_queue.h>
+#include <param/param_server.h>
+#include <param/param_subscribe.h>
+
+static int cmd_subscribe(struct slash *slash) {
+
+	unsigned int timeout = slash_dfl_timeout;
+	unsigned int server = slash_dfl_node;
+	unsigned int interval = 1000;
+	unsigned int lease = PARAM_SUBSCRIBE_LEASE_DEFAULT;
+	char * include_mask_str = NULL;
+	char * exclude_mask_str = NULL;
+	char * deadband_str = NULL;
+
+	optparse_t * parser = optparse_new("subscribe", "[param ...]");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 't', "timeout", "NUM", 0, &timeout, "timeout in milliseconds (default = <env>)");
+	optparse_add_unsigned(parser, 's', "server", "NUM", 0, &server, "server to subscribe to (default = <env>))");
+	optparse_add_string(parser, 'm', "imask", "MASK", &include_mask_str, "Include mask (param letters)");
+	optparse_add_string(parser, 'e', "emask", "MASK", &exclude_mask_str, "Exclude mask (param letters)");
+	optparse_add_unsigned(parser, 'i', "interval", "NUM", 0, &interval, "min interval between updates in ms (default = 1000)");
+	optparse_add_string(parser, 'd', "deadband", "NUM", &deadband_str, "min change of numeric values (default = any change)");
+	optparse_add_unsigned(parser, 'l', "lease", "NUM", 0, &lease, "subscription lifetime in seconds");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	uint32_t include_mask = 0xFFFFFFFF;
+	uint32_t exclude_mask = PM_REMOTE | PM_HWREG;
+
+	if (include_mask_str)
+		include_mask = param_maskstr_to_mask(include_mask_str);
+	if (exclude_mask_str)
+		exclude_mask = param_maskstr_to_mask(exclude_mask_str);
+
+	float deadband = 0;
+	if (deadband_str)
+		deadband = atof(deadband_str);
+
+	/* Optional explicit list of parameters */
+	char queue_buf[PARAM_SERVER_MTU - PARAM_SUBSCRIBE_HEADER_SIZE];
+	param_queue_t queue;
+	param_queue_init(&queue, queue_buf, sizeof(queue_buf), 0, PARAM_QUEUE_TYPE_GET, 2);
+
+	while (++argi < slash->argc) {
+		param_t * param = param_list_find_name(server, slash->argv[argi]);
+		if (param == NULL) {
+			printf("%s not found on node %u\n", slash->argv[argi], server);
+			optparse_del(parser);
+			return SLASH_EINVAL;
+		}
+		if (param_queue_add(&queue, param, -1, NULL) != 0) {
+			printf("Too many parameters\n");
+			optparse_del(parser);
+			return SLASH_ENOSPC;
+		}
+	}
+
+	if (param_subscribe(server, include_mask, exclude_mask, &queue, interval, deadband, lease, 1, timeout) < 0) {
+		optparse_del(parser);
+		return SLASH_EIO;
+	}
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command(subscribe, cmd_subscribe, "[OPTIONS] [param ...]", "Subscribe to parameter changes on a remote node");
+
+static int cmd_unsubscribe(struct slash *slash) {
+
+	unsigned int timeout = slash_dfl_timeout;
+	unsigned int server = slash_dfl_node;
+
+	optparse_t * parser = optparse_new("unsubscribe", "");
+	optparse_add_help(parser);
+	optparse_add_unsigned(parser, 't', "timeout", "NUM", 0, &timeout, "timeout in milliseconds (default = <env>)");
+	optparse_add_unsigned(parser, 's', "server", "NUM", 0, &server, "server to unsubscribe from (default = <env>))");
+
+	int argi = optparse_parse(parser, slash->argc - 1, (const char **) slash->argv + 1);
+	if (argi < 0) {
+		optparse_del(parser);
+		return SLASH_EINVAL;
+	}
+
+	if (param_unsubscribe(server, 1, timeout) < 0) {
+		optparse_del(parser);
+		return SLASH_EIO;
+	}
+
+	optparse_del(parser);
+	return SLASH_SUCCESS;
+}
+slash_command(unsubscribe, cmd_unsubscribe, "[OPTIONS]", "Cancel subscription on a remote node");
@@ -10,6 +10,8 @@
 #include <csp/csp.h>
 
 #include <vmem/vmem.h>
+#include <vmem/vmem_ram.h>
+#include <param/param_trace.h>
 
 extern int __start_vmem, __stop_vmem;
 
@@ -33,6 +35,179 @@ void * vmem_memcpy(void * to, const void * from, uint32_t size) {
 	return vmem_cpy((uint64_t)(uintptr_t)to, (uint64_t)(uintptr_t)from, (uint64_t)size);
 }
 
+enum {
+	VMEM_FIND_ANY,
+	VMEM_FIND_WRITE,	/* Skip VMEMs without a write method */
+	VMEM_FIND_READ,		/* Skip VMEMs without a read method */
+};
+
+static int vmem_find_filter(vmem_t * vmem, int filter) {
+	switch (filter) {
+		case VMEM_FIND_WRITE: return vmem->write != NULL;
+		case VMEM_FIND_READ: return vmem->read != NULL;
+		default: return 1;
+	}
+}
+
+static vmem_t * vmem_find_linear(uint64_t addr, uint32_t size, int filter) {
+
+	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
+		if ((addr >= vmem->vaddr) && (addr + (uint64_t)size <= vmem->vaddr + vmem->size) && vmem_find_filter(vmem, filter)) {
+			return vmem;
+		}
+	}
+
+	return NULL;
+}
+
+#if PARAM_VMEM_INDEX > 0
+
+/**
+ * VMEMs sorted by start address, so a lookup is a binary search instead of a
+ * scan of the vmem section. max_end is the highest end address of this and all
+ * lower entries, which bounds the backwards search when VMEMs overlap (several
+ * driver VMEMs commonly sit at vaddr 0). The first match in section order is
+ * returned, exactly like the linear scan.
+ *
+ * The last hit is remembered, so sequential transfers resolve without a search.
+ * It is only used for VMEMs that overlap no other.
+ */
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	uint64_t max_end;
+	vmem_t * vmem;
+	uint8_t overlaps;
+} vmem_index_entry_t;
+
+static struct {
+	uint8_t busy;
+	uint8_t valid;
+	uint32_t generation;
+	int count;
+	vmem_index_entry_t * last;
+	vmem_index_entry_t entry[PARAM_VMEM_INDEX];
+} vmem_index;
+
+/* Bumped by vmem_index_invalidate(), starts different from the index */
+static uint32_t vmem_index_generation = 1;
+
+void vmem_index_invalidate(void) {
+	__atomic_add_fetch(&vmem_index_generation, 1, __ATOMIC_RELAXED);
+}
+
+/* Must be called with index locked */
+static void vmem_index_build(void) {
+
+	vmem_index.count = 0;
+	vmem_index.valid = 0;
+	vmem_index.last = NULL;
+	vmem_index.generation = __atomic_load_n(&vmem_index_generation, __ATOMIC_RELAXED);
+
+	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
+
+		/* Too many VMEMs, callers fall back to linear search */
+		if (vmem_index.count >= PARAM_VMEM_INDEX)
+			return;
+
+		/* Insertion sort on start, keeping section order for equal starts */
+		int i = vmem_index.count++;
+		while (i > 0 && vmem_index.entry[i - 1].start > vmem->vaddr) {
+			vmem_index.entry[i] = vmem_index.entry[i - 1];
+			i--;
+		}
+		vmem_index.entry[i].start = vmem->vaddr;
+		vmem_index.entry[i].end = vmem->vaddr + vmem->size;
+		vmem_index.entry[i].vmem = vmem;
+	}
+
+	uint64_t max_end = 0;
+	for (int i = 0; i < vmem_index.count; i++) {
+		max_end = VMEM_MAX(max_end, vmem_index.entry[i].end);
+		vmem_index.entry[i].max_end = max_end;
+	}
+
+	/* Overlapped by any lower entry, or by the next higher one */
+	for (int i = 0; i < vmem_index.count; i++) {
+		vmem_index_entry_t * e = &vmem_index.entry[i];
+		e->overlaps = 0;
+		if (i > 0 && e->start < vmem_index.entry[i - 1].max_end)
+			e->overlaps = 1;
+		if (i + 1 < vmem_index.count && vmem_index.entry[i + 1].start < e->end)
+			e->overlaps = 1;
+	}
+
+	vmem_index.valid = 1;
+}
+
+/* @return 0 if the index was used, with result in *found */
+static int vmem_index_find(uint64_t addr, uint32_t size, int filter, vmem_t ** found) {
+
+	if (__atomic_test_and_set(&vmem_index.busy, __ATOMIC_ACQUIRE))
+		return -1;
+
+	if (vmem_index.generation != __atomic_load_n(&vmem_index_generation, __ATOMIC_RELAXED))
+		vmem_index_build();
+
+	if (!vmem_index.valid) {
+		__atomic_clear(&vmem_index.busy, __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	uint64_t addr_end = addr + (uint64_t)size;
+	vmem_index_entry_t * match = NULL;
+
+	/* Last hit. With size 0 a VMEM touching it could match as well */
+	vmem_index_entry_t * last = vmem_index.last;
+	if (last && size > 0 && addr >= last->start && addr_end <= last->end) {
+		match = vmem_find_filter(last->vmem, filter) ? last : NULL;
+	} else {
+
+		/* Number of entries starting at or below addr */
+		int lo = 0, hi = vmem_index.count;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (vmem_index.entry[mid].start <= addr) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		/* Walk down while some entry can still reach addr_end, keep the first in section order */
+		for (int i = lo - 1; i >= 0 && vmem_index.entry[i].max_end >= addr_end; i--) {
+			vmem_index_entry_t * e = &vmem_index.entry[i];
+			if (e->end >= addr_end && vmem_find_filter(e->vmem, filter) && (match == NULL || e->vmem < match->vmem))
+				match = e;
+		}
+
+		if (match && !match->overlaps)
+			vmem_index.last = match;
+	}
+
+	*found = (match) ? match->vmem : NULL;
+
+	__atomic_clear(&vmem_index.busy, __ATOMIC_RELEASE);
+	return 0;
+}
+
+#else
+
+void vmem_index_invalidate(void) {
+}
+
+#endif
+
+/* First VMEM in section order holding [addr, addr + size] and passing filter */
+static vmem_t * vmem_find(uint64_t addr, uint32_t size, int filter) {
+#if PARAM_VMEM_INDEX > 0
+	vmem_t * vmem;
+	if (vmem_index_find(addr, size, filter, &vmem) == 0)
+		return vmem;
+#endif
+	return vmem_find_linear(addr, size, filter);
+}
+
 /**
  * @brief Write chunk of data to VMEM from physical memory to virtual memory
  * 
@@ -43,16 +218,17 @@ void * vmem_memcpy(void * to, const void * from, uint32_t size) {
  */
 void * vmem_write(uint64_t to, const void * from, uint32_t size) {
 
-	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
-		/* Write to VMEM */
-		if ((to >= vmem->vaddr) && (to + (uint64_t)size <= vmem->vaddr + vmem->size)) {
-			if (vmem->write) {
-				vmem->write(vmem, to - vmem->vaddr, (void*)(uintptr_t)from, size);
-			} else {
-				memcpy((void *)(uintptr_t)to, (void *)(uintptr_t)from, size);
-			}
-			break;
-		}
+	vmem_t * vmem = vmem_find(to, size, VMEM_FIND_ANY);
+	if (vmem == NULL)
+		return NULL;
+
+	/* Write to VMEM */
+	if (vmem->write) {
+		PARAM_TRACE_BEGIN(trace_start);
+		vmem->write(vmem, to - vmem->vaddr, (void*)(uintptr_t)from, size);
+		PARAM_TRACE_END(trace_start, PARAM_TRACE_VMEM_WRITE, vmem_ptr_to_index(vmem), 0, size);
+	} else {
+		memcpy((void *)(uintptr_t)to, (void *)(uintptr_t)from, size);
 	}
 
 	return NULL;
@@ -60,16 +236,17 @@ void * vmem_write(uint64_t to, const void * from, uint32_t size) {
 
 void * vmem_read(void * to, uint64_t from, uint32_t size) {
 
-	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
-		/* Read */
-		if ((from >= vmem->vaddr) && (from + (uint64_t)size <= vmem->vaddr + vmem->size)) {
-			if (vmem->read) {
-				vmem->read(vmem, from - vmem->vaddr, (void*)(uintptr_t)to, size);
-			} else {
-				memcpy((void *)(uintptr_t)to, (void *)(uintptr_t)from, size);
-			}
-			break;
-		}
+	vmem_t * vmem = vmem_find(from, size, VMEM_FIND_ANY);
+	if (vmem == NULL)
+		return NULL;
+
+	/* Read */
+	if (vmem->read) {
+		PARAM_TRACE_BEGIN(trace_start);
+		vmem->read(vmem, from - vmem->vaddr, (void*)(uintptr_t)to, size);
+		PARAM_TRACE_END(trace_start, PARAM_TRACE_VMEM_READ, vmem_ptr_to_index(vmem), 0, size);
+	} else {
+		memcpy((void *)(uintptr_t)to, (void *)(uintptr_t)from, size);
 	}
 
 	return NULL;
@@ -77,24 +254,20 @@ void * vmem_read(void * to, uint64_t from, uint32_t size) {
 
 void * vmem_cpy(uint64_t to, uint64_t from, uint32_t size) {
 
-	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
-
-		/* Write to VMEM */
-		if ((to >= vmem->vaddr) && (to + (uint64_t)size <= vmem->vaddr + vmem->size)) {
-			if (vmem->write) {
-				vmem->write(vmem, to - vmem->vaddr, (void*)(uintptr_t)from, size);
-				return NULL;
-			}
-		}
+	/* The first VMEM in section order that can take the write or serve the read, write first */
+	vmem_t * vmem_to = vmem_find(to, size, VMEM_FIND_WRITE);
+	vmem_t * vmem_from = vmem_find(from, size, VMEM_FIND_READ);
 
-		/* Read */
-		if ((from >= vmem->vaddr) && (from + (uint64_t)size <= vmem->vaddr + vmem->size)) {
-			if (vmem->read) {
-				vmem->read(vmem, from - vmem->vaddr, (void*)(uintptr_t)to, size);
-				return NULL;
-			}
-		}
+	/* Write to VMEM */
+	if (vmem_to && (vmem_from == NULL || vmem_to <= vmem_from)) {
+		vmem_to->write(vmem_to, to - vmem_to->vaddr, (void*)(uintptr_t)from, size);
+		return NULL;
+	}
 
+	/* Read */
+	if (vmem_from) {
+		vmem_from->read(vmem_from, from - vmem_from->vaddr, (void*)(uintptr_t)to, size);
+		return NULL;
 	}
 
 	/* If no VMEM found or nor read/write methods exists for the particular VMEM */
@@ -104,15 +277,8 @@ void * vmem_cpy(uint64_t to, uint64_t from, uint32_t size) {
 
 vmem_t * vmem_vaddr_to_vmem(uint64_t vaddr) {
 
-	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
-
-		/* Find VMEM from vaddr */
-		if ((vaddr >= vmem->vaddr) && (vaddr <= vmem->vaddr + vmem->size)) {
-			return vmem;
-		}
-	}
-
-	return NULL;
+	/* Find VMEM from vaddr, the end address is included */
+	return vmem_find(vaddr, 0, VMEM_FIND_ANY);
 }
 
 int vmem_flush(vmem_t *vmem) {
@@ -125,6 +291,55 @@ int vmem_flush(vmem_t *vmem) {
 	return res;
 }
 
+#if PARAM_TRACE > 0
+static uint32_t vmem_iov_length(const vmem_iovec_t * iov, int count) {
+	uint32_t len = 0;
+	for (int i = 0; i < count; i++)
+		len += iov[i].len;
+	return len;
+}
+#endif
+
+void vmem_readv(vmem_t * vmem, const vmem_iovec_t * iov, int count) {
+
+	PARAM_TRACE_BEGIN(trace_start);
+
+	if (vmem->readv) {
+		vmem->readv(vmem, iov, count);
+	} else if (vmem->read) {
+		for (int i = 0; i < count; i++)
+			vmem->read(vmem, iov[i].addr, iov[i].buf, iov[i].len);
+	} else {
+		for (int i = 0; i < count; i++)
+			memcpy(iov[i].buf, (void *)(uintptr_t)(vmem->vaddr + iov[i].addr), iov[i].len);
+	}
+
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_VMEM_READ, vmem_ptr_to_index(vmem), 0, vmem_iov_length(iov, count));
+}
+
+void vmem_writev(vmem_t * vmem, const vmem_iovec_t * iov, int count) {
+
+	PARAM_TRACE_BEGIN(trace_start);
+
+	if (vmem->writev) {
+		vmem->writev(vmem, iov, count);
+	} else if (vmem->write) {
+		for (int i = 0; i < count; i++)
+			vmem->write(vmem, iov[i].addr, iov[i].buf, iov[i].len);
+	} else {
+		for (int i = 0; i < count; i++)
+			memcpy((void *)(uintptr_t)(vmem->vaddr + iov[i].addr), iov[i].buf, iov[i].len);
+	}
+
+	PARAM_TRACE_END(trace_start, PARAM_TRACE_VMEM_WRITE, vmem_ptr_to_index(vmem), 0, vmem_iov_length(iov, count));
+}
+
+void * vmem_ram_map(vmem_t * vmem, uint64_t addr, uint32_t len, int flags) {
+	if (addr + len > vmem->size)
+		return NULL;
+	return (void *)(uintptr_t)(vmem->vaddr + addr);
+}
+
 vmem_t * vmem_index_to_ptr(int idx) {
 	return ((vmem_t *) &__start_vmem) + idx;
 }
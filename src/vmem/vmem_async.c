@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vmem/vmem.h>
+#include <vmem/vmem_async.h>
+
+#if PARAM_VMEM_ASYNC > 0
+#include <pthread.h>
+
+static pthread_mutex_t vmem_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vmem_async_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t vmem_async_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t vmem_async_once = PTHREAD_ONCE_INIT;
+
+/* Queue in submission order */
+static vmem_async_t * vmem_async_head = NULL;
+static vmem_async_t * vmem_async_tail = NULL;
+
+/* VMEM each worker is busy with */
+static vmem_t * vmem_async_active[PARAM_VMEM_ASYNC];
+static int vmem_async_workers = 0;
+#endif
+
+static void vmem_async_run(vmem_async_t * op) {
+	vmem_iovec_t iov = {
+		.addr = op->addr,
+		.buf = op->buf,
+		.len = op->len,
+	};
+	if (op->write) {
+		vmem_writev(op->vmem, &iov, 1);
+	} else {
+		vmem_readv(op->vmem, &iov, 1);
+	}
+}
+
+#if PARAM_VMEM_ASYNC > 0
+
+static int vmem_async_is_active(vmem_t * vmem) {
+	for (int i = 0; i < PARAM_VMEM_ASYNC; i++) {
+		if (vmem_async_active[i] == vmem)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Dequeue the oldest operation on a VMEM no worker is busy with.
+ * Older operations on the same VMEM would have been found first,
+ * so this keeps the order per VMEM. Must be called with lock held.
+ */
+static vmem_async_t * vmem_async_take(void) {
+
+	vmem_async_t * prev = NULL;
+	for (vmem_async_t * op = vmem_async_head; op != NULL; prev = op, op = op->next) {
+
+		if (vmem_async_is_active(op->vmem))
+			continue;
+
+		if (prev) {
+			prev->next = op->next;
+		} else {
+			vmem_async_head = op->next;
+		}
+		if (vmem_async_tail == op)
+			vmem_async_tail = prev;
+		return op;
+	}
+
+	return NULL;
+}
+
+static void * vmem_async_worker(void * arg) {
+
+	int slot = (intptr_t) arg;
+
+	pthread_mutex_lock(&vmem_async_lock);
+
+	while (1) {
+
+		vmem_async_t * op;
+		while ((op = vmem_async_take()) == NULL)
+			pthread_cond_wait(&vmem_async_work_cond, &vmem_async_lock);
+
+		vmem_async_active[slot] = op->vmem;
+		pthread_mutex_unlock(&vmem_async_lock);
+
+		vmem_async_run(op);
+
+		/* Once complete the op belongs to the caller again, so read it first */
+		vmem_async_callback_f callback = op->callback;
+		void * context = op->context;
+
+		pthread_mutex_lock(&vmem_async_lock);
+		vmem_async_active[slot] = NULL;
+
+		if (callback) {
+			pthread_mutex_unlock(&vmem_async_lock);
+			callback(op, context);
+			pthread_mutex_lock(&vmem_async_lock);
+		} else {
+			op->done = 1;
+			pthread_cond_broadcast(&vmem_async_done_cond);
+		}
+	}
+
+	return NULL;
+}
+
+static void vmem_async_start(void) {
+	for (int i = 0; i < PARAM_VMEM_ASYNC; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, vmem_async_worker, (void *)(intptr_t) i) == 0) {
+			pthread_detach(thread);
+			vmem_async_workers++;
+		}
+	}
+}
+
+#endif
+
+static void vmem_async_submit(vmem_async_t * op) {
+
+	op->next = NULL;
+	op->done = 0;
+
+#if PARAM_VMEM_ASYNC > 0
+	pthread_once(&vmem_async_once, vmem_async_start);
+
+	if (vmem_async_workers > 0) {
+		pthread_mutex_lock(&vmem_async_lock);
+		if (vmem_async_tail) {
+			vmem_async_tail->next = op;
+		} else {
+			vmem_async_head = op;
+		}
+		vmem_async_tail = op;
+		pthread_cond_signal(&vmem_async_work_cond);
+		pthread_mutex_unlock(&vmem_async_lock);
+		return;
+	}
+#endif
+
+	/* No workers, complete in the caller */
+	vmem_async_run(op);
+	op->done = 1;
+	if (op->callback)
+		op->callback(op, op->context);
+}
+
+void vmem_async_read(vmem_async_t * op, vmem_t * vmem, uint64_t addr, void * buf, uint32_t len, vmem_async_callback_f callback, void * context) {
+	op->vmem = vmem;
+	op->addr = addr;
+	op->buf = buf;
+	op->len = len;
+	op->write = 0;
+	op->callback = callback;
+	op->context = context;
+	vmem_async_submit(op);
+}
+
+void vmem_async_write(vmem_async_t * op, vmem_t * vmem, uint64_t addr, const void * buf, uint32_t len, vmem_async_callback_f callback, void * context) {
+	op->vmem = vmem;
+	op->addr = addr;
+	op->buf = (void *) buf;
+	op->len = len;
+	op->write = 1;
+	op->callback = callback;
+	op->context = context;
+	vmem_async_submit(op);
+}
+
+void vmem_async_wait(vmem_async_t * op) {
+#if PARAM_VMEM_ASYNC > 0
+	pthread_mutex_lock(&vmem_async_lock);
+	while (!op->done)
+		pthread_cond_wait(&vmem_async_done_cond, &vmem_async_lock);
+	pthread_mutex_unlock(&vmem_async_lock);
+#endif
+}
@@ -23,211 +23,310 @@ extern __attribute__((weak)) vmem_block_device_t __stop_vmem_bdevice;
 static uint32_t cache_read(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address, uintptr_t data, uint32_t length);
 static uint32_t cache_write(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address, uintptr_t data, uint32_t length);
 static void cache_flush(const vmem_block_driver_t *drv, vmem_block_cache_t *cache);
-static bool address_in_cache(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address);
 
-static bool address_in_cache(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address) {
+static void direct_read(const vmem_block_driver_t *drv, uint64_t address, uintptr_t data, uint32_t length) {
 
-    bool in_cache = false;
-    
-    if (cache->is_valid) {
-        uint64_t cache_start = ((uint64_t)cache->start_block * (uint64_t)drv->device->bsize);
-        if (address >= cache_start && address < (cache_start + cache->size)) {
-            in_cache = true;
+    uint32_t block_addr = (address / drv->device->bsize);
+    uint32_t unalign = (address % drv->device->bsize);
+    uint64_t addr = address;
+    int32_t res;
+    uint32_t len = 0;
+
+    /* If the starting address is not block aligned, we need to handle that special */
+    if (unalign) {
+        res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
+        if (res) { printf("Error, could no read from device '%s'\n", drv->device->name); }
+        /* Calculate the amount to move */
+        len = (drv->device->bsize - unalign);
+        if (len > length) {
+            len = length;
         }
+        /* Move the data from oneblock into the receiving buffer */
+        memcpy((void *)data, &drv->device->oneblock[unalign], len);
+        data += len;
+        addr += len;
     }
 
-    return in_cache;
-
-}
-
-static void cache_flush(const vmem_block_driver_t *drv, vmem_block_cache_t *cache) {
+    /* Read the most of what we can of whole blocks */
+    uint32_t nblocks = (length - len) / drv->device->bsize;
+    if (nblocks > 0) {
+        block_addr = addr / drv->device->bsize;
+        res = drv->api.read(drv, block_addr, nblocks, (void *)data);
+        if (res) { printf("Error, could no read from device '%s'\n", drv->device->name); }
+        data += (nblocks * drv->device->bsize);
+        addr += (nblocks * drv->device->bsize);
+    }
 
-    if (cache->is_modified && cache->is_valid) {
-        int32_t res;
-        //printf("::cache_flush() The cache is modified, write it to device\n");
-        res = drv->api.write(drv, cache->start_block, (cache->size / drv->device->bsize), cache->data);
-        if (res) {
-            printf("Error, could not write to block device '%s'\n", drv->device->name);
-        } else {
-            /* The cache is still valid, but now it is not modified anymore */
-            cache->is_modified = false;
+    /* Finally we must possibly read an unaligned block at the end */
+    if (addr < (address + length)) {
+        block_addr = addr / drv->device->bsize;
+        unalign = (address + length) % drv->device->bsize;
+        if (unalign) {
+            res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
+            if (res) { printf("Error, could no read from device '%s'\n", drv->device->name); }
+            /* Update the receiving buffer with the part from the oneblock we actually have to read */
+            memcpy((void *)data, &drv->device->oneblock[0], unalign);
         }
     }
-
 }
 
-static uint32_t cache_write(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address, uintptr_t data, uint32_t length) {
+static void direct_write(const vmem_block_driver_t *drv, uint64_t address, uintptr_t data, uint32_t length) {
 
     uint32_t block_addr = (address / drv->device->bsize);
     uint32_t unalign = (address % drv->device->bsize);
     uint64_t addr = address;
-    uint32_t size = 0;
-
-    //printf("::cache_write(%p,0x%"PRIX64",0x%"PRIXPTR",%"PRIu32")\n", drv, address, (uintptr_t)data, length);
+    int32_t res;
+    uint32_t len = 0;
+
+    if (unalign) {
+        /* We need to read a least one block, if we are not aligned */
+        res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
+        if (res) { printf("Error, could not read from device\n"); return; }
+        len = (drv->device->bsize - unalign);
+        if (len > length) {
+            len = length;
+        }
+        /* Update the part of the oneblock we actually need to write, and write it back */
+        memcpy(&drv->device->oneblock[unalign], (void *)data, len);
+        res = drv->api.write(drv, block_addr, 1, drv->device->oneblock);
+        if (res) { printf("Error , could not write to device\n"); return; }
+        data += len;
+        addr += len;
+    }
 
-    if (!cache && data != (uintptr_t)NULL && length > 0) {
-        int32_t res;
-        uint32_t len = 0;
+    /* Write the most part of what can be written directly as whole blocks */
+    uint32_t nblocks = (length - len) / drv->device->bsize;
+    if (nblocks > 0) {
+        block_addr = addr / drv->device->bsize;
+        res = drv->api.write(drv, block_addr, nblocks, (void *)data);
+        if (res) { printf("Error, could not write to device\n"); return; }
+        data += (nblocks * drv->device->bsize);
+        addr += (nblocks * drv->device->bsize);
+    }
 
+    /* Finally we must write any remaining parts */
+    if (addr < (address + length)) {
+        block_addr = addr / drv->device->bsize;
+        unalign = (address + length) % drv->device->bsize;
         if (unalign) {
-            /* We need to read a least one block, if we are not aligned */
             res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
-            if (res) { printf("Error, could not read from device\n"); return 0; }
-            len = (drv->device->bsize - unalign);
-            if (len > length) {
-                len = length;
-            }
+            if (res) { printf("Error, could not read from device\n"); return; }
             /* Update the part of the oneblock we actually need to write, and write it back */
-            memcpy(&drv->device->oneblock[unalign], (void *)data, len);
+            memcpy(&drv->device->oneblock[0], (void *)data, unalign);
             res = drv->api.write(drv, block_addr, 1, drv->device->oneblock);
-            if (res) { printf("Error , could not write to device\n"); return 0; }
-            data += len;
-            addr += len;
-        }
-        
-        /* Write the most part of what can be written directly as whole blocks */
-        uint32_t nblocks = (length - len) / drv->device->bsize;
-        if (nblocks > 0) {
-            block_addr = addr / drv->device->bsize;
-            res = drv->api.write(drv, block_addr, nblocks, (void *)data);
-            if (res) { printf("Error, could not read from device\n"); return 0; }
-            data += (nblocks * drv->device->bsize);
-            addr += (nblocks * drv->device->bsize);
+            if (res) { printf("Error , could not write to device\n"); return; }
         }
+    }
+}
 
-        /* Finally we must write any remaining parts */
-        if (addr < (address + length)) {
-            block_addr = addr / drv->device->bsize;
-            unalign = (address + length) % drv->device->bsize;
-            if (unalign) {
-                res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
-                if (res) { printf("Error, could not read from device\n"); return 0; }
-                /* Update the part of the oneblock we actually need to write, and write it back */
-                memcpy(&drv->device->oneblock[0], (void *)data, unalign);
-                res = drv->api.write(drv, block_addr, 1, drv->device->oneblock);
-                if (res) { printf("Error , could not write to device\n"); return 0; }
-                data += unalign;
-            }
+/* Set up the geometry on first use, returns false if the cache cannot serve this driver */
+static bool cache_bind(const vmem_block_driver_t *drv, vmem_block_cache_t *cache) {
+
+    /* Block numbers are per device, so any driver of the bound device can use the lines */
+    if (cache->device == drv->device) {
+        return (cache->sets > 0);
+    }
+    if (cache->device != NULL) {
+        /* Bound to another device, its block numbers would collide */
+        return false;
+    }
+
+    uint32_t nlines = cache->size / drv->device->bsize;
+    if (nlines > cache->max_lines) {
+        nlines = cache->max_lines;
+    }
+    if (cache->ways == 0 || cache->ways > nlines) {
+        cache->ways = (nlines < 255) ? nlines : 255;
+    }
+
+    cache->device = drv->device;
+    cache->sets = (cache->ways > 0) ? (nlines / cache->ways) : 0;
+    for (uint32_t i = 0; i < nlines; i++) {
+        cache->lines[i].is_valid = false;
+        cache->lines[i].is_modified = false;
+    }
+
+    return (cache->sets > 0);
+}
+
+static uint8_t *line_data(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, vmem_block_line_t *line) {
+    return &cache->data[(line - cache->lines) * drv->device->bsize];
+}
+
+static vmem_block_line_t *cache_find(vmem_block_cache_t *cache, uint32_t block) {
+
+    vmem_block_line_t *set = &cache->lines[(block % cache->sets) * cache->ways];
+    for (uint32_t way = 0; way < cache->ways; way++) {
+        if (set[way].is_valid && set[way].block == block) {
+            return &set[way];
         }
+    }
 
-        /* We wrote the entire length to the device */
-        size = length;
+    return NULL;
+}
+
+static int32_t cache_writeback(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, vmem_block_line_t *line) {
+
+    int32_t res = drv->api.write(drv, line->block, 1, line_data(drv, cache, line));
+    if (res) {
+        printf("Error, could not write to block device '%s'\n", drv->device->name);
     } else {
-        /* Normal cache handling, since the length are shorter than the cache size */
-        if (!address_in_cache(drv, cache, address)) {
-            //printf("::cache_write() Flush the cache and re-read from address 0x%"PRIX64"\n", address);
-            /* There is not a cache hit, so flush and read a new one */
-            cache_flush(drv, cache);
-            /* Read in the cache and ignore the return value */
-            (void)cache_read(drv, cache, address, (uintptr_t)NULL, 0);
+        line->is_modified = false;
+    }
+
+    return res;
+}
+
+/* Take the least recently used line of the set for block, NULL if the victim or block cannot be transferred */
+static vmem_block_line_t *cache_alloc(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint32_t block, bool fill) {
+
+    vmem_block_line_t *set = &cache->lines[(block % cache->sets) * cache->ways];
+    vmem_block_line_t *victim = &set[0];
+    for (uint32_t way = 0; way < cache->ways; way++) {
+        if (!set[way].is_valid) {
+            victim = &set[way];
+            break;
+        }
+        if (set[way].used < victim->used) {
+            victim = &set[way];
         }
+    }
+
+    if (victim->is_valid && victim->is_modified && cache_writeback(drv, cache, victim)) {
+        return NULL;
+    }
 
-        /* The address is within the cache and it is valid */
-        uint32_t offset = (((block_addr - cache->start_block) * drv->device->bsize) + unalign);
-
-        /* We need to adjust the amount we can actually write to the cache */
-        if ((length + offset) > cache->size) {
-            /* We are about to write more than the entire cache */
-            size = cache->size - offset;
-            /* Copy the portion we can fit */
-            memcpy(&cache->data[offset], (void *)data, size);
-            cache->is_modified = true;
-            /* Then flush it */
-            cache_flush(drv, cache);
-        } else {
-            size = length;
-            memcpy(&cache->data[offset], (void *)data, size);
-            cache->is_modified = true;
+    victim->is_valid = false;
+    if (fill && drv->api.read(drv, block, 1, line_data(drv, cache, victim))) {
+        printf("Error, could not read from block device '%s'\n", drv->device->name);
+        return NULL;
+    }
+
+    victim->block = block;
+    victim->is_valid = true;
+    victim->is_modified = false;
+    return victim;
+}
+
+/* Whole blocks from block on, within length, that are not in the cache */
+static uint32_t cache_miss_run(vmem_block_cache_t *cache, uint32_t block, uint32_t nblocks) {
+
+    uint32_t n = 0;
+    while (n < nblocks && cache_find(cache, block + n) == NULL) {
+        n++;
+    }
+
+    return n;
+}
+
+static void cache_flush(const vmem_block_driver_t *drv, vmem_block_cache_t *cache) {
+
+    if (cache->device != drv->device) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < cache->sets * cache->ways; i++) {
+        if (cache->lines[i].is_valid && cache->lines[i].is_modified) {
+            (void)cache_writeback(drv, cache, &cache->lines[i]);
         }
     }
 
-    /* Signal the actual length written */
-    return size;
 }
 
-static uint32_t cache_read(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address, uintptr_t data, uint32_t length) {
+static uint32_t cache_write(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address, uintptr_t data, uint32_t length) {
 
-    uint32_t block_addr = (address / drv->device->bsize);
-    uint32_t unalign = (address % drv->device->bsize);
-    uint32_t size = 0;
-    uint64_t addr = address;
+    uint32_t bsize = drv->device->bsize;
+    uint32_t block_addr = (address / bsize);
+    uint32_t unalign = (address % bsize);
 
-    //printf("::cache_read(%p,0x%"PRIX64",%"PRIu32")\n", drv, address, (length ? (*length) : 0));
+    //printf("::cache_write(%p,0x%"PRIX64",0x%"PRIXPTR",%"PRIu32")\n", drv, address, (uintptr_t)data, length);
 
-    if (!address_in_cache(drv, cache, address)) {
-        //printf("::cache_read() Address not in cache, read from device\n");
-        int32_t res;
-        uint32_t len = 0;
+    if (!cache || !cache_bind(drv, cache)) {
+        direct_write(drv, address, data, length);
+        /* We wrote the entire length to the device */
+        return length;
+    }
 
-        /* If the starting address is not block aligned, we need to handle that special */
-        if (unalign) {
-            res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
-            if (res) { printf("Error, could no read from device '%s'\n", drv->device->name); }
-            /* Calculate the amount to move */
-            len = (drv->device->bsize - unalign);
-            if (len > length) {
-                len = length;
+    uint32_t size = bsize - unalign;
+    if (size > length) {
+        size = length;
+    }
+
+    vmem_block_line_t *line = cache_find(cache, block_addr);
+    if (line) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+
+        /* Write runs of whole uncached blocks around the cache, so streaming does not evict it */
+        uint32_t nblocks = (unalign == 0) ? cache_miss_run(cache, block_addr, length / bsize) : 0;
+        if (nblocks > 1) {
+            if (drv->api.write(drv, block_addr, nblocks, (void *)data)) {
+                printf("Error, could not write to block device '%s'\n", drv->device->name);
             }
-            /* Move the data from oneblock into the receiving buffer */
-            memcpy((void *)data, &drv->device->oneblock[unalign], len);
-            data += len;
-            addr += len;
+            return nblocks * bsize;
         }
 
-        /* Read the most of what we can of whole blocks */
-        uint32_t nblocks = (length - len) / drv->device->bsize;
-        if (nblocks > 0) {
-            block_addr = addr / drv->device->bsize;
-            res = drv->api.read(drv, block_addr, nblocks, (void *)data);
-            if (res) { printf("Error, could no read from device '%s'\n", drv->device->name); }
-            data += (nblocks * drv->device->bsize);
-            addr += (nblocks * drv->device->bsize);
+        /* A whole block is overwritten, so there is no need to read it first */
+        line = cache_alloc(drv, cache, block_addr, (size < bsize));
+        if (line == NULL) {
+            direct_write(drv, address, data, size);
+            return size;
         }
+    }
 
-        /* Finally we must possibly read an unaligned block at the end */
-        if (addr < (address + length)) {
-            block_addr = addr / drv->device->bsize;
-            unalign = (address + length) % drv->device->bsize;
-            if (unalign) {
-                res = drv->api.read(drv, block_addr, 1, drv->device->oneblock);
-                if (res) { printf("Error, could no read from device '%s'\n", drv->device->name); }
-                /* Update the receiving buffer with the part from the oneblock we actually have to read */
-                memcpy((void *)data, &drv->device->oneblock[0], unalign);
-                data += unalign;
-            }
-        }
+    line->used = ++cache->clock;
+    memcpy(&line_data(drv, cache, line)[unalign], (void *)data, size);
+    line->is_modified = true;
+
+    /* Signal the actual length written */
+    return size;
+}
 
+static uint32_t cache_read(const vmem_block_driver_t *drv, vmem_block_cache_t *cache, uint64_t address, uintptr_t data, uint32_t length) {
+
+    uint32_t bsize = drv->device->bsize;
+    uint32_t block_addr = (address / bsize);
+    uint32_t unalign = (address % bsize);
+
+    //printf("::cache_read(%p,0x%"PRIX64",%"PRIu32")\n", drv, address, length);
+
+    if (!cache || !cache_bind(drv, cache)) {
+        direct_read(drv, address, data, length);
         /* We read the entire length from the device */
+        return length;
+    }
+
+    uint32_t size = bsize - unalign;
+    if (size > length) {
         size = length;
+    }
+
+    vmem_block_line_t *line = cache_find(cache, block_addr);
+    if (line) {
+        cache->hits++;
     } else {
-        /* Normal cache handling, since the length are shorter than the cache size */
-        if (!address_in_cache(drv, cache, address)) {
-            //printf("::cache_read() Address not in cache, read from device\n");
-            int32_t res;
-            /* The current block is outside the cache or the cache is invalid */
-            res = drv->api.read(drv, block_addr, (cache->size / drv->device->bsize), cache->data);
-            if (res) {
+        cache->misses++;
+
+        /* Read runs of whole uncached blocks around the cache, in one device transfer */
+        uint32_t nblocks = (unalign == 0) ? cache_miss_run(cache, block_addr, length / bsize) : 0;
+        if (nblocks > 1) {
+            if (drv->api.read(drv, block_addr, nblocks, (void *)data)) {
                 printf("Error, could not read from block device '%s'\n", drv->device->name);
-                return 0;
             }
-            cache->is_valid = true;
-            cache->is_modified = false;
-            cache->start_block = block_addr;
-        }
-
-        uint32_t offset = (((block_addr - cache->start_block) * drv->device->bsize) + unalign);
-
-        size = (cache->size - offset);
-        if (size > length) {
-            size = length;
+            return nblocks * bsize;
         }
 
-        if (data != 0) {
-            /* Now copy the data from the cache into the destination */
-            memcpy((void *)data, &cache->data[offset], size);
+        line = cache_alloc(drv, cache, block_addr, true);
+        if (line == NULL) {
+            direct_read(drv, address, data, size);
+            return size;
         }
     }
 
+    line->used = ++cache->clock;
+    memcpy((void *)data, &line_data(drv, cache, line)[unalign], size);
+
     /* Return the size of the data just read from the cache */
     return size;
 }
@@ -289,7 +388,7 @@ int vmem_block_flush(vmem_t * vmem) {
     if (vmem->type == VMEM_TYPE_BLOCK) {
         vmem_block_region_t *region = (vmem_block_region_t *)vmem->driver;
         if (region->cache) {
-            /* If the region has a cache object attached, flush it */
+            /* If the region has a cache object attached, flush it, shared caches write back every region */
             cache_flush(region->driver, region->cache);
         }
         res = 0;
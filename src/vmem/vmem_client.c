@@ -341,6 +341,123 @@ int vmem_ring_download(int node, int timeout, const char * vmem_name, int offset
 
 }
 
+/* One request, *rearm is set to the next sequence number if the server ended a follow slice */
+static int vmem_ring_request_once(int node, int timeout, const char * vmem_name, int from, uint8_t flags, uint32_t count, int follow, char * dataout, uint32_t size, vmem_ring_entry_f callback, void * context, int version, int * stop, uint32_t * rearm, int * rearmed) {
+
+	csp_conn_t * conn = csp_connect(CSP_PRIO_HIGH, node, VMEM_PORT_SERVER, timeout, CSP_O_RDP | CSP_O_CRC32);
+	if (conn == NULL)
+		return -1;
+
+	csp_packet_t * packet = csp_buffer_get(sizeof(vmem_request_t));
+	if (packet == NULL) {
+		csp_close(conn);
+		return -1;
+	}
+
+	vmem_request_t * request = (void *) packet->data;
+	request->version = version;
+	request->type = follow ? VMEM_SERVER_RING_FOLLOW : VMEM_SERVER_RING_BATCH;
+	strncpy(request->ring_range.vmem_name, vmem_name, 5);
+	request->ring_range.from = htobe32((uint32_t) from);
+	request->ring_range.count = htobe32(count);
+	request->ring_range.flags = flags;
+	packet->length = sizeof(vmem_request_t);
+
+	csp_send(conn, packet);
+
+	int entries = 0;
+	*rearmed = 0;
+	while (!abort && (count == 0 || (uint32_t) entries < count)) {
+
+		/* Entry header, a follow may be idle for up to VMEM_SERVER_FOLLOW_SLICE */
+		packet = csp_read(conn, follow ? VMEM_SERVER_FOLLOW_SLICE + timeout : timeout);
+		if (packet == NULL)
+			break;
+		if (packet->length != sizeof(vmem_ring_entry_t)) {
+			csp_buffer_free(packet);
+			break;
+		}
+		vmem_ring_entry_t * entry = (void *) packet->data;
+		uint32_t seq = be32toh(entry->seq);
+		uint32_t length = be32toh(entry->length);
+		csp_buffer_free(packet);
+
+		if (length == VMEM_RING_ENTRY_REARM) {
+			*rearm = seq;
+			*rearmed = 1;
+			break;
+		}
+
+		/* Data, entries larger than the buffer are truncated */
+		uint32_t received = 0;
+		while (received < length) {
+			packet = csp_read(conn, timeout);
+			if (packet == NULL)
+				break;
+			if (received < size)
+				memcpy(dataout + received, packet->data, VMEM_MIN(packet->length, size - received));
+			received += packet->length;
+			csp_buffer_free(packet);
+		}
+		if (received != length) {
+			/* Cut short, the server stops an entry that is overwritten while it is sent */
+			if (follow) {
+				*rearm = seq;
+				*rearmed = 1;
+			}
+			break;
+		}
+
+		entries++;
+		if (callback(seq, dataout, VMEM_MIN(length, size), context) != 0) {
+			*stop = 1;
+			break;
+		}
+	}
+
+	csp_close(conn);
+
+	return entries;
+}
+
+static int vmem_ring_request_range(int node, int timeout, const char * vmem_name, int from, uint32_t count, int follow, char * dataout, uint32_t size, vmem_ring_entry_f callback, void * context, int version) {
+
+	abort = 0;
+
+	int stop = 0;
+	uint32_t rearm;
+	int rearmed;
+	int entries = vmem_ring_request_once(node, timeout, vmem_name, from, 0, count, follow, dataout, size, callback, context, version, &stop, &rearm, &rearmed);
+	if (entries < 0)
+		return -1;
+
+	/* The server ends a follow after each slice, continue where it stopped until idle for VMEM_SERVER_TIMEOUT */
+	uint32_t last_entry = csp_get_ms();
+	while (follow && rearmed && !stop && !abort) {
+		int received = vmem_ring_request_once(node, timeout, vmem_name, (int) rearm, VMEM_RING_RANGE_SEQ, (count == 0) ? 0 : count - entries, follow, dataout, size, callback, context, version, &stop, &rearm, &rearmed);
+		if (received < 0)
+			break;
+		entries += received;
+		if (received > 0) {
+			last_entry = csp_get_ms();
+		} else if (csp_get_ms() - last_entry >= VMEM_SERVER_TIMEOUT) {
+			break;
+		}
+	}
+
+	return entries;
+}
+
+int vmem_ring_download_range(int node, int timeout, const char * vmem_name, int from, int to, char * dataout, uint32_t size, vmem_ring_entry_f callback, void * context, int version) {
+	if (to <= from)
+		return 0;
+	return vmem_ring_request_range(node, timeout, vmem_name, from, to - from, 0, dataout, size, callback, context, version);
+}
+
+int vmem_ring_follow(int node, int timeout, const char * vmem_name, int from, char * dataout, uint32_t size, vmem_ring_entry_f callback, void * context, int version) {
+	return vmem_ring_request_range(node, timeout, vmem_name, from, 0, 1, dataout, size, callback, context, version);
+}
+
 static csp_packet_t * vmem_client_list_get(int node, int timeout, int version) {
 
 	csp_conn_t * conn = csp_connect(CSP_PRIO_HIGH, node, VMEM_PORT_SERVER, timeout, CSP_O_CRC32);
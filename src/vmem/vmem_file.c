@@ -7,6 +7,9 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csp/arch/csp_time.h>
 #include <vmem/vmem.h>
 #include <vmem/vmem_file.h>
 
@@ -23,23 +26,210 @@ void vmem_file_init(vmem_t * vmem) {
 
 }
 
+static void vmem_file_lock(uint8_t * lock) {
+	while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE));
+}
+
+static void vmem_file_unlock(uint8_t * lock) {
+	__atomic_clear(lock, __ATOMIC_RELEASE);
+}
+
+/* Add [start, end) to the dirty ranges, must be called with lock held */
+static void vmem_file_mark(vmem_file_driver_t * drv, uint32_t start, uint32_t end) {
+
+	if (drv->dirty_count == 0)
+		drv->dirty_since = csp_get_ms();
+
+	while (1) {
+
+		/* Absorb every range overlapping or touching the new one */
+		for (int i = 0; i < drv->dirty_count; ) {
+			if (drv->dirty[i].start <= end && start <= drv->dirty[i].end) {
+				start = VMEM_MIN(start, drv->dirty[i].start);
+				end = VMEM_MAX(end, drv->dirty[i].end);
+				drv->dirty[i] = drv->dirty[--drv->dirty_count];
+			} else {
+				i++;
+			}
+		}
+
+		if (drv->dirty_count < VMEM_FILE_DIRTY_RANGES)
+			break;
+
+		/* Full, widen to the closest range and absorb again */
+		int closest = 0;
+		uint32_t closest_gap = UINT32_MAX;
+		for (int i = 0; i < drv->dirty_count; i++) {
+			uint32_t gap = (drv->dirty[i].end < start) ? start - drv->dirty[i].end : drv->dirty[i].start - end;
+			if (gap < closest_gap) {
+				closest_gap = gap;
+				closest = i;
+			}
+		}
+		start = VMEM_MIN(start, drv->dirty[closest].start);
+		end = VMEM_MAX(end, drv->dirty[closest].end);
+	}
+
+	drv->dirty[drv->dirty_count].start = start;
+	drv->dirty[drv->dirty_count].end = end;
+	drv->dirty_count++;
+}
+
+static uint32_t vmem_file_dirty_bytes(vmem_file_driver_t * drv) {
+	uint32_t bytes = 0;
+	for (int i = 0; i < drv->dirty_count; i++)
+		bytes += drv->dirty[i].end - drv->dirty[i].start;
+	return bytes;
+}
+
+static int vmem_file_write_all(int fd, const uint8_t * data, uint32_t len, uint32_t offset) {
+	while (len > 0) {
+		ssize_t written = pwrite(fd, data, len, offset);
+		if (written <= 0)
+			return -1;
+		data += written;
+		offset += written;
+		len -= written;
+	}
+	return 0;
+}
+
+/* Crash safe: the file holds either the old or the new image, never a mix */
+static int vmem_file_replace(vmem_t * vmem, vmem_file_driver_t * drv) {
+
+	char tmpname[strlen(drv->filename) + 5];
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", drv->filename);
+
+	int fd = open(tmpname, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		printf("Failed to open file %s\n", tmpname);
+		return -1;
+	}
+
+	int res = vmem_file_write_all(fd, drv->physaddr, vmem->size, 0);
+	if (res == 0)
+		res = fsync(fd);
+	close(fd);
+
+	if (res == 0)
+		res = rename(tmpname, drv->filename);
+
+	return (res == 0) ? 0 : -1;
+}
+
+int vmem_file_flush(vmem_t * vmem) {
+
+	vmem_file_driver_t * drv = vmem->driver;
+
+	/* Take the dirty ranges, writes meanwhile start a new set */
+	vmem_file_lock(&drv->lock);
+	int count = drv->dirty_count;
+	vmem_file_range_t dirty[VMEM_FILE_DIRTY_RANGES];
+	memcpy(dirty, drv->dirty, count * sizeof(vmem_file_range_t));
+	drv->dirty_count = 0;
+	vmem_file_unlock(&drv->lock);
+
+	if (count == 0)
+		return 0;
+
+	/* A sync can take long, so writers waiting for it sleep instead of spinning */
+	pthread_mutex_lock(&drv->io_lock);
+
+	int res = 0;
+	if (drv->sync == VMEM_FILE_SYNC_ATOMIC) {
+		res = vmem_file_replace(vmem, drv);
+	} else {
+
+		if (drv->fd == 0) {
+			int fd = open(drv->filename, O_CREAT | O_RDWR, 0644);
+			if (fd < 0) {
+				printf("Failed to open file %s\n", drv->filename);
+				res = -1;
+			} else {
+				drv->fd = fd + 1;
+			}
+		}
+
+		for (int i = 0; i < count && res == 0; i++) {
+			res = vmem_file_write_all(drv->fd - 1, (uint8_t *) drv->physaddr + dirty[i].start, dirty[i].end - dirty[i].start, dirty[i].start);
+		}
+
+		if (res == 0 && drv->sync == VMEM_FILE_SYNC_FSYNC)
+			res = fdatasync(drv->fd - 1);
+	}
+
+	pthread_mutex_unlock(&drv->io_lock);
+
+	if (res != 0) {
+		/* Keep it dirty for the next attempt */
+		vmem_file_lock(&drv->lock);
+		for (int i = 0; i < count; i++)
+			vmem_file_mark(drv, dirty[i].start, dirty[i].end);
+		vmem_file_unlock(&drv->lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+void vmem_file_flush_expired(void) {
+
+	uint32_t now = csp_get_ms();
+
+	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
+
+		/* VMEM_TYPE_FILE is shared with vmem_mmap, so check the driver */
+		if (vmem->write != vmem_file_write)
+			continue;
+
+		vmem_file_driver_t * drv = vmem->driver;
+		if (drv->flush_interval == 0 || drv->dirty_count == 0)
+			continue;
+
+		if (now - drv->dirty_since >= drv->flush_interval)
+			vmem_file_flush(vmem);
+	}
+}
+
 void vmem_file_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t len) {
 	memcpy(dataout, ((vmem_file_driver_t *) vmem->driver)->physaddr + addr, len);
 }
 
 void vmem_file_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len) {
-	memcpy(((vmem_file_driver_t *) vmem->driver)->physaddr + addr, datain, len);
+	vmem_iovec_t iov = {
+		.addr = addr,
+		.buf = (void *) datain,
+		.len = len,
+	};
+	vmem_file_writev(vmem, &iov, 1);
+}
 
-	/* Flush back to file */
-	FILE * stream = fopen(((vmem_file_driver_t *) vmem->driver)->filename, "w+");
-	if (stream == NULL) {
-		printf("Failed to open file %s\n", ((vmem_file_driver_t *) vmem->driver)->filename);
-		return;
-	}
-	int written = fwrite(((vmem_file_driver_t *) vmem->driver)->physaddr, 1, vmem->size, stream);
-	(void) written;
-	//printf("Wrote %d bytes to %s\n", written, ((vmem_file_driver_t *) vmem->driver)->filename);
-	fclose(stream);
+void vmem_file_readv(vmem_t * vmem, const vmem_iovec_t * iov, int count) {
+	for (int i = 0; i < count; i++)
+		memcpy(iov[i].buf, ((vmem_file_driver_t *) vmem->driver)->physaddr + iov[i].addr, iov[i].len);
 }
 
+void vmem_file_writev(vmem_t * vmem, const vmem_iovec_t * iov, int count) {
+
+	vmem_file_driver_t * drv = vmem->driver;
+
+	vmem_file_lock(&drv->lock);
+	for (int i = 0; i < count; i++) {
+		memcpy(drv->physaddr + iov[i].addr, iov[i].buf, iov[i].len);
+		if (iov[i].len > 0)
+			vmem_file_mark(drv, iov[i].addr, iov[i].addr + iov[i].len);
+	}
+	int flush = vmem_file_dirty_bytes(drv) >= drv->dirty_limit;
+	vmem_file_unlock(&drv->lock);
 
+	/* All segments reach the file in one flush */
+	if (flush)
+		vmem_file_flush(vmem);
+}
+
+/* Stores must go through write, which tracks the dirty ranges */
+void * vmem_file_map(vmem_t * vmem, uint64_t addr, uint32_t len, int flags) {
+	if ((flags & VMEM_MAP_WRITE) || addr + len > vmem->size)
+		return NULL;
+	return ((vmem_file_driver_t *) vmem->driver)->physaddr + addr;
+}
@@ -26,3 +26,38 @@ void vmem_fram_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t
 	fram_write_data(((uintptr_t) ((vmem_fram_driver_t*) vmem->driver)->fram_addr) + (uintptr_t)addr, datain, len);
 }
 
+/**
+ * Segments that follow each other both in FRAM and in memory are merged,
+ * so a gathered array or struct becomes a single bus transaction.
+ */
+static int vmem_fram_run(const vmem_iovec_t * iov, int count, uint32_t * len) {
+	int n = 1;
+	*len = iov[0].len;
+	while (n < count
+			&& iov[n].addr == iov[0].addr + *len
+			&& (uint8_t *) iov[n].buf == (uint8_t *) iov[0].buf + *len) {
+		*len += iov[n].len;
+		n++;
+	}
+	return n;
+}
+
+void vmem_fram_readv(vmem_t * vmem, const vmem_iovec_t * iov, int count) {
+	int i = 0;
+	while (i < count) {
+		uint32_t len;
+		int n = vmem_fram_run(&iov[i], count - i, &len);
+		vmem_fram_read(vmem, iov[i].addr, iov[i].buf, len);
+		i += n;
+	}
+}
+
+void vmem_fram_writev(vmem_t * vmem, const vmem_iovec_t * iov, int count) {
+	int i = 0;
+	while (i < count) {
+		uint32_t len;
+		int n = vmem_fram_run(&iov[i], count - i, &len);
+		vmem_fram_write(vmem, iov[i].addr, iov[i].buf, len);
+		i += n;
+	}
+}
@@ -1,3 +1,6 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* mremap */
+#endif
 #include <string.h>
 #include <stdio.h>
 #include <vmem/vmem_mmap.h>
@@ -6,58 +9,146 @@
 #include <unistd.h>
 #include <fcntl.h>
 
-static void ensure_init(vmem_mmap_driver_t *drv, uint64_t *size)
+/* Map capacity bytes of the open file, or remap the existing mapping to it */
+static int vmem_mmap_remap(vmem_mmap_driver_t *drv, uint64_t capacity)
 {
+	void *map;
+
+#ifdef MREMAP_MAYMOVE
+	if (drv->physaddr)
+		map = mremap(drv->physaddr, drv->capacity, capacity, MREMAP_MAYMOVE);
+	else
+#endif
+	{
+		int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+		if (drv->flags & VMEM_MMAP_POPULATE)
+			flags |= MAP_POPULATE;
+#endif
+		map = mmap(0, capacity, PROT_WRITE|PROT_READ, flags, drv->fd - 1, 0);
+		if (map != MAP_FAILED && drv->physaddr)
+			munmap(drv->physaddr, drv->capacity);
+	}
+
+	if (map == MAP_FAILED)
+	{
+		perror("mmap");
+		return -1;
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (drv->flags & VMEM_MMAP_HUGEPAGE)
+		madvise(map, capacity, MADV_HUGEPAGE);
+#endif
+
+	drv->physaddr = map;
+	drv->capacity = capacity;
+	return 0;
+}
+
+static void ensure_init(vmem_t *vmem)
+{
+	vmem_mmap_driver_t *drv = (vmem_mmap_driver_t *)vmem->driver;
+
 	if (0 == drv->physaddr)
 	{
-		int fd;
-		if ((fd = open(drv->filename, O_CREAT|O_RDWR, 0600)) == -1)
+		if (drv->fd == 0)
 		{
-			perror("open");
-			return;
+			int fd;
+			if ((fd = open(drv->filename, O_CREAT|O_RDWR, 0600)) == -1)
+			{
+				perror("open");
+				return;
+			}
+			drv->fd = fd + 1;
 		}
-		uint32_t _size = (uint32_t)(*size);
-		long cur_size = lseek(fd, 0, SEEK_END);
-		if (cur_size < _size) {
+		off_t cur_size = lseek(drv->fd - 1, 0, SEEK_END);
+		if (cur_size < 0)
+			return;
+		if ((uint64_t)cur_size < vmem->size) {
 			/* Grow the file if needed */
-			if (ftruncate(fd, _size) != 0) {
-				close(fd);
+			if (ftruncate(drv->fd - 1, vmem->size) != 0) {
 				perror("ftruncate");
 				return;
 			}
-		} else {
+		} else if (vmem->size != (uint64_t)cur_size) {
 			/* File size is >= requested size, don't destroy/truncate data but adjust the driver size instead */
-			*size = (uint64_t)cur_size;
-		}
-		drv->physaddr = mmap(0, *size, PROT_WRITE|PROT_READ, MAP_SHARED, fd, 0);
-		close(fd);
-		if (drv->physaddr == MAP_FAILED)
-		{
-			perror("mmap");
-			return;
+			vmem->size = (uint64_t)cur_size;
+			vmem_index_invalidate();
 		}
+
+		/* mmap of zero bytes fails, keep at least a page mapped. The file is not
+		 * extended to cover it, only bytes below vmem->size are ever touched */
+		uint64_t capacity = VMEM_MAX(vmem->size, (uint64_t)sysconf(_SC_PAGESIZE));
+		vmem_mmap_remap(drv, capacity);
 	}
 }
 
+/* Extend the logical size to end, at least doubling the mapping when it is exceeded */
+static int vmem_mmap_grow(vmem_t *vmem, uint64_t end)
+{
+	vmem_mmap_driver_t *drv = (vmem_mmap_driver_t *)vmem->driver;
+
+	if (end > drv->capacity && vmem_mmap_remap(drv, VMEM_MAX(end, drv->capacity * 2)) != 0)
+		return -1;
+
+	/* The file stays at the logical size, and must cover the new bytes before they are
+	 * touched, pages beyond its end raise SIGBUS */
+	if (ftruncate(drv->fd - 1, end) != 0) {
+		perror("ftruncate");
+		return -1;
+	}
+
+	vmem->size = end;
+	vmem_index_invalidate();
+	return 0;
+}
+
 void vmem_mmap_read(vmem_t *vmem, uint64_t addr, void *dataout, uint32_t len)
 {
 	vmem_mmap_driver_t *drv = (vmem_mmap_driver_t *)vmem->driver;
-	ensure_init(drv, &vmem->size);
-	memcpy(dataout, ((vmem_mmap_driver_t *)vmem->driver)->physaddr + addr, len);
+	ensure_init(vmem);
+	if (drv->physaddr == 0)
+		return;
+	memcpy(dataout, drv->physaddr + addr, len);
 }
 
 void vmem_mmap_write(vmem_t *vmem, uint64_t addr, const void *datain, uint32_t len)
 {
 	vmem_mmap_driver_t *drv = (vmem_mmap_driver_t *)vmem->driver;
-	ensure_init(drv, &vmem->size);
-	if ((addr + len) >  vmem->size) {
-		// Grow the file...
-		if (msync(drv->physaddr, vmem->size, MS_SYNC|MS_INVALIDATE) == -1) {
-			perror("Could not sync the file to disk");
+	ensure_init(vmem);
+	if (drv->physaddr == 0)
+		return;
+	if ((addr + len) > vmem->size && vmem_mmap_grow(vmem, addr + len) != 0)
+		return;
+	memcpy(drv->physaddr + addr, datain, len);
+}
+
+int vmem_mmap_flush(vmem_t *vmem)
+{
+	vmem_mmap_driver_t *drv = (vmem_mmap_driver_t *)vmem->driver;
+	if (drv->physaddr == 0)
+		return 0;
+
+	int res = 0;
+
+	if (drv->sync != VMEM_MMAP_SYNC_NONE && vmem->size > 0)
+	{
+		if (msync(drv->physaddr, vmem->size, (drv->sync == VMEM_MMAP_SYNC_SYNC) ? MS_SYNC : MS_ASYNC) == -1) {
+			perror("msync");
+			res = -1;
 		}
-		vmem->size = (addr + len);
-		drv->physaddr = 0;
-		ensure_init(drv, &vmem->size);
 	}
-	memcpy(drv->physaddr + addr, datain, len);
+
+	return res;
+}
+
+/* The mapping is shared with the file, so stores need no flush. Growing the file is left to write */
+void * vmem_mmap_map(vmem_t *vmem, uint64_t addr, uint32_t len, int flags)
+{
+	vmem_mmap_driver_t *drv = (vmem_mmap_driver_t *)vmem->driver;
+	ensure_init(vmem);
+	if (drv->physaddr == 0 || addr + len > vmem->size)
+		return NULL;
+	return drv->physaddr + addr;
 }
@@ -7,61 +7,134 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <vmem/vmem.h>
 #include <vmem/vmem_ring.h>
 
+#define RING_META_SIZE(driver) (((driver)->entries + 2) * sizeof(uint32_t))
+
+/* Guards head, tail and appended against followers, and wakes them on append */
+static pthread_mutex_t vmem_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vmem_ring_cond = PTHREAD_COND_INITIALIZER;
+static int vmem_ring_waiters = 0;
+
+/* Map the whole file, growing it to full size. Returns 1 if the file was empty */
+static int vmem_ring_map(vmem_ring_driver_t * driver) {
+
+    if (driver->map)
+        return 0;
+
+    size_t size = RING_META_SIZE(driver) + driver->data_size;
+
+    int fd = open(driver->filename, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* Files written by the stdio version only extend as far as the data written */
+    if ((size_t) st.st_size < size && ftruncate(fd, size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    driver->map = map;
+    return (st.st_size == 0) ? 1 : 0;
+}
+
 void vmem_ring_init(vmem_t * vmem) {
     vmem_ring_driver_t * driver = (vmem_ring_driver_t *) vmem->driver;
 
-	FILE * stream = fopen(driver->filename, "r+");
-	if (stream == NULL) {
-        stream = fopen(driver->filename, "w+");
-        fwrite(&driver->tail, sizeof(uint32_t), 1, stream);
-        fwrite(&driver->head, sizeof(uint32_t), 1, stream);
-        fwrite(driver->offsets, sizeof(uint32_t), driver->entries, stream);
-		return;
+    int created = vmem_ring_map(driver);
+    if (created < 0)
+        return;
+
+    uint32_t * meta = (uint32_t *) driver->map;
+    if (created) {
+        meta[0] = driver->tail;
+        meta[1] = driver->head;
+        memcpy(&meta[2], driver->offsets, driver->entries * sizeof(uint32_t));
+    } else {
+        driver->tail = meta[0];
+        driver->head = meta[1];
+        memcpy(driver->offsets, &meta[2], driver->entries * sizeof(uint32_t));
     }
-    
-    fseek(stream, 0, SEEK_SET);
-	fread(&driver->tail, sizeof(uint32_t), 1, stream);
-	fread(&driver->head, sizeof(uint32_t), 1, stream);
-    fread(driver->offsets, sizeof(uint32_t), driver->entries, stream);
-	fclose(stream);
+    driver->committed_head = driver->head;
+    driver->uncommitted = 0;
+    driver->appended = 0;
+}
+
+int vmem_ring_commit(vmem_t * vmem) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *) vmem->driver;
+
+    if (driver->map == NULL)
+        return -1;
+
+    uint32_t * meta = (uint32_t *) driver->map;
+    uint32_t * offsets = (uint32_t *) driver->offsets;
+
+    /* Offsets of the new entries first, an entry ends at the offset of the next */
+    uint32_t from = driver->committed_head;
+    uint32_t count = (driver->uncommitted < driver->entries) ? driver->uncommitted : driver->entries;
+    for (uint32_t i = 0; i <= count; i++) {
+        uint32_t idx = (from + i) % driver->entries;
+        meta[2 + idx] = offsets[idx];
+    }
+
+    /* Then the commit point */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    meta[0] = driver->tail;
+    meta[1] = driver->head;
+
+    driver->committed_head = driver->head;
+    driver->uncommitted = 0;
+
+    if (driver->sync != VMEM_RING_SYNC_NONE) {
+        size_t size = RING_META_SIZE(driver) + driver->data_size;
+        if (msync(driver->map, size, (driver->sync == VMEM_RING_SYNC_SYNC) ? MS_SYNC : MS_ASYNC) != 0)
+            return -1;
+    }
+
+    return 0;
 }
 
 // Offset specifies the offset within the vmem ring buffer where the read should begin
-void vmem_ring_read(vmem_t * vmem, uint32_t offset, void * dataout, uint32_t len) {
+void vmem_ring_read(vmem_t * vmem, uint64_t addr, void * dataout, uint32_t len) {
 
     vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
 
-    int wraparound = (offset + len) > driver->data_size;
+    if (vmem_ring_map(driver) < 0)
+        return;
 
-    FILE *stream = fopen(driver->filename, "r+");
-    if (stream == NULL)
-		return;
-    
-    /* Adjust read address and length in case of wraparound */
-    uint32_t driver_meta_size = (driver->entries + 2) * sizeof(uint32_t); // offset with initial metadata
-    fseek(stream, offset + driver_meta_size, SEEK_SET);
-    if (wraparound) {
+    uint32_t offset = addr % driver->data_size;
+    if (len > driver->data_size)
+        len = driver->data_size;
+
+    uint8_t * data = driver->map + RING_META_SIZE(driver);
+
+    /* Split the read in case of wraparound */
+    if (offset + len > driver->data_size) {
         uint32_t len_fst = driver->data_size - offset;
-        uint32_t len_snd = (driver->data_size + offset) % driver->data_size;
-        fread(dataout, len_fst, 1, stream); // read first part
-        fseek(stream, driver_meta_size, SEEK_SET);
-        fread((char *)dataout + len_fst, len_snd, 1, stream); // read second part
+        uint32_t len_snd = len - len_fst;
+        memcpy(dataout, data + offset, len_fst);
+        memcpy((char *)dataout + len_fst, data, len_snd);
     } else {
-        // This could also be fread(dataout, len, 1, stream), difference: https://stackoverflow.com/questions/295994/what-is-the-rationale-for-fread-fwrite-taking-size-and-count-as-arguments
-        fread(dataout, 1, len, stream);
+        memcpy(dataout, data + offset, len);
     }
-    fclose(stream);
-}
-
-static int overtake(int before, int target, int after) 
-{
-    if (before < target && target < after) return 1; // Simple overtake
-    if (target < before && target < after && after < before) return 1; // After wraparound overtake
-    if (before < target && after < target && after < before) return 1; // Before wraparound overtake
-    return 0;
 }
 
 static int next(int current, int max) 
@@ -69,65 +142,168 @@ static int next(int current, int max)
     return (current + 1) % max;
 }
 
-void vmem_ring_write(vmem_t * vmem, uint32_t addr, const void * datain, uint32_t len) {
-    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
-    
-    uint32_t head = driver->head;
-    uint32_t tail = driver->tail;
+/* Bytes between the head and the oldest entry, the new entry is written there */
+static uint32_t vmem_ring_free(vmem_ring_driver_t * driver) {
     uint32_t * offsets = (uint32_t *)driver->offsets;
-    uint32_t head_offset = offsets[head];
-    uint32_t tail_offset = offsets[tail];
-    
-    /* Detect and react to wraparound read */
-    int wraparound = head_offset + len > driver->data_size;
-    uint32_t insert_offset = head_offset;
-    uint32_t new_head_offset = (head_offset + len) % driver->data_size;
-
-    if (overtake(head_offset, tail_offset, new_head_offset)) 
-    {
-        uint32_t next_tail = next(tail, driver->entries);
-        uint32_t next_tail_offset = offsets[next_tail];
-
-        while (!overtake(tail_offset, new_head_offset, next_tail_offset))
-        {
-            tail_offset = next_tail_offset;
-            next_tail = next(next_tail, driver->entries);
-            next_tail_offset = offsets[next_tail];
-        }
-        
-        tail = next_tail;
+    if (driver->head == driver->tail)
+        return driver->data_size;
+    uint32_t used = (offsets[driver->head] + driver->data_size - offsets[driver->tail]) % driver->data_size;
+    return (used == 0) ? 0 : driver->data_size - used;
+}
+
+/**
+ * Evict the oldest entry. It may still be listed in the file, so move the tail
+ * in the file past it before its data is overwritten. If the eviction reaches
+ * past the committed head, commit everything instead.
+ */
+static void vmem_ring_evict(vmem_t * vmem) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
+
+    uint32_t new_tail = next(driver->tail, driver->entries);
+    pthread_mutex_lock(&vmem_ring_lock);
+    driver->tail = new_tail;
+    pthread_mutex_unlock(&vmem_ring_lock);
+
+    uint32_t * meta = (uint32_t *) driver->map;
+    uint32_t disk_tail = meta[0];
+    uint32_t evicted = (new_tail + driver->entries - disk_tail) % driver->entries;
+    uint32_t committed = (driver->committed_head + driver->entries - disk_tail) % driver->entries;
+    if (evicted <= committed) {
+        meta[0] = new_tail;
+    } else {
+        vmem_ring_commit(vmem);
     }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+int vmem_ring_append_begin(vmem_t * vmem, vmem_ring_append_t * append, uint32_t len) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
 
-    uint32_t new_head = next(head, driver->entries);
-    uint32_t new_tail = tail == new_head ? next(tail, driver->entries) : tail;
+    if (vmem_ring_map(driver) < 0)
+        return -1;
+    if (len >= driver->data_size)
+        return -1;
 
-    FILE *stream = fopen(driver->filename, "r+");
-    if (stream == NULL)
-		return;
-    
-    /* Adjust read address and length in case of wraparound */
-    uint32_t driver_meta_size = (driver->entries + 2) * sizeof(uint32_t); // offset with initial metadata
-    fseek(stream, insert_offset + driver_meta_size, SEEK_SET);
-    if (wraparound) {
-        uint32_t len_fst = driver->data_size - insert_offset;
-        uint32_t len_snd = new_head_offset;
-        fwrite(datain, len_fst, 1, stream); // write first part
-        fseek(stream, driver_meta_size, SEEK_SET);
-        fwrite((const char *)datain + len_fst, len_snd, 1, stream); // write second part
+    /* Nothing is evicted yet, an append that never ends keeps the entries it did not overwrite */
+    uint32_t * offsets = (uint32_t *)driver->offsets;
+    append->offset = offsets[driver->head];
+    append->length = len;
+    append->written = 0;
+    return 0;
+}
+
+void vmem_ring_append(vmem_t * vmem, vmem_ring_append_t * append, const void * datain, uint32_t len) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
+
+    len = VMEM_MIN(len, append->length - append->written);
+    uint32_t offset = (append->offset + append->written) % driver->data_size;
+    uint8_t * data = driver->map + RING_META_SIZE(driver);
+
+    /* Evict only the entries these bytes overwrite */
+    while (vmem_ring_free(driver) < append->written + len && driver->tail != driver->head)
+        vmem_ring_evict(vmem);
+
+    /* Split the write in case of wraparound */
+    if (offset + len > driver->data_size) {
+        uint32_t len_fst = driver->data_size - offset;
+        uint32_t len_snd = len - len_fst;
+        memcpy(data + offset, datain, len_fst); // write first part
+        memcpy(data, (const char *)datain + len_fst, len_snd); // write second part
     } else {
-        fwrite(datain, len, 1, stream);
+        memcpy(data + offset, datain, len);
     }
 
-    /* Update driver values (tail, head, offsets) */
-    driver->tail = new_tail;
+    append->written += len;
+}
+
+void vmem_ring_append_end(vmem_t * vmem, vmem_ring_append_t * append) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
+    uint32_t * offsets = (uint32_t *)driver->offsets;
+
+    /* The new entry needs its index slot */
+    uint32_t new_head = next(driver->head, driver->entries);
+    if (new_head == driver->tail)
+        vmem_ring_evict(vmem);
+
+    /* Update driver values (head, offsets), the file follows at the next commit */
+    offsets[new_head] = (append->offset + append->length) % driver->data_size;
+
+    pthread_mutex_lock(&vmem_ring_lock);
     driver->head = new_head;
-    offsets[new_head] = new_head_offset;
-    
-    fseek(stream, 0, SEEK_SET);
-    fwrite(&new_tail, sizeof(uint32_t), 1, stream);
-    fwrite(&new_head, sizeof(uint32_t), 1, stream);
-    fwrite(offsets, sizeof(uint32_t), driver->entries, stream);
-    fclose(stream);
+    driver->appended++;
+    if (vmem_ring_waiters > 0)
+        pthread_cond_broadcast(&vmem_ring_cond);
+    pthread_mutex_unlock(&vmem_ring_lock);
+
+    driver->uncommitted++;
+
+    if (driver->commit_every > 0 && driver->uncommitted >= driver->commit_every)
+        vmem_ring_commit(vmem);
+}
+
+void vmem_ring_write(vmem_t * vmem, uint64_t addr, const void * datain, uint32_t len) {
+    vmem_ring_append_t append;
+    if (vmem_ring_append_begin(vmem, &append, len) < 0)
+        return;
+    vmem_ring_append(vmem, &append, datain, len);
+    vmem_ring_append_end(vmem, &append);
+}
+
+uint32_t vmem_ring_appended(vmem_t * vmem) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
+
+    pthread_mutex_lock(&vmem_ring_lock);
+    uint32_t appended = driver->appended;
+    pthread_mutex_unlock(&vmem_ring_lock);
+    return appended;
+}
+
+uint32_t vmem_ring_wait(vmem_t * vmem, uint32_t seen, uint32_t timeout_ms) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&vmem_ring_lock);
+    vmem_ring_waiters++;
+    while (driver->appended == seen) {
+        if (pthread_cond_timedwait(&vmem_ring_cond, &vmem_ring_lock, &deadline) != 0)
+            break;
+    }
+    vmem_ring_waiters--;
+    uint32_t appended = driver->appended;
+    pthread_mutex_unlock(&vmem_ring_lock);
+    return appended;
+}
+
+int vmem_ring_sequence_entry(vmem_t * vmem, uint32_t seq, uint32_t * offset, uint32_t * length) {
+    vmem_ring_driver_t * driver = (vmem_ring_driver_t *)vmem->driver;
+    uint32_t * offsets = (uint32_t *)driver->offsets;
+
+    /* Resolve to an absolute slot with the lock held, an eviction moves the tail under us otherwise */
+    pthread_mutex_lock(&vmem_ring_lock);
+    uint32_t behind = driver->appended - seq;
+    uint32_t elements = (driver->head + driver->entries - driver->tail) % driver->entries;
+    if (behind == 0 || behind > elements) {
+        pthread_mutex_unlock(&vmem_ring_lock);
+        return -1;
+    }
+    uint32_t slot = (driver->head + driver->entries - behind) % driver->entries;
+    uint32_t from = offsets[slot];
+    uint32_t to = offsets[(slot + 1) % driver->entries];
+    pthread_mutex_unlock(&vmem_ring_lock);
+
+    if (offset)
+        *offset = from;
+    if (length)
+        *length = (to < from) ? driver->data_size - from + to : to - from;
+    return 0;
 }
 
 // Ring buffer utility functions
@@ -21,11 +21,176 @@
 
 #include <libparam.h>
 #include <param/param_server.h>
+#include <param/param_stats.h>
 
 #include <vmem/vmem_ring.h>
+#include <vmem/vmem_async.h>
 
 static int unlocked = 0;
 
+#ifdef PARAM_HAVE_FOPEN
+static vmem_t * vmem_server_find_ring(const char * name) {
+	for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
+		if (vmem->read == vmem_ring_read && strncmp(name, vmem->name, 5) == 0) {
+			return vmem;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Stream length bytes from the ring at offset in MTU sized packets.
+ * With seq set, each packet is only sent if that entry was not evicted while it was read.
+ */
+static int vmem_server_ring_send(csp_conn_t * conn, vmem_t * ring, uint32_t offset, uint32_t length, const uint32_t * seq) {
+	uint32_t count = 0;
+	while (count < length) {
+		if (!csp_conn_is_active(conn))
+			return -1;
+
+		csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
+		if (packet == NULL) {
+			param_stats_add(PARAM_STATS_NOBUF, 1);
+			return -1;
+		}
+		packet->length = VMEM_MIN(VMEM_SERVER_MTU, length - count);
+
+		/* The read handles the wraparound */
+		vmem_ring_read(ring, offset + count, packet->data, packet->length);
+		if (seq && vmem_ring_sequence_entry(ring, *seq, NULL, NULL) < 0) {
+			csp_buffer_free(packet);
+			return -1;
+		}
+
+		count += packet->length;
+		param_stats_add(PARAM_STATS_BYTES_OUT, packet->length);
+
+		csp_send(conn, packet);
+	}
+	return 0;
+}
+
+/* Send entries from sequence number seq on, and wait for new ones for one slice when following */
+static void vmem_server_ring_range(csp_conn_t * conn, vmem_t * ring, uint32_t seq, uint32_t count, int follow) {
+
+	uint32_t sent = 0;
+	uint32_t start = csp_get_ms();
+	while ((count == 0 || sent < count) && csp_conn_is_active(conn)) {
+
+		uint32_t elapsed = csp_get_ms() - start;
+		if (follow && elapsed >= VMEM_SERVER_FOLLOW_SLICE) {
+			/* Give the task back to other requests, the client re-arms from seq */
+			csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
+			if (packet == NULL) {
+				param_stats_add(PARAM_STATS_NOBUF, 1);
+				break;
+			}
+			vmem_ring_entry_t * entry = (void *) packet->data;
+			entry->seq = htobe32(seq);
+			entry->length = htobe32(VMEM_RING_ENTRY_REARM);
+			packet->length = sizeof(vmem_ring_entry_t);
+			csp_send(conn, packet);
+			break;
+		}
+
+		uint32_t appended = vmem_ring_appended(ring);
+		if (seq == appended) {
+			if (!follow)
+				break;
+			vmem_ring_wait(ring, seq, VMEM_SERVER_FOLLOW_SLICE - elapsed);
+			continue;
+		}
+
+		uint32_t offset, length;
+		if (vmem_ring_sequence_entry(ring, seq, &offset, &length) < 0) {
+			/* Evicted, skip to the oldest entry still in the ring */
+			seq = appended - vmem_ring_get_amount_of_elements(ring);
+			continue;
+		}
+
+		csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
+		if (packet == NULL) {
+			param_stats_add(PARAM_STATS_NOBUF, 1);
+			break;
+		}
+		vmem_ring_entry_t * entry = (void *) packet->data;
+		entry->seq = htobe32(seq);
+		entry->length = htobe32(length);
+		packet->length = sizeof(vmem_ring_entry_t);
+		csp_send(conn, packet);
+
+		/* Overwritten while sending, the entry is cut short and the client re-arms from seq */
+		if (vmem_server_ring_send(conn, ring, offset, length, &seq) < 0)
+			break;
+
+		seq++;
+		sent++;
+	}
+}
+#endif
+
+#if PARAM_VMEM_ASYNC > 0
+
+/* Submit the read of the next reply packet, NULL if no buffer */
+static csp_packet_t * vmem_server_prefetch(vmem_async_t * op, vmem_t * vmem, uint64_t address, uint64_t remain) {
+	csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
+	if (packet == NULL) {
+		param_stats_add(PARAM_STATS_NOBUF, 1);
+		return NULL;
+	}
+	packet->length = VMEM_MIN(VMEM_SERVER_MTU, remain);
+	vmem_async_read(op, vmem, address - vmem->vaddr, packet->data, packet->length, NULL, NULL);
+	return packet;
+}
+
+/**
+ * Download from a device VMEM, reading the next packet while the current one
+ * is sent. Returns -1 if the range is not on a single device VMEM.
+ */
+static int vmem_server_download_async(csp_conn_t * conn, uint64_t address, uint64_t length) {
+
+	vmem_t * vmem = vmem_vaddr_to_vmem(address);
+	if (vmem == NULL || vmem->read == NULL || address + length > vmem->vaddr + vmem->size)
+		return -1;
+
+	/* Memory mapped VMEMs are not worth it */
+	if (vmem_map(vmem, address - vmem->vaddr, VMEM_MIN(VMEM_SERVER_MTU, length), VMEM_MAP_READ) != NULL)
+		return -1;
+
+	vmem_async_t op;
+	uint64_t count = 0;
+	csp_packet_t * next = NULL;
+
+	while ((count < length) && csp_conn_is_active(conn)) {
+
+		if (next == NULL) {
+			next = vmem_server_prefetch(&op, vmem, address + count, length - count);
+			if (next == NULL)
+				break;
+		}
+
+		vmem_async_wait(&op);
+		csp_packet_t * packet = next;
+		next = NULL;
+		count += packet->length;
+
+		if (count < length)
+			next = vmem_server_prefetch(&op, vmem, address + count, length - count);
+
+		param_stats_add(PARAM_STATS_BYTES_OUT, packet->length);
+		csp_send(conn, packet);
+	}
+
+	if (next) {
+		vmem_async_wait(&op);
+		csp_buffer_free(next);
+	}
+
+	return 0;
+}
+
+#endif
+
 void vmem_server_handler(csp_conn_t * conn)
 {
 	/* Read request */
@@ -33,6 +198,9 @@ void vmem_server_handler(csp_conn_t * conn)
 	if (packet == NULL)
 		return;
 
+	param_stats_add(PARAM_STATS_VMEM_REQUESTS, 1);
+	param_stats_add(PARAM_STATS_BYTES_IN, packet->length);
+
 	/* Copy data from request */
 	vmem_request_t * request = (void *) packet->data;
 	int type = request->type;
@@ -67,10 +235,16 @@ void vmem_server_handler(csp_conn_t * conn)
 			 */
 			csp_buffer_free(packet);
 
+#if PARAM_VMEM_ASYNC > 0
+			if (vmem_server_download_async(conn, address, length) == 0)
+				return;
+#endif
+
 			while((count < length) && csp_conn_is_active(conn)) {
 				/* Prepare packet */
 				csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
 				if (packet == NULL) {
+					param_stats_add(PARAM_STATS_NOBUF, 1);
 					break;
 				}
 				packet->length = VMEM_MIN(VMEM_SERVER_MTU, length - count);
@@ -80,6 +254,7 @@ void vmem_server_handler(csp_conn_t * conn)
 
 				/* Increment */
 				count += packet->length;
+				param_stats_add(PARAM_STATS_BYTES_OUT, packet->length);
 
 				csp_send(conn, packet);
 			}
@@ -123,6 +298,7 @@ void vmem_server_handler(csp_conn_t * conn)
 
 			/* Increment */
 			count += packet->length;
+			param_stats_add(PARAM_STATS_BYTES_IN, packet->length);
 
 			csp_buffer_free(packet);
 		}
@@ -267,22 +443,16 @@ void vmem_server_handler(csp_conn_t * conn)
 
 		csp_send(conn, packet);
 
+#ifdef PARAM_HAVE_FOPEN
 	/**
 	 * RING BUFFER DOWNLOAD
 	 */
 	} else if (request->type == VMEM_SERVER_RING_DOWNLOAD) {
 
-		vmem_t *ring = NULL;
-		for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
-			if (strncmp(request->ring.vmem_name, vmem->name, 5) == 0) {
-				ring = vmem;
-				break;
-			}
-		}
-		if (ring == NULL) return;
-		
+		vmem_t * ring = vmem_server_find_ring(request->ring.vmem_name);
 		uint32_t offset = request->ring.offset;
 		csp_buffer_free(packet);
+		if (ring == NULL) return;
 
 		/* Find size of download */	
 		vmem_ring_driver_t * driver = (vmem_ring_driver_t *)ring->driver;
@@ -306,14 +476,10 @@ void vmem_server_handler(csp_conn_t * conn)
 		uint32_t read_to_index = (read_from_index + 1) % driver->entries;
 		uint32_t read_from_offset = offsets[read_from_index];
 		uint32_t read_to_offset = offsets[read_to_index];
-		uint32_t length = read_from_index > read_to_offset
+		uint32_t length = read_from_offset > read_to_offset
 			? driver->data_size - read_from_offset + read_to_offset
 			: read_to_offset - read_from_offset;
 
-		/* Read image data from ring-buffer */
-		unsigned char buffer[length];
-		ring->read(ring, 0, buffer, offset);
-
 		/* Send download size to client */
 		csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
 		if (packet == NULL) {
@@ -322,41 +488,62 @@ void vmem_server_handler(csp_conn_t * conn)
 		packet->length = sizeof(uint32_t);
 		memcpy(packet->data, &length, packet->length);
 		csp_send(conn, packet);
-		
-		unsigned int count = 0;
-		while((count < length) && csp_conn_is_active(conn)) {
-			/* Prepare packet */
-			csp_packet_t * packet = csp_buffer_get(VMEM_SERVER_MTU);
-			if (packet == NULL) {
-				break;
-			}
-			packet->length = VMEM_MIN(VMEM_SERVER_MTU, length - count);
 
-			/* Get data */
-			memcpy(packet->data, buffer + count, packet->length);
+		vmem_server_ring_send(conn, ring, read_from_offset, length, NULL);
 
-			/* Increment */
-			count += packet->length;
+	/**
+	 * RING BUFFER BATCH AND FOLLOW
+	 */
+	} else if (request->type == VMEM_SERVER_RING_BATCH || request->type == VMEM_SERVER_RING_FOLLOW) {
 
-			csp_send(conn, packet);
+		vmem_t * ring = vmem_server_find_ring(request->ring_range.vmem_name);
+		int32_t from = (int32_t) be32toh(request->ring_range.from);
+		uint32_t count = be32toh(request->ring_range.count);
+		uint8_t flags = request->ring_range.flags;
+		int follow = (request->type == VMEM_SERVER_RING_FOLLOW);
+		csp_buffer_free(packet);
+		if (ring == NULL) return;
+
+		uint32_t appended = vmem_ring_appended(ring);
+		int32_t elements = vmem_ring_get_amount_of_elements(ring);
+		uint32_t seq;
+		if (flags & VMEM_RING_RANGE_SEQ) {
+			/* A re-armed follow. A seq ahead of ours means we restarted, so only send new entries */
+			seq = (uint32_t) from;
+			if ((int32_t) (seq - appended) > 0)
+				seq = appended;
+		} else {
+			/* Sequence number of the first entry, a from past the newest only sends new entries */
+			if (from < 0)
+				from = VMEM_MAX(elements + from, 0);
+			if (from > elements)
+				from = elements;
+			seq = appended - elements + from;
 		}
 
+		vmem_server_ring_range(conn, ring, seq, count, follow);
+
 	/**
 	 * RING BUFFER UPLOAD
 	 */
 	} else if (request->type == VMEM_SERVER_RING_UPLOAD) {
-		int length = request->ring.offset;
-		unsigned char buffer[length];
 
+		vmem_t * ring = vmem_server_find_ring(request->ring.vmem_name);
+		uint32_t length = request->ring.offset;
 		csp_buffer_free(packet);
+		if (ring == NULL) return;
 
-		int count = 0;
+		/* Stream into the ring, the entry is only added once complete */
+		vmem_ring_append_t append;
+		if (vmem_ring_append_begin(ring, &append, length) < 0) return;
+
+		uint32_t count = 0;
 		while((packet = csp_read(conn, VMEM_SERVER_TIMEOUT)) != NULL) {
 
 			//csp_hex_dump("Upload", packet->data, packet->length);
 
-			/* Put data in buffer */
-			memcpy(buffer + count, packet->data, packet->length);
+			/* Put data in ring */
+			vmem_ring_append(ring, &append, packet->data, packet->length);
 
 			/* Increment */
 			count += packet->length;
@@ -364,16 +551,9 @@ void vmem_server_handler(csp_conn_t * conn)
 			csp_buffer_free(packet);
 		}
 
-		/* After transfer, write data to VMEM */
-		vmem_t *ring = NULL;
-		for(vmem_t * vmem = (vmem_t *) &__start_vmem; vmem < (vmem_t *) &__stop_vmem; vmem++) {
-			if (strncmp(request->ring.vmem_name, vmem->name, 5)) {
-				ring = vmem;
-				break;
-			}
-		}
-		if (ring == NULL) return;
-		ring->write(ring, 0, buffer, length);
+		if (count >= length)
+			vmem_ring_append_end(ring, &append);
+#endif
 
 	} else {
 
@@ -389,12 +569,16 @@ void vmem_server_handler(csp_conn_t * conn)
 
 static void rparam_list_handler(csp_conn_t * conn)
 {
+	param_stats_add(PARAM_STATS_LIST_REQUESTS, 1);
+
 	param_t * param;
 	param_list_iterator i = {};
 	while ((param = param_list_iterate(&i)) != NULL) {
 		csp_packet_t * packet = csp_buffer_get(256);
-		if (packet == NULL)
-		    break;
+		if (packet == NULL) {
+			param_stats_add(PARAM_STATS_NOBUF, 1);
+			break;
+		}
 
 		memset(packet->data, 0, 256);
 
@@ -422,6 +606,7 @@ static void rparam_list_handler(csp_conn_t * conn)
 		}
 		//packet->length = sizeof(param_transfer3_t);
 		packet->length = offsetof(param_transfer3_t, help) + helplen + 1;
+		param_stats_add(PARAM_STATS_BYTES_OUT, packet->length);
 		
 		csp_send(conn, packet);
 	}
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <vector>
+#include "param/param.h"
+#include "param/param_archive.h"
+#include "vmem/vmem_ring.h"
+
+#define RING_DATA_SIZE      0x4000
+#define RING_ENTRIES        64
+
+static uint32_t g_ring_offsets[RING_ENTRIES];
+static vmem_ring_driver_t g_ring_driver;
+static vmem_t g_ring;
+static char g_ring_file[] = "/tmp/param_archive_testXXXXXX";
+
+struct sample {
+    uint32_t time;
+    double value;
+};
+
+static void collect(uint32_t time, double value, void *context) {
+    ((std::vector<sample> *)context)->push_back({time, value});
+}
+
+/* Each test archives its own parameter, columns are never removed */
+static param_t make_param(uint16_t id, param_type_e type, void *addr) {
+
+    param_t param;
+    memset(&param, 0, sizeof(param));
+    param.id = id;
+    param.node = 0;
+    param.type = type;
+    param.name = (char *)"archived";
+    param.addr = addr;
+    param.array_size = 1;
+    return param;
+}
+
+static std::vector<sample> query(uint16_t id) {
+    std::vector<sample> samples;
+    param_archive_query(0, id, 0, UINT32_MAX, collect, &samples);
+    return samples;
+}
+
+class param_archive : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+
+        int fd = mkstemp(g_ring_file);
+        ASSERT_GE(fd, 0);
+        close(fd);
+
+        g_ring_driver.data_size = RING_DATA_SIZE;
+        g_ring_driver.entries = RING_ENTRIES;
+        g_ring_driver.filename = g_ring_file;
+        g_ring_driver.offsets = g_ring_offsets;
+        g_ring_driver.commit_every = 1;
+
+        g_ring.type = VMEM_TYPE_FILE;
+        g_ring.name = "archive";
+        g_ring.size = RING_DATA_SIZE + (RING_ENTRIES + 2) * sizeof(uint32_t);
+        g_ring.read = vmem_ring_read;
+        g_ring.write = vmem_ring_write;
+        g_ring.flush = vmem_ring_commit;
+        g_ring.driver = &g_ring_driver;
+
+        vmem_ring_init(&g_ring);
+        param_archive_init(&g_ring);
+    }
+
+    static void TearDownTestSuite() {
+        unlink(g_ring_file);
+    }
+};
+
+TEST_F(param_archive, block_format) {
+
+    uint32_t value = 0x11223344;
+    param_t param = make_param(101, PARAM_TYPE_UINT32, &value);
+    ASSERT_EQ(param_archive_add(&param), 0);
+
+    param_archive_record(&param, 1000);
+    value++;
+    param_archive_record(&param, 1010);
+    param_archive_flush();
+
+    uint32_t index = vmem_ring_get_amount_of_elements(&g_ring) - 1;
+    uint32_t length = vmem_ring_element_size(&g_ring, index);
+    ASSERT_GT(length, sizeof(param_archive_block_t) + 8);
+
+    uint8_t block[PARAM_ARCHIVE_BLOCK_SIZE];
+    vmem_ring_read(&g_ring, vmem_ring_offset(&g_ring, index, 0), block, length);
+
+    /* Big endian header, then the first value raw */
+    const uint8_t header[] = {
+        0xA5, 0xC1,                 // magic
+        0x00, 101,                  // id
+        0x00, 0x00,                 // node
+        PARAM_TYPE_UINT32, 0x00,
+        0x00, 0x02,                 // count
+        0x00, 0x00,
+        0x00, 0x00, 0x03, 0xE8,     // first time
+        0x00, 0x00, 0x03, 0xF2,     // last time
+    };
+    ASSERT_EQ(sizeof(header), sizeof(param_archive_block_t));
+    ASSERT_EQ(memcmp(block, header, sizeof(header)), 0);
+
+    const uint8_t first[] = {0, 0, 0, 0, 0x11, 0x22, 0x33, 0x44};
+    ASSERT_EQ(memcmp(&block[sizeof(header)], first, sizeof(first)), 0);
+}
+
+TEST_F(param_archive, roundtrip_integer) {
+
+    int32_t value;
+    param_t param = make_param(102, PARAM_TYPE_INT32, &value);
+    ASSERT_EQ(param_archive_add(&param), 0);
+
+    /* Every delta-of-delta range: 0, 7, 9, 12 and 32 bits, both signs */
+    const uint32_t times[] = {100, 110, 120, 130, 190, 140, 440, 200, 2200, 300, 100000, 100001, 100002};
+    const int32_t values[] = {0, 0, 1, -1, 1000, -1000, INT32_MAX, INT32_MIN, 5, 5, 6, 7, -123456};
+    const int count = sizeof(times) / sizeof(times[0]);
+
+    for (int i = 0; i < count; i++) {
+        value = values[i];
+        param_archive_record(&param, times[i]);
+    }
+
+    /* Half in RAM, then all of it from the ring */
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<sample> samples = query(102);
+        ASSERT_EQ((int)samples.size(), count);
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(samples[i].time, times[i]);
+            ASSERT_EQ(samples[i].value, values[i]);
+        }
+        param_archive_flush();
+    }
+}
+
+TEST_F(param_archive, roundtrip_float) {
+
+    double value;
+    param_t param = make_param(103, PARAM_TYPE_DOUBLE, &value);
+    ASSERT_EQ(param_archive_add(&param), 0);
+
+    const double values[] = {1.5, 1.5, 1.25, -0.0, 3.14159265358979, 1e300, -1e-300, 1.5};
+    const int count = sizeof(values) / sizeof(values[0]);
+
+    for (int i = 0; i < count; i++) {
+        value = values[i];
+        param_archive_record(&param, 500 + i);
+    }
+    param_archive_flush();
+
+    std::vector<sample> samples = query(103);
+    ASSERT_EQ((int)samples.size(), count);
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ(samples[i].time, 500u + i);
+        ASSERT_EQ(memcmp(&samples[i].value, &values[i], sizeof(double)), 0);
+    }
+}
+
+TEST_F(param_archive, roundtrip_across_blocks) {
+
+    uint16_t value;
+    param_t param = make_param(104, PARAM_TYPE_UINT16, &value);
+    ASSERT_EQ(param_archive_add(&param), 0);
+
+    uint32_t before = vmem_ring_get_amount_of_elements(&g_ring);
+
+    /* Noisy values fill several blocks */
+    const int count = 500;
+    for (int i = 0; i < count; i++) {
+        value = (i * 7919) & 0xFFFF;
+        param_archive_record(&param, 10000 + i * 3 + (i % 5));
+    }
+    ASSERT_GT(vmem_ring_get_amount_of_elements(&g_ring), before + 1);
+
+    std::vector<sample> samples = query(104);
+    ASSERT_EQ((int)samples.size(), count);
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ(samples[i].time, 10000u + i * 3 + (i % 5));
+        ASSERT_EQ(samples[i].value, (i * 7919) & 0xFFFF);
+    }
+
+    /* A time window only returns the samples inside it */
+    std::vector<sample> window;
+    int found = param_archive_query(0, 104, 10300, 10400, collect, &window);
+    ASSERT_EQ(found, (int)window.size());
+    for (const sample &s : window) {
+        ASSERT_GE(s.time, 10300u);
+        ASSERT_LE(s.time, 10400u);
+    }
+    ASSERT_GT(window.size(), 0u);
+}
+
+/* Blocks can be uploaded to the ring by anyone, a corrupt one must not be trusted */
+static void upload(uint16_t id, uint16_t count, const uint8_t *stream, size_t stream_length) {
+
+    uint8_t block[PARAM_ARCHIVE_BLOCK_SIZE];
+    param_archive_block_t *header = (param_archive_block_t *)block;
+    memset(block, 0, sizeof(block));
+    header->magic = htobe16(PARAM_ARCHIVE_MAGIC);
+    header->id = htobe16(id);
+    header->type = PARAM_TYPE_UINT32;
+    header->count = htobe16(count);
+    header->first_time = htobe32(100);
+    header->last_time = htobe32(100);
+    memcpy(&block[sizeof(param_archive_block_t)], stream, stream_length);
+    vmem_ring_write(&g_ring, 0, block, sizeof(param_archive_block_t) + stream_length);
+}
+
+TEST_F(param_archive, corrupt_count) {
+
+    /* First value, then room for four unchanged samples, but the header claims the maximum */
+    const uint8_t stream[] = {0, 0, 0, 0, 0, 0, 0, 42, 0x00};
+    upload(105, UINT16_MAX, stream, sizeof(stream));
+
+    std::vector<sample> samples = query(105);
+    ASSERT_EQ((int)samples.size(), 5);
+    for (const sample &s : samples) {
+        ASSERT_EQ(s.time, 100u);
+        ASSERT_EQ(s.value, 42);
+    }
+}
+
+TEST_F(param_archive, corrupt_window) {
+
+    /* Second sample: same time, new window with 31 leading bits and a 64 bit length */
+    const uint8_t stream[] = {0, 0, 0, 0, 0, 0, 0, 42, 0x7F, 0xFC, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    upload(106, 2, stream, sizeof(stream));
+
+    std::vector<sample> samples = query(106);
+    ASSERT_EQ((int)samples.size(), 1);
+    ASSERT_EQ(samples[0].value, 42);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include "vmem/vmem.h"
+#include "vmem/vmem_async.h"
+
+#define SLOW_VMEMS      2
+#define SLOW_SIZE       0x1000
+#define SLOW_DELAY_US   2000
+
+__attribute__((section("vmem"))) __attribute__((used)) vmem_t g_slow_vmems[SLOW_VMEMS];
+
+static uint8_t g_slow_mem[SLOW_VMEMS][SLOW_SIZE];
+static std::atomic<int> g_in_driver[SLOW_VMEMS];
+static std::atomic<int> g_max_in_driver[SLOW_VMEMS];
+static std::atomic<int> g_in_flight;
+static std::atomic<int> g_max_in_flight;
+
+static void slow_enter(int idx) {
+
+    int n = ++g_in_driver[idx];
+    if (n > g_max_in_driver[idx])
+        g_max_in_driver[idx] = n;
+    n = ++g_in_flight;
+    if (n > g_max_in_flight)
+        g_max_in_flight = n;
+    usleep(SLOW_DELAY_US);
+}
+
+static void slow_exit(int idx) {
+    g_in_driver[idx]--;
+    g_in_flight--;
+}
+
+static void slow_read(vmem_t *vmem, uint64_t addr, void *dataout, uint32_t len) {
+
+    int idx = vmem - g_slow_vmems;
+    slow_enter(idx);
+    memcpy(dataout, &g_slow_mem[idx][addr], len);
+    slow_exit(idx);
+}
+
+static void slow_write(vmem_t *vmem, uint64_t addr, const void *datain, uint32_t len) {
+
+    int idx = vmem - g_slow_vmems;
+    slow_enter(idx);
+    memcpy(&g_slow_mem[idx][addr], datain, len);
+    slow_exit(idx);
+}
+
+static void count_completion(vmem_async_t *op, void *context) {
+    (*(std::atomic<int> *)context)++;
+}
+
+class vmem_async : public ::testing::Test {
+protected:
+    void SetUp() override {
+
+        for (int i = 0; i < SLOW_VMEMS; i++) {
+            g_slow_vmems[i].type = VMEM_TYPE_DRIVER;
+            g_slow_vmems[i].read = slow_read;
+            g_slow_vmems[i].write = slow_write;
+            g_slow_vmems[i].vaddr = 0x40000000ULL + i * SLOW_SIZE;
+            g_slow_vmems[i].size = SLOW_SIZE;
+            g_slow_vmems[i].name = "slow";
+            memset(g_slow_mem[i], 0, SLOW_SIZE);
+            g_max_in_driver[i] = 0;
+        }
+        g_max_in_flight = 0;
+        vmem_index_invalidate();
+    }
+};
+
+/* A read submitted after writes to the same VMEM sees all of them */
+TEST_F(vmem_async, same_vmem_in_order) {
+
+    uint8_t data[8][16];
+    vmem_async_t writes[8];
+    for (int i = 0; i < 8; i++) {
+        memset(data[i], i + 1, sizeof(data[i]));
+        vmem_async_write(&writes[i], &g_slow_vmems[0], 0x100, data[i], sizeof(data[i]), NULL, NULL);
+    }
+
+    uint8_t out[16];
+    vmem_async_t read;
+    vmem_async_read(&read, &g_slow_vmems[0], 0x100, out, sizeof(out), NULL, NULL);
+    vmem_async_wait(&read);
+
+    for (int i = 0; i < 16; i++)
+        EXPECT_EQ(out[i], 8);
+    for (int i = 0; i < 8; i++)
+        vmem_async_wait(&writes[i]);
+
+    /* The driver is never entered twice at once for one VMEM */
+    EXPECT_EQ(g_max_in_driver[0], 1);
+}
+
+TEST_F(vmem_async, callbacks) {
+
+    std::atomic<int> completed(0);
+    uint8_t out[SLOW_VMEMS][4][32];
+    vmem_async_t ops[SLOW_VMEMS][4];
+
+    for (int i = 0; i < SLOW_VMEMS; i++) {
+        for (int j = 0; j < 32 * 4; j++)
+            g_slow_mem[i][j] = i * 64 + j;
+        for (int j = 0; j < 4; j++)
+            vmem_async_read(&ops[i][j], &g_slow_vmems[i], j * 32, out[i][j], 32, count_completion, &completed);
+    }
+
+    for (int tries = 0; completed < SLOW_VMEMS * 4 && tries < 1000; tries++)
+        usleep(1000);
+
+    ASSERT_EQ(completed, SLOW_VMEMS * 4);
+    for (int i = 0; i < SLOW_VMEMS; i++)
+        for (int j = 0; j < 4; j++)
+            for (int k = 0; k < 32; k++)
+                EXPECT_EQ(out[i][j][k], (uint8_t)(i * 64 + j * 32 + k));
+}
+
+/* Different VMEMs transfer in parallel, the caller is not blocked */
+TEST_F(vmem_async, overlap) {
+
+    uint8_t out[SLOW_VMEMS][16];
+    vmem_async_t ops[SLOW_VMEMS];
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < SLOW_VMEMS; i++)
+        vmem_async_read(&ops[i], &g_slow_vmems[i], 0, out[i], sizeof(out[i]), NULL, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int i = 0; i < SLOW_VMEMS; i++)
+        vmem_async_wait(&ops[i]);
+
+    long submit_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+
+#if PARAM_VMEM_ASYNC > 0
+    EXPECT_LT(submit_us, SLOW_DELAY_US);
+#if PARAM_VMEM_ASYNC >= SLOW_VMEMS
+    EXPECT_EQ(g_max_in_flight, SLOW_VMEMS);
+#endif
+#else
+    EXPECT_GE(submit_us, SLOW_VMEMS * SLOW_DELAY_US);
+#endif
+}
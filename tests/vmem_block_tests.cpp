@@ -17,6 +17,7 @@ extern "C" int32_t bwrite_emmc(const vmem_block_driver_t *drv, uint32_t blockadd
 
 VMEM_DEFINE_BLOCK_DEVICE(emmc0, "emmc0", EMMC_BLOCK_SIZE, 16777216, binit_emmc);
 VMEM_DEFINE_BLOCK_DRIVER(emmc, "emmc", bread_emmc, bwrite_emmc, emmc0);
+VMEM_DEFINE_BLOCK_DRIVER(emmc_alt, "emmc_alt", bread_emmc, bwrite_emmc, emmc0);
 
 VMEM_DEFINE_BLOCK_CACHE(emmc_cache_reg0, EMMC_BLOCK_SIZE * 100);
 VMEM_DEFINE_BLOCK_CACHE(emmc_cache_reg1, EMMC_BLOCK_SIZE * 50);
@@ -30,6 +31,11 @@ VMEM_DEFINE_BLOCK_REGION(stfw2, "stfw2", 0x0 + (2 * STFW_FIFO_SIZE), STFW_FIFO_S
 VMEM_DEFINE_BLOCK_REGION(stfw3, "stfw3", 0x0 + (3 * STFW_FIFO_SIZE), STFW_FIFO_SIZE, 0x1000000000ULL + (3 * STFW_FIFO_SIZE), emmc, &vmem_emmc_cache_reg3_cache);
 VMEM_DEFINE_BLOCK_REGION(stfw4, "stfw4", 0x0 + (4 * STFW_FIFO_SIZE), STFW_FIFO_SIZE, 0x1000000000ULL + (4 * STFW_FIFO_SIZE), emmc, &vmem_emmc_cache_reg4_cache);
 
+/* Two regions on different drivers of the same device, sharing one 16 line, 4-way cache */
+VMEM_DEFINE_BLOCK_CACHE_WAYS(emmc_shared, EMMC_BLOCK_SIZE * 16, EMMC_BLOCK_SIZE, 4);
+VMEM_DEFINE_BLOCK_REGION(shr0, "shr0", 0x0 + (0 * STFW_FIFO_SIZE), STFW_FIFO_SIZE, 0x2000000000ULL + (0 * STFW_FIFO_SIZE), emmc, &vmem_emmc_shared_cache);
+VMEM_DEFINE_BLOCK_REGION(shr1, "shr1", 0x0 + (1 * STFW_FIFO_SIZE), STFW_FIFO_SIZE, 0x2000000000ULL + (1 * STFW_FIFO_SIZE), emmc_alt, &vmem_emmc_shared_cache);
+
 #define TEST_BUFFER_SIZE 10240
 #define TEST_BUFFER_OFFSET 78
 #define TEST_READ_CHUNK_SIZE 512
@@ -39,6 +45,9 @@ VMEM_DEFINE_BLOCK_REGION(stfw4, "stfw4", 0x0 + (4 * STFW_FIFO_SIZE), STFW_FIFO_S
 uint8_t g_emmc_data_read[EMMC_SIZE];
 uint8_t g_emmc_data_write[EMMC_SIZE];
 uint8_t *g_emmc_data_ptr;
+uint32_t g_emmc_reads;
+uint32_t g_emmc_writes;
+uint32_t g_emmc_blocks_written;
 
 extern "C" int32_t binit_emmc(const vmem_block_device_t *dev) {
 
@@ -48,6 +57,7 @@ extern "C" int32_t binit_emmc(const vmem_block_device_t *dev) {
 extern "C" int32_t bread_emmc(const vmem_block_driver_t *drv, uint32_t blockaddr, uint32_t n_blocks, uint8_t *data) {
 
     int32_t res = 0;
+    g_emmc_reads++;
     memcpy(data, &g_emmc_data_ptr[(blockaddr * drv->device->bsize)], (n_blocks * drv->device->bsize));
     return res;
 }
@@ -55,6 +65,8 @@ extern "C" int32_t bread_emmc(const vmem_block_driver_t *drv, uint32_t blockaddr
 extern "C" int32_t bwrite_emmc(const vmem_block_driver_t *drv, uint32_t blockaddr, uint32_t n_blocks, uint8_t *data) {
 
     int32_t res = 0;
+    g_emmc_writes++;
+    g_emmc_blocks_written += n_blocks;
     memcpy(&g_emmc_data_ptr[(blockaddr * drv->device->bsize)], data, (n_blocks * drv->device->bsize));
     return res;
 }
@@ -185,4 +197,100 @@ TEST(vmem_block, upload_random_download_compare_at_offset) {
     // 7. Compare the content expected to be in the writeable "eMMC"
     EXPECT_TRUE( 0 == memcmp(&read_buffer[0], &write_buffer[0], TEST_BUFFER_SIZE) );
 
-}
\ No newline at end of file
+}
+
+static void shared_cache_reset(void) {
+
+    vmem_block_flush(&vmem_shr0);
+    for (uint32_t i = 0; i < vmem_emmc_shared_cache.max_lines; i++) {
+        vmem_emmc_shared_cache.lines[i].is_valid = false;
+    }
+    vmem_emmc_shared_cache.hits = 0;
+    vmem_emmc_shared_cache.misses = 0;
+    g_emmc_reads = 0;
+    g_emmc_writes = 0;
+    g_emmc_blocks_written = 0;
+}
+
+/* Interleaved access to two regions on the same device must not thrash */
+TEST(vmem_block, shared_cache_interleaved_hit_rate) {
+
+    g_emmc_data_ptr = &g_emmc_data_read[0];
+    generate_series_data(g_emmc_data_ptr, EMMC_SIZE);
+    shared_cache_reset();
+
+    /* 4 blocks in each region, 8 lines in total, read 16 bytes at a time alternating between them */
+    uint8_t buf[16];
+    for (int pass = 0; pass < 4; pass++) {
+        for (uint32_t offset = 0; offset < 4 * EMMC_BLOCK_SIZE; offset += sizeof(buf)) {
+            vmem_memcpy(buf, (void *)(uintptr_t)(vmem_shr0.vaddr + offset), sizeof(buf));
+            EXPECT_EQ(0, memcmp(buf, &g_emmc_data_ptr[offset], sizeof(buf)));
+            vmem_memcpy(buf, (void *)(uintptr_t)(vmem_shr1.vaddr + offset), sizeof(buf));
+            EXPECT_EQ(0, memcmp(buf, &g_emmc_data_ptr[STFW_FIFO_SIZE + offset], sizeof(buf)));
+        }
+    }
+
+    /* Each block is read from the device once */
+    EXPECT_EQ(8U, vmem_emmc_shared_cache.misses);
+    EXPECT_EQ(8U, g_emmc_reads);
+    uint32_t accesses = vmem_emmc_shared_cache.hits + vmem_emmc_shared_cache.misses;
+    EXPECT_GT((double)vmem_emmc_shared_cache.hits / accesses, 0.99);
+}
+
+/* Small writes stay in the cache until flushed, then each dirty block is written once */
+TEST(vmem_block, write_back_on_flush) {
+
+    g_emmc_data_ptr = &g_emmc_data_write[0];
+    memset(g_emmc_data_ptr, 0, EMMC_SIZE);
+    shared_cache_reset();
+
+    uint8_t write_buffer[3 * EMMC_BLOCK_SIZE];
+    generate_random_data(write_buffer, sizeof(write_buffer));
+
+    for (int pass = 0; pass < 10; pass++) {
+        for (uint32_t offset = 0; offset < sizeof(write_buffer); offset += 24) {
+            vmem_memcpy((void *)(uintptr_t)(vmem_shr1.vaddr + TEST_BUFFER_OFFSET + offset), &write_buffer[offset], 24);
+        }
+    }
+    EXPECT_EQ(0U, g_emmc_writes);
+
+    vmem_block_flush(&vmem_shr1);
+
+    /* The write spans 4 blocks when unaligned */
+    EXPECT_EQ(4U, g_emmc_blocks_written);
+    EXPECT_EQ(0, memcmp(write_buffer, &g_emmc_data_ptr[STFW_FIFO_SIZE + TEST_BUFFER_OFFSET], sizeof(write_buffer)));
+
+    /* Nothing is left dirty */
+    vmem_block_flush(&vmem_shr0);
+    EXPECT_EQ(4U, g_emmc_blocks_written);
+}
+
+/* Large transfers go around the cache in multi-block device transfers and leave the cached lines alone */
+TEST(vmem_block, streaming_bypasses_cache) {
+
+    g_emmc_data_ptr = &g_emmc_data_read[0];
+    generate_series_data(g_emmc_data_ptr, EMMC_SIZE);
+    shared_cache_reset();
+
+    /* Warm up a working set of 2 blocks */
+    uint8_t small[16];
+    vmem_memcpy(small, (void *)(uintptr_t)(vmem_shr0.vaddr), sizeof(small));
+    vmem_memcpy(small, (void *)(uintptr_t)(vmem_shr0.vaddr + EMMC_BLOCK_SIZE), sizeof(small));
+    uint32_t misses = vmem_emmc_shared_cache.misses;
+
+    /* Stream 64 KiB from the other region in 4 KiB reads */
+    static uint8_t stream[64 * 1024];
+    g_emmc_reads = 0;
+    for (uint32_t offset = 0; offset < sizeof(stream); offset += 4096) {
+        vmem_memcpy(&stream[offset], (void *)(uintptr_t)(vmem_shr1.vaddr + offset), 4096);
+    }
+    EXPECT_EQ(0, memcmp(stream, &g_emmc_data_ptr[STFW_FIFO_SIZE], sizeof(stream)));
+    EXPECT_EQ(sizeof(stream) / 4096, g_emmc_reads);
+
+    /* The working set is still cached */
+    g_emmc_reads = 0;
+    vmem_memcpy(small, (void *)(uintptr_t)(vmem_shr0.vaddr), sizeof(small));
+    vmem_memcpy(small, (void *)(uintptr_t)(vmem_shr0.vaddr + EMMC_BLOCK_SIZE), sizeof(small));
+    EXPECT_EQ(0U, g_emmc_reads);
+    EXPECT_EQ(misses + sizeof(stream) / 4096, vmem_emmc_shared_cache.misses);
+}
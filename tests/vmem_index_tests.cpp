@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include "vmem/vmem.h"
+
+#define BENCH_VMEMS         512
+#define BENCH_VMEM_BASE     0x10000000ULL
+#define BENCH_VMEM_SIZE     0x10000
+#define BENCH_CHUNK_SIZE    192
+
+/* Two driver VMEMs at vaddr 0, like rings and files without a vaddr */
+#define OVERLAP_SMALL_SIZE  0x100
+#define OVERLAP_LARGE_SIZE  0x200
+
+__attribute__((section("vmem"))) __attribute__((used)) vmem_t g_overlap_vmems[2];
+__attribute__((section("vmem"))) __attribute__((used)) vmem_t g_bench_vmems[BENCH_VMEMS];
+
+static vmem_t *g_last_vmem;
+static uint64_t g_last_addr;
+static uint32_t g_reads;
+
+static void bench_read(vmem_t *vmem, uint64_t addr, void *dataout, uint32_t len) {
+
+    g_last_vmem = vmem;
+    g_last_addr = addr;
+    g_reads++;
+}
+
+class vmem_index : public ::testing::Test {
+protected:
+    void SetUp() override {
+
+        /* Defined in reverse address order, so the index has to sort them */
+        for (int i = 0; i < BENCH_VMEMS; i++) {
+            g_bench_vmems[i].type = VMEM_TYPE_DRIVER;
+            g_bench_vmems[i].read = bench_read;
+            g_bench_vmems[i].vaddr = BENCH_VMEM_BASE + (uint64_t)(BENCH_VMEMS - 1 - i) * BENCH_VMEM_SIZE;
+            g_bench_vmems[i].size = BENCH_VMEM_SIZE;
+            g_bench_vmems[i].name = "bench";
+        }
+
+        for (int i = 0; i < 2; i++) {
+            g_overlap_vmems[i].type = VMEM_TYPE_DRIVER;
+            g_overlap_vmems[i].read = bench_read;
+            g_overlap_vmems[i].vaddr = 0;
+            g_overlap_vmems[i].name = "overlap";
+        }
+        g_overlap_vmems[0].size = OVERLAP_SMALL_SIZE;
+        g_overlap_vmems[1].size = OVERLAP_LARGE_SIZE;
+
+        vmem_index_invalidate();
+        g_reads = 0;
+    }
+};
+
+TEST_F(vmem_index, resolves_every_vmem) {
+
+    uint8_t buf[BENCH_CHUNK_SIZE];
+
+    for (int i = 0; i < BENCH_VMEMS; i++) {
+        uint64_t start = g_bench_vmems[i].vaddr;
+
+        ASSERT_EQ(vmem_vaddr_to_vmem(start + 10), &g_bench_vmems[i]);
+
+        /* Last byte in the VMEM, and a chunk crossing into the next one */
+        vmem_read(buf, start + BENCH_VMEM_SIZE - BENCH_CHUNK_SIZE, BENCH_CHUNK_SIZE);
+        ASSERT_EQ(g_last_vmem, &g_bench_vmems[i]);
+        ASSERT_EQ(g_last_addr, BENCH_VMEM_SIZE - BENCH_CHUNK_SIZE);
+
+        g_last_vmem = NULL;
+        vmem_read(buf, start + BENCH_VMEM_SIZE - 10, BENCH_CHUNK_SIZE);
+        ASSERT_EQ(g_last_vmem, nullptr);
+    }
+
+    ASSERT_EQ(vmem_vaddr_to_vmem(BENCH_VMEM_BASE + (uint64_t)BENCH_VMEMS * BENCH_VMEM_SIZE + 1), nullptr);
+}
+
+TEST_F(vmem_index, overlapping_first_match) {
+
+    uint8_t buf[16];
+
+    /* Both hold the address, the first in section order wins */
+    vmem_read(buf, 0x10, sizeof(buf));
+    ASSERT_EQ(g_last_vmem, &g_overlap_vmems[0]);
+
+    /* Only the large one holds it */
+    vmem_read(buf, OVERLAP_SMALL_SIZE + 0x10, sizeof(buf));
+    ASSERT_EQ(g_last_vmem, &g_overlap_vmems[1]);
+    ASSERT_EQ(g_last_addr, OVERLAP_SMALL_SIZE + 0x10);
+
+    /* And back, the last hit must not be used for overlapping VMEMs */
+    vmem_read(buf, 0x20, sizeof(buf));
+    ASSERT_EQ(g_last_vmem, &g_overlap_vmems[0]);
+}
+
+TEST_F(vmem_index, resize_invalidates) {
+
+    /* Build the index before resizing */
+    uint64_t start = g_bench_vmems[0].vaddr;
+    uint64_t shrunk_start = g_bench_vmems[1].vaddr;
+    ASSERT_EQ(vmem_vaddr_to_vmem(start + 10), &g_bench_vmems[0]);
+    ASSERT_EQ(vmem_vaddr_to_vmem(shrunk_start + BENCH_VMEM_SIZE - 10), &g_bench_vmems[1]);
+
+    /* The highest VMEM grows, the one below it shrinks. A stale index answers from the old sizes */
+    g_bench_vmems[0].size = BENCH_VMEM_SIZE * 2;
+    g_bench_vmems[1].size = BENCH_VMEM_SIZE / 2;
+    vmem_index_invalidate();
+
+    ASSERT_EQ(vmem_vaddr_to_vmem(start + BENCH_VMEM_SIZE + 10), &g_bench_vmems[0]);
+    ASSERT_EQ(vmem_vaddr_to_vmem(shrunk_start + BENCH_VMEM_SIZE - 10), nullptr);
+    ASSERT_EQ(vmem_vaddr_to_vmem(shrunk_start + 10), &g_bench_vmems[1]);
+}
+
+extern "C" int __start_vmem, __stop_vmem;
+
+/* The lookup the index replaces */
+static vmem_t *linear_find(uint64_t addr) {
+    for (vmem_t *vmem = (vmem_t *)&__start_vmem; vmem < (vmem_t *)&__stop_vmem; vmem++) {
+        if (addr >= vmem->vaddr && addr <= vmem->vaddr + vmem->size)
+            return vmem;
+    }
+    return NULL;
+}
+
+static double elapsed_ns(const struct timespec &t0, const struct timespec &t1) {
+    return (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+}
+
+TEST_F(vmem_index, lookup_benchmark) {
+
+    int vmems = (vmem_t *)&__stop_vmem - (vmem_t *)&__start_vmem;
+    if (PARAM_VMEM_INDEX < vmems)
+        GTEST_SKIP() << "index holds " << PARAM_VMEM_INDEX << " of " << vmems << " vmems";
+
+    /* Random VMEMs, so neither the last hit nor section order helps */
+    const int lookups = 4096;
+    static uint64_t addrs[lookups];
+    uint32_t seed = 1;
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        addrs[i] = g_bench_vmems[(seed >> 16) % BENCH_VMEMS].vaddr + (seed % BENCH_VMEM_SIZE);
+        ASSERT_EQ(vmem_vaddr_to_vmem(addrs[i]), linear_find(addrs[i]));
+    }
+
+    /* Best of several runs, to keep scheduling noise out */
+    double indexed = 1e18, linear = 1e18;
+    struct timespec t0, t1;
+    for (int run = 0; run < 5; run++) {
+
+        uintptr_t sum = 0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < lookups; i++)
+            sum += (uintptr_t)vmem_vaddr_to_vmem(addrs[i]);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        indexed = std::min(indexed, elapsed_ns(t0, t1) / lookups);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < lookups; i++)
+            sum -= (uintptr_t)linear_find(addrs[i]);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        linear = std::min(linear, elapsed_ns(t0, t1) / lookups);
+
+        ASSERT_EQ(sum, 0u);
+    }
+
+    printf("%d vmems: %.1f ns indexed, %.1f ns linear per lookup\n", vmems, indexed, linear);
+    ASSERT_LT(indexed, linear);
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Decode a libparam trace buffer (param_trace_dump() or vmem download of the "trace" VMEM)
+
+    param_trace_decode.py trace.bin [--thread N] [--op NAME] [--min-us N]
+
+Prints one event per line, oldest first, merged across threads.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x50545243
+
+OPS = {
+    1: "get",
+    2: "set",
+    3: "get_data",
+    4: "set_data",
+    5: "apply",
+    6: "transaction",
+    7: "vmem_read",
+    8: "vmem_write",
+}
+
+
+def decode(data):
+    for endian in ("<", ">"):
+        magic, version, threads, entries = struct.unpack_from(endian + "IHHI", data, 0)
+        if magic == MAGIC:
+            break
+    else:
+        raise ValueError("not a trace buffer (bad magic)")
+
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+
+    heads = struct.unpack_from(endian + "%dI" % threads, data, 12)
+    event = struct.Struct(endian + "IIHHBBH")
+    base = 12 + 4 * threads
+
+    events = []
+    reference = None
+    for thread, head in enumerate(heads):
+        count = min(head, entries)
+        for seq in range(head - count, head):
+            offset = base + (thread * entries + seq % entries) * event.size
+            events.append(event.unpack_from(data, offset))
+        if count and reference is None:
+            reference = events[-1][0]
+
+    # Timestamps are 32 bit microseconds, sort relative to a recent event so a wrap is handled
+    if events:
+        events.sort(key=lambda e: (e[0] - reference + (1 << 31)) & 0xFFFFFFFF)
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("file")
+    parser.add_argument("--thread", type=int)
+    parser.add_argument("--op", choices=sorted(OPS.values()))
+    parser.add_argument("--min-us", type=int, default=0, help="only events lasting at least this long")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        data = f.read()
+
+    try:
+        events = decode(data)
+    except (ValueError, struct.error) as e:
+        sys.exit("%s: %s" % (args.file, e))
+
+    print("%12s %10s %3s %-12s %6s %5s %6s" % ("time [us]", "dur [us]", "thr", "op", "id", "node", "len"))
+    for time, duration, pid, node, op, thread, length in events:
+        if args.thread is not None and thread != args.thread:
+            continue
+        name = OPS.get(op, str(op))
+        if args.op and name != args.op:
+            continue
+        if duration < args.min_us:
+            continue
+        print("%12u %10u %3u %-12s %6u %5u %6u" % (time, duration, thread, name, pid, node, length))
+
+
+if __name__ == "__main__":
+    main()